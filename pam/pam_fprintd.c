@@ -207,10 +207,33 @@ typedef struct {
 	gboolean is_swipe;
 	pam_handle_t *pamh;
 	GMainLoop *loop;
+	GSource *timeout_source;
 
 	char *driver;
 } verify_data;
 
+static gboolean verify_timeout_cb (gpointer user_data);
+
+static void verify_timeout_start (verify_data *data)
+{
+	if (data->timeout_source != NULL) {
+		g_source_destroy (data->timeout_source);
+		g_source_unref (data->timeout_source);
+	}
+
+	/* Set up the timeout on our non-default context */
+	data->timeout_source = g_timeout_source_new_seconds (TIMEOUT);
+	g_source_set_callback (data->timeout_source, verify_timeout_cb, data, NULL);
+	g_source_attach (data->timeout_source, g_main_loop_get_context (data->loop));
+}
+
+static void verify_timeout_stop (verify_data *data)
+{
+	g_source_destroy (data->timeout_source);
+	g_source_unref (data->timeout_source);
+	data->timeout_source = NULL;
+}
+
 static void verify_result(GObject *object, const char *result, gboolean done, gpointer user_data)
 {
 	verify_data *data = user_data;
@@ -223,6 +246,14 @@ static void verify_result(GObject *object, const char *result, gboolean done, gp
 		return;
 	}
 
+	/* fprintd restarted the verification by itself,
+	 * give the user the full time for the next try */
+	if (g_str_equal (result, "verify-no-match")) {
+		send_err_msg (data->pamh, "Failed to match fingerprint");
+		verify_timeout_start (data);
+		return;
+	}
+
 	msg = verify_result_str_to_msg (result, data->is_swipe);
 	send_err_msg (data->pamh, msg);
 }
@@ -256,12 +287,54 @@ static gboolean verify_timeout_cb (gpointer user_data)
 	return FALSE;
 }
 
+/* Starts the verification, leaving the retries to fprintd if it
+ * supports it. Returns the number of tries that were started */
+static guint verify_start(DBusGProxy *dev, verify_data *data, gboolean *server_retries, GError **error)
+{
+	GHashTable *options;
+	GValue value = { 0, };
+	gboolean ret;
+
+	if (*server_retries == FALSE || data->max_tries == 1)
+		goto fallback;
+
+	options = g_hash_table_new (g_str_hash, g_str_equal);
+	g_value_init (&value, G_TYPE_UINT);
+	g_value_set_uint (&value, data->max_tries);
+	g_hash_table_insert (options, "max-attempts", &value);
+
+	ret = dbus_g_proxy_call (dev, "VerifyStartWithOptions", error,
+				 G_TYPE_STRING, "any",
+				 dbus_g_type_get_map ("GHashTable", G_TYPE_STRING, G_TYPE_VALUE), options,
+				 G_TYPE_INVALID, G_TYPE_INVALID);
+	g_hash_table_destroy (options);
+	g_value_unset (&value);
+
+	if (ret != FALSE)
+		return data->max_tries;
+
+	/* Older fprintd, do the retries ourselves */
+	if ((*error)->domain != DBUS_GERROR ||
+	    (*error)->code != DBUS_GERROR_REMOTE_EXCEPTION ||
+	    !dbus_g_error_has_name (*error, "org.freedesktop.DBus.Error.UnknownMethod"))
+		return 0;
+	g_error_free (*error);
+	*error = NULL;
+	*server_retries = FALSE;
+
+fallback:
+	if (!dbus_g_proxy_call (dev, "VerifyStart", error, G_TYPE_STRING, "any", G_TYPE_INVALID, G_TYPE_INVALID))
+		return 0;
+	return 1;
+}
+
 static int do_verify(GMainLoop *loop, pam_handle_t *pamh, DBusGProxy *dev)
 {
 	GError *error = NULL;
 	GHashTable *props;
 	DBusGProxy *p;
 	verify_data *data;
+	gboolean server_retries = TRUE;
 	int ret;
 
 	data = g_new0 (verify_data, 1);
@@ -297,29 +370,24 @@ static int do_verify(GMainLoop *loop, pam_handle_t *pamh, DBusGProxy *dev)
 	ret = PAM_AUTH_ERR;
 
 	while (ret == PAM_AUTH_ERR && data->max_tries > 0) {
-		GSource *source;
-		guint timeout_id;
+		guint tries;
 
-		/* Set up the timeout on our non-default context */
-		source = g_timeout_source_new_seconds (TIMEOUT);
-		timeout_id = g_source_attach (source, g_main_loop_get_context (loop));
-		g_source_set_callback (source, verify_timeout_cb, data, NULL);
+		verify_timeout_start (data);
 
 		data->timed_out = FALSE;
 
-		if (!dbus_g_proxy_call (dev, "VerifyStart", &error, G_TYPE_STRING, "any", G_TYPE_INVALID, G_TYPE_INVALID)) {
+		tries = verify_start (dev, data, &server_retries, &error);
+		if (tries == 0) {
 			D(pamh, "VerifyStart failed: %s", error->message);
 			g_error_free (error);
 
-			g_source_remove (timeout_id);
-			g_source_unref (source);
+			verify_timeout_stop (data);
 			break;
 		}
 
 		g_main_loop_run (loop);
 
-		g_source_remove (timeout_id);
-		g_source_unref (source);
+		verify_timeout_stop (data);
 
 		/* Ignore errors from VerifyStop */
 		dbus_g_proxy_call (dev, "VerifyStop", NULL, G_TYPE_INVALID, G_TYPE_INVALID);
@@ -348,7 +416,7 @@ static int do_verify(GMainLoop *loop, pam_handle_t *pamh, DBusGProxy *dev)
 			g_free (data->result);
 			data->result = NULL;
 		}
-		data->max_tries--;
+		data->max_tries -= tries;
 	}
 
 	dbus_g_proxy_disconnect_signal(dev, "VerifyStatus", G_CALLBACK(verify_result), data);
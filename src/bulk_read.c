@@ -0,0 +1,339 @@
+/*
+ * Bulk file reading for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Reads many small files as fast as the kernel allows: with io_uring,
+ * each file's statx and openat get queued together, then its read
+ * and close, with up to depth files in flight and one system call
+ * for a whole batch of them. Without io_uring, or if the kernel
+ * refuses it or lacks any of those operations, depth threads read the
+ * files the usual way.
+ *
+ * Either way, the callback gets called from the calling thread.
+ */
+
+/* For struct statx, before anything gets to include the libc headers */
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "bulk_read.h"
+
+#define BULK_READ_MAX_THREADS 16
+
+struct bulk_result {
+	guint index;
+	guchar *data;
+	gsize len;
+	int error;
+};
+
+static void read_file(const char *path, struct bulk_result *result)
+{
+	struct stat st;
+	gsize len = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		result->error = -errno;
+		return;
+	}
+	if (fstat(fd, &st) < 0) {
+		result->error = -errno;
+		close(fd);
+		return;
+	}
+
+	result->data = g_malloc(st.st_size + 1);
+	while (len < (gsize) st.st_size) {
+		ssize_t r = read(fd, result->data + len, st.st_size - len);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0)
+			result->error = -errno;
+		if (r <= 0)
+			break;
+		len += r;
+	}
+	result->len = len;
+	close(fd);
+}
+
+struct pool_data {
+	GPtrArray *paths;
+	GAsyncQueue *results;
+};
+
+/* The job is the index of the path, plus one */
+static void pool_read(gpointer data, gpointer user_data)
+{
+	struct pool_data *pool = user_data;
+	struct bulk_result *result = g_new0(struct bulk_result, 1);
+
+	result->index = GPOINTER_TO_UINT(data) - 1;
+	read_file(g_ptr_array_index(pool->paths, result->index), result);
+	g_async_queue_push(pool->results, result);
+}
+
+static void bulk_read_threads(GPtrArray *paths, guint threads,
+	bulk_read_cb func, gpointer user_data)
+{
+	struct pool_data pool;
+	GThreadPool *thread_pool;
+	guint i;
+
+	pool.paths = paths;
+	pool.results = g_async_queue_new();
+	thread_pool = g_thread_pool_new(pool_read, &pool, threads, TRUE, NULL);
+	for (i = 0; i < paths->len; i++)
+		g_thread_pool_push(thread_pool, GUINT_TO_POINTER(i + 1), NULL);
+
+	for (i = 0; i < paths->len; i++) {
+		struct bulk_result *result = g_async_queue_pop(pool.results);
+
+		func(result->index, result->data, result->len, result->error, user_data);
+		g_free(result->data);
+		g_free(result);
+	}
+
+	g_thread_pool_free(thread_pool, FALSE, TRUE);
+	g_async_queue_unref(pool.results);
+}
+
+#ifdef HAVE_LIBURING
+
+/* Operations, in the low bits of the completions' user data */
+enum uring_op {
+	OP_STATX = 0,
+	OP_OPEN,
+	OP_READ,
+	OP_CLOSE
+};
+#define OP_MASK 3
+
+struct uring_file {
+	guint index;
+	gboolean busy;
+	/* Completions still expected for the current step */
+	int pending;
+	int fd;
+	int error;
+	struct statx stx;
+	guchar *data;
+	gsize len;
+};
+
+static void queue_op(struct io_uring *ring, struct uring_file *file,
+	enum uring_op op, const char *path)
+{
+	struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+
+	switch (op) {
+	case OP_STATX:
+		io_uring_prep_statx(sqe, AT_FDCWD, path, 0, STATX_SIZE, &file->stx);
+		break;
+	case OP_OPEN:
+		io_uring_prep_openat(sqe, AT_FDCWD, path, O_RDONLY, 0);
+		break;
+	case OP_READ:
+		io_uring_prep_read(sqe, file->fd, file->data, file->stx.stx_size, 0);
+		/* The close waits for the read */
+		sqe->flags |= IOSQE_IO_LINK;
+		break;
+	case OP_CLOSE:
+		io_uring_prep_close(sqe, file->fd);
+		break;
+	}
+	io_uring_sqe_set_data(sqe, (void *) ((gsize) file | op));
+	file->pending++;
+}
+
+static void start_file(struct io_uring *ring, struct uring_file *file,
+	guint index, GPtrArray *paths)
+{
+	memset(file, 0, sizeof(*file));
+	file->index = index;
+	file->busy = TRUE;
+	file->fd = -1;
+	queue_op(ring, file, OP_STATX, g_ptr_array_index(paths, index));
+	queue_op(ring, file, OP_OPEN, g_ptr_array_index(paths, index));
+}
+
+/* Kernels from before 5.6 have io_uring, but not all of the
+ * operations needed */
+static gboolean uring_supported(void)
+{
+	static const int ops[] = {
+		IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE
+	};
+	struct io_uring_probe *probe;
+	gboolean supported = TRUE;
+	guint i;
+
+	probe = io_uring_get_probe();
+	if (probe == NULL)
+		return FALSE;
+	for (i = 0; i < G_N_ELEMENTS(ops); i++) {
+		if (!io_uring_opcode_supported(probe, ops[i]))
+			supported = FALSE;
+	}
+	io_uring_free_probe(probe);
+
+	return supported;
+}
+
+static int bulk_read_uring(GPtrArray *paths, guint depth,
+	bulk_read_cb func, gpointer user_data)
+{
+	struct io_uring ring;
+	struct uring_file *files;
+	guint next = 0, done = 0, i;
+	int r;
+
+	if (!uring_supported())
+		return -EOPNOTSUPP;
+
+	/* Two operations in flight per file at most */
+	r = io_uring_queue_init(depth * 2, &ring, 0);
+	if (r < 0)
+		return r;
+
+	files = g_new0(struct uring_file, depth);
+	for (i = 0; i < depth && next < paths->len; i++)
+		start_file(&ring, &files[i], next++, paths);
+
+	while (done < paths->len) {
+		struct io_uring_cqe *cqe;
+
+		io_uring_submit(&ring);
+		r = io_uring_wait_cqe(&ring, &cqe);
+		if (r == -EINTR)
+			continue;
+		if (r < 0)
+			break;
+
+		/* Everything completed so far, before submitting again */
+		do {
+			gsize data = (gsize) io_uring_cqe_get_data(cqe);
+			struct uring_file *file = (struct uring_file *) (data & ~(gsize) OP_MASK);
+			int res = cqe->res;
+
+			io_uring_cqe_seen(&ring, cqe);
+			file->pending--;
+
+			switch (data & OP_MASK) {
+			case OP_STATX:
+				if (res < 0 && file->error == 0)
+					file->error = res;
+				break;
+			case OP_OPEN:
+				if (res < 0 && file->error == 0)
+					file->error = res;
+				else if (res >= 0)
+					file->fd = res;
+				break;
+			case OP_READ:
+				if (res < 0 && file->error == 0)
+					file->error = res;
+				else if (res >= 0)
+					file->len = res;
+				break;
+			case OP_CLOSE:
+				/* Cancelled with a failed read, closed below */
+				if (res >= 0)
+					file->fd = -1;
+				break;
+			}
+			if (file->pending > 0)
+				continue;
+
+			/* Opened, read next, unless something failed */
+			if (file->data == NULL && file->error == 0) {
+				file->data = g_malloc(file->stx.stx_size + 1);
+				queue_op(&ring, file, OP_READ, NULL);
+				queue_op(&ring, file, OP_CLOSE, NULL);
+				continue;
+			}
+
+			if (file->fd >= 0)
+				close(file->fd);
+			func(file->index, file->data, file->len, file->error, user_data);
+			g_free(file->data);
+			file->busy = FALSE;
+			done++;
+			if (next < paths->len)
+				start_file(&ring, file, next++, paths);
+		} while (io_uring_peek_cqe(&ring, &cqe) == 0);
+	}
+
+	io_uring_queue_exit(&ring);
+
+	/* The ring broke, report the rest as failed */
+	if (done < paths->len) {
+		g_warning("io_uring failed: %s", g_strerror(-r));
+		for (i = 0; i < depth; i++) {
+			if (!files[i].busy)
+				continue;
+			if (files[i].fd >= 0)
+				close(files[i].fd);
+			func(files[i].index, NULL, 0, r, user_data);
+			g_free(files[i].data);
+		}
+		for (; next < paths->len; next++)
+			func(next, NULL, 0, r, user_data);
+	}
+	g_free(files);
+
+	return 0;
+}
+
+#endif
+
+/* Reads each of the paths, calling func with the contents, in any
+ * order, and returns how it was done, "io_uring" or "threads" */
+const char *bulk_read(GPtrArray *paths, guint depth, bulk_read_cb func,
+	gpointer user_data)
+{
+	if (depth == 0)
+		depth = 1;
+
+#ifdef HAVE_LIBURING
+	if (bulk_read_uring(paths, depth, func, user_data) == 0)
+		return "io_uring";
+#endif
+
+	/* Blocking reads don't need that many threads */
+	bulk_read_threads(paths, MIN(depth, BULK_READ_MAX_THREADS), func, user_data);
+	return "threads";
+}
+
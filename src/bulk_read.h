@@ -0,0 +1,33 @@
+/*
+ * Bulk file reading for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef BULK_READ_H
+
+#define BULK_READ_H
+
+/* error is a negative errno, data is only valid during the call */
+typedef void (*bulk_read_cb)(guint index, const guchar *data, gsize len,
+	int error, gpointer user_data);
+
+const char *bulk_read(GPtrArray *paths, guint depth, bulk_read_cb func,
+	gpointer user_data);
+
+#endif
+
@@ -0,0 +1,265 @@
+/*
+ * D-Bus workload capture for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Writes the method calls clients make to fprintd, with when they
+ * were made and who made them, so that tests/replay.c can drive
+ * another instance with the same workload. Each line is made of
+ * tab-separated fields:
+ *
+ * TIME call SENDER PATH INTERFACE MEMBER SIGNATURE ARGUMENTS
+ * TIME disconnect SENDER
+ *
+ * with TIME in microseconds since the capture started. Arguments
+ * are space-separated, strings quoted and escaped, arrays written
+ * as "[ ... ]", dictionary entries as "{ KEY VALUE }", structures as
+ * "( ... )" and variants as "< SIGNATURE VALUE >".
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <dbus/dbus-glib-bindings.h>
+#include <dbus/dbus-glib-lowlevel.h>
+#include <glib.h>
+#include <libfprint/fprint.h>
+
+#include "fprintd.h"
+#include "stats.h"
+#include "log.h"
+#include "capture.h"
+
+static FILE *capture_file = NULL;
+static guint64 capture_started = 0;
+/* Senders that made calls, to note when they go away */
+static GHashTable *senders = NULL;
+
+static void write_value(GString *out, DBusMessageIter *iter)
+{
+	DBusMessageIter sub;
+	int type = dbus_message_iter_get_arg_type(iter);
+
+	switch (type) {
+	case DBUS_TYPE_STRING:
+	case DBUS_TYPE_OBJECT_PATH:
+	case DBUS_TYPE_SIGNATURE: {
+		const char *s;
+		char *escaped;
+
+		dbus_message_iter_get_basic(iter, &s);
+		escaped = g_strescape(s, NULL);
+		g_string_append_printf(out, "\"%s\"", escaped);
+		g_free(escaped);
+		break;
+	}
+	case DBUS_TYPE_BOOLEAN: {
+		dbus_bool_t b;
+
+		dbus_message_iter_get_basic(iter, &b);
+		g_string_append(out, b ? "true" : "false");
+		break;
+	}
+	case DBUS_TYPE_BYTE: {
+		unsigned char y;
+
+		dbus_message_iter_get_basic(iter, &y);
+		g_string_append_printf(out, "%u", y);
+		break;
+	}
+	case DBUS_TYPE_INT16: {
+		dbus_int16_t n;
+
+		dbus_message_iter_get_basic(iter, &n);
+		g_string_append_printf(out, "%d", n);
+		break;
+	}
+	case DBUS_TYPE_UINT16: {
+		dbus_uint16_t q;
+
+		dbus_message_iter_get_basic(iter, &q);
+		g_string_append_printf(out, "%u", q);
+		break;
+	}
+	case DBUS_TYPE_INT32: {
+		dbus_int32_t i;
+
+		dbus_message_iter_get_basic(iter, &i);
+		g_string_append_printf(out, "%d", i);
+		break;
+	}
+	case DBUS_TYPE_UINT32: {
+		dbus_uint32_t u;
+
+		dbus_message_iter_get_basic(iter, &u);
+		g_string_append_printf(out, "%u", u);
+		break;
+	}
+	case DBUS_TYPE_INT64: {
+		dbus_int64_t x;
+
+		dbus_message_iter_get_basic(iter, &x);
+		g_string_append_printf(out, "%" G_GINT64_FORMAT, (gint64) x);
+		break;
+	}
+	case DBUS_TYPE_UINT64: {
+		dbus_uint64_t t;
+
+		dbus_message_iter_get_basic(iter, &t);
+		g_string_append_printf(out, "%" G_GUINT64_FORMAT, (guint64) t);
+		break;
+	}
+	case DBUS_TYPE_DOUBLE: {
+		double d;
+		char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+		dbus_message_iter_get_basic(iter, &d);
+		g_string_append(out, g_ascii_dtostr(buf, sizeof(buf), d));
+		break;
+	}
+	case DBUS_TYPE_ARRAY:
+	case DBUS_TYPE_STRUCT:
+	case DBUS_TYPE_DICT_ENTRY: {
+		const char *brackets = type == DBUS_TYPE_ARRAY ? "[]" :
+			type == DBUS_TYPE_STRUCT ? "()" : "{}";
+
+		g_string_append_c(out, brackets[0]);
+		dbus_message_iter_recurse(iter, &sub);
+		while (dbus_message_iter_get_arg_type(&sub) != DBUS_TYPE_INVALID) {
+			g_string_append_c(out, ' ');
+			write_value(out, &sub);
+			dbus_message_iter_next(&sub);
+		}
+		g_string_append_c(out, ' ');
+		g_string_append_c(out, brackets[1]);
+		break;
+	}
+	case DBUS_TYPE_VARIANT: {
+		char *signature;
+
+		dbus_message_iter_recurse(iter, &sub);
+		signature = dbus_message_iter_get_signature(&sub);
+		g_string_append_printf(out, "< %s ", signature);
+		dbus_free(signature);
+		write_value(out, &sub);
+		g_string_append(out, " >");
+		break;
+	}
+	default:
+		/* Unix file descriptors and the like, fprintd has none */
+		g_string_append(out, "?");
+		break;
+	}
+}
+
+static void capture_disconnect(DBusMessage *message)
+{
+	const char *name, *old_owner, *new_owner;
+
+	if (!dbus_message_get_args(message, NULL,
+				   DBUS_TYPE_STRING, &name,
+				   DBUS_TYPE_STRING, &old_owner,
+				   DBUS_TYPE_STRING, &new_owner,
+				   DBUS_TYPE_INVALID))
+		return;
+	if (*new_owner != '\0' || !g_hash_table_remove(senders, name))
+		return;
+
+	fprintf(capture_file, "%" G_GUINT64_FORMAT "\tdisconnect\t%s\n",
+		fprint_stats_now() - capture_started, name);
+	fflush(capture_file);
+}
+
+static DBusHandlerResult capture_filter(DBusConnection *conn,
+	DBusMessage *message, void *user_data)
+{
+	DBusMessageIter iter;
+	const char *interface, *sender;
+	GString *line;
+
+	if (dbus_message_is_signal(message, DBUS_INTERFACE_DBUS, "NameOwnerChanged")) {
+		capture_disconnect(message);
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+
+	interface = dbus_message_get_interface(message);
+	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL ||
+	    interface == NULL || !g_str_has_prefix(interface, "net.reactivated.Fprint"))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	sender = dbus_message_get_sender(message);
+	if (sender == NULL)
+		sender = "";
+	if (g_hash_table_lookup(senders, sender) == NULL)
+		g_hash_table_insert(senders, g_strdup(sender), GINT_TO_POINTER(1));
+
+	line = g_string_new(NULL);
+	g_string_printf(line, "%" G_GUINT64_FORMAT "\tcall\t%s\t%s\t%s\t%s\t%s\t",
+			fprint_stats_now() - capture_started, sender,
+			dbus_message_get_path(message), interface,
+			dbus_message_get_member(message),
+			dbus_message_get_signature(message));
+	if (dbus_message_iter_init(message, &iter)) {
+		do {
+			write_value(line, &iter);
+			g_string_append_c(line, ' ');
+		} while (dbus_message_iter_next(&iter));
+	}
+	g_string_append_c(line, '\n');
+
+	fputs(line->str, capture_file);
+	fflush(capture_file);
+	g_string_free(line, TRUE);
+
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+void capture_start(GKeyFile *conf)
+{
+	char *path;
+
+	path = g_key_file_get_string(conf, "debug", "capture", NULL);
+	if (path == NULL || *path == '\0') {
+		g_free(path);
+		return;
+	}
+
+	capture_file = fopen(path, "w");
+	if (capture_file == NULL) {
+		g_warning("could not open %s: %s", path, g_strerror(errno));
+		g_free(path);
+		return;
+	}
+	fprint_message(FPRINT_LOG_MAIN, "capturing D-Bus calls to %s", path);
+	g_free(path);
+
+	fputs("# fprintd D-Bus capture\n", capture_file);
+	capture_started = fprint_stats_now();
+	senders = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	dbus_connection_add_filter(dbus_g_connection_get_connection(fprintd_dbus_conn),
+				   capture_filter, NULL, NULL);
+	/* Clients that never claimed a device aren't watched otherwise */
+	dbus_bus_add_match(dbus_g_connection_get_connection(fprintd_dbus_conn),
+			   "type='signal',sender='" DBUS_SERVICE_DBUS "',"
+			   "interface='" DBUS_INTERFACE_DBUS "',member='NameOwnerChanged'",
+			   NULL);
+}
+
@@ -0,0 +1,165 @@
+/*
+ * CRC32C for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* CRC32C, the Castagnoli CRC used by iSCSI and ext4, which x86
+ * processors with SSE4.2 and ARMv8 ones with the CRC extension
+ * compute in hardware, a word per instruction. Which implementation
+ * gets used is picked on the first call, falling back to a table
+ * driven one a byte at a time.
+ *
+ * Prints are a few kilobytes, so a single stream of instructions is
+ * enough to keep checksumming well under a microsecond per print.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_X86
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#define CRC32C_ARM
+#endif
+
+#include "crc32c.h"
+
+/* Reflected form of 0x1edc6f41 */
+#define CRC32C_POLY 0x82f63b78
+
+typedef guint32 (*crc32c_func)(guint32 crc, const guchar *p, gsize len);
+
+static guint32 table[256];
+static crc32c_func func = NULL;
+static const char *method = NULL;
+
+static guint32 crc32c_table(guint32 crc, const guchar *p, gsize len)
+{
+	while (len-- > 0)
+		crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#ifdef CRC32C_X86
+__attribute__((target("sse4.2")))
+static guint32 crc32c_sse42(guint32 crc, const guchar *p, gsize len)
+{
+	while (len > 0 && ((gsize) p & 7) != 0) {
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+#ifdef __x86_64__
+	while (len >= 8) {
+		guint64 v;
+
+		memcpy(&v, p, 8);
+		crc = (guint32) _mm_crc32_u64(crc, v);
+		p += 8;
+		len -= 8;
+	}
+#endif
+	while (len >= 4) {
+		guint32 v;
+
+		memcpy(&v, p, 4);
+		crc = _mm_crc32_u32(crc, v);
+		p += 4;
+		len -= 4;
+	}
+	while (len-- > 0)
+		crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+#endif
+
+#ifdef CRC32C_ARM
+__attribute__((target("arch=armv8-a+crc")))
+static guint32 crc32c_armv8(guint32 crc, const guchar *p, gsize len)
+{
+	while (len > 0 && ((gsize) p & 7) != 0) {
+		crc = __crc32cb(crc, *p++);
+		len--;
+	}
+	while (len >= 8) {
+		guint64 v;
+
+		memcpy(&v, p, 8);
+		crc = __crc32cd(crc, v);
+		p += 8;
+		len -= 8;
+	}
+	while (len-- > 0)
+		crc = __crc32cb(crc, *p++);
+	return crc;
+}
+#endif
+
+static void crc32c_setup(void)
+{
+	static gsize done = 0;
+	guint32 i, j, crc;
+
+	if (!g_once_init_enter(&done))
+		return;
+
+#ifdef CRC32C_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) {
+		func = crc32c_sse42;
+		method = "sse4.2";
+	}
+#endif
+#ifdef CRC32C_ARM
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+		func = crc32c_armv8;
+		method = "armv8";
+	}
+#endif
+
+	if (func == NULL) {
+		for (i = 0; i < 256; i++) {
+			crc = i;
+			for (j = 0; j < 8; j++)
+				crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+			table[i] = crc;
+		}
+		func = crc32c_table;
+		method = "table";
+	}
+
+	g_once_init_leave(&done, 1);
+}
+
+guint32 crc32c(const void *data, gsize len)
+{
+	crc32c_setup();
+	return ~func(~0u, data, len);
+}
+
+/* "sse4.2", "armv8" or "table" */
+const char *crc32c_method(void)
+{
+	crc32c_setup();
+	return method;
+}
@@ -29,10 +29,18 @@
 #include <sys/types.h>
 #include <pwd.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "fprintd-marshal.h"
 #include "fprintd.h"
 #include "storage.h"
+#include "usage_stats.h"
+#include "stats.h"
+#include "probes.h"
+#include "loop_monitor.h"
+#include "log.h"
+#include "recorder.h"
 #include "egg-dbus-monitor.h"
 
 static char *fingers[] = {
@@ -57,8 +65,20 @@ static void fprint_device_release(FprintDevice *rdev,
 	DBusGMethodInvocation *context);
 static void fprint_device_verify_start(FprintDevice *rdev,
 	const char *finger_name, DBusGMethodInvocation *context);
+static void fprint_device_verify_start_with_options(FprintDevice *rdev,
+	const char *finger_name, GHashTable *options,
+	DBusGMethodInvocation *context);
 static void fprint_device_verify_stop(FprintDevice *rdev,
 	DBusGMethodInvocation *context);
+static void fprint_device_get_last_result_details(FprintDevice *rdev,
+	DBusGMethodInvocation *context);
+static void fprint_device_identify_start(FprintDevice *rdev,
+	const char **usernames, GHashTable *options,
+	DBusGMethodInvocation *context);
+static void fprint_device_identify_ack(FprintDevice *rdev,
+	guint serial, DBusGMethodInvocation *context);
+static void fprint_device_identify_stop(FprintDevice *rdev,
+	DBusGMethodInvocation *context);
 static void fprint_device_enroll_start(FprintDevice *rdev,
 	const char *finger_name, DBusGMethodInvocation *context);
 static void fprint_device_enroll_stop(FprintDevice *rdev,
@@ -69,6 +89,12 @@ static void fprint_device_list_enrolled_fingers(FprintDevice *rdev,
 static void fprint_device_delete_enrolled_fingers(FprintDevice *rdev,
 						  const char *username,
 						  DBusGMethodInvocation *context);
+static gboolean fprint_device_get_counters(FprintDevice *rdev,
+	GHashTable **counters, GError **error);
+static gboolean fprint_device_get_histograms(FprintDevice *rdev,
+	GHashTable **histograms, GError **error);
+static gboolean fprint_device_get_histogram_buckets(FprintDevice *rdev,
+	GArray **buckets, GError **error);
 
 #include "device-dbus-glue.h"
 
@@ -76,7 +102,8 @@ typedef enum {
 	ACTION_NONE = 0,
 	ACTION_IDENTIFY,
 	ACTION_VERIFY,
-	ACTION_ENROLL
+	ACTION_ENROLL,
+	ACTION_IDENTIFY_CONTINUOUS
 } FprintDeviceAction;
 
 struct session_data {
@@ -88,6 +115,86 @@ struct session_data {
 
 	/* method invocation for async ReleaseDevice() */
 	DBusGMethodInvocation *context_release_device;
+
+	/* When Claim() was called, and the device open started,
+	 * see fprint_stats_now() */
+	guint64 claim_start;
+	guint64 open_start;
+
+	/* The claiming user's fingers, most used first, discovered
+	 * while the device is being opened */
+	GSList *prints;
+	gboolean prints_discovered;
+	/* Value of store_generation when the prints were discovered */
+	guint prints_generation;
+
+	/* Print data cache, indexed by finger number, filled in from an
+	 * idle handler after the device is opened, or on demand */
+	struct fp_print_data *print_data[RIGHT_LITTLE + 1];
+	gboolean print_loaded[RIGHT_LITTLE + 1];
+	/* What loading each print returned */
+	int print_ret[RIGHT_LITTLE + 1];
+	guint prefetch_id;
+
+	/* Whether the session was started ahead of a Claim by
+	 * fprint_device_prewarm(), the source closing it again,
+	 * and the memory used by its prints */
+	gboolean prewarm;
+	gboolean prewarm_expired;
+	guint prewarm_id;
+	gsize prewarm_memory;
+};
+
+/* Where the time went in a verification attempt, see
+ * GetLastResultDetails(). Timestamps are from fprint_stats_now() */
+struct verify_timing {
+	/* VerifyStart() called, or the verification restarted */
+	guint64 start;
+	guint64 prints_loaded;
+	/* fp_async_verify_start() or fp_async_identify_start() returned */
+	guint64 armed;
+	/* the result callback ran */
+	guint64 completed;
+
+	int result;
+	int finger;
+	guint attempt;
+	/* Whether the driver passed us the scanned image */
+	gboolean image;
+
+	/* libfprint event dispatches when started, and
+	 * until the result, see loop_monitor.c */
+	guint64 dispatches;
+	guint64 wakeups;
+};
+
+struct continuous_data {
+	/* The users whose prints are in the gallery */
+	char **usernames;
+
+	/* The resident gallery, NULL-terminated, and for each print,
+	 * the index of its user in usernames and its finger */
+	struct fp_print_data **gallery;
+	guint *gallery_users;
+	int *gallery_fingers;
+
+	/* Serial of the last result sent, and of the last one the
+	 * client acknowledged. The sensor isn't re-armed while
+	 * max_unacked results are outstanding */
+	guint serial;
+	guint acked;
+	guint max_unacked;
+	gboolean paused;
+
+	/* idle handler re-arming the sensor */
+	guint rearm_id;
+	/* Whether identification is being stopped to re-arm it */
+	gboolean rearming;
+	/* Whether identification was stopped in libfprint */
+	gboolean stopped;
+
+	/* method invocation for async IdentifyStop() */
+	DBusGMethodInvocation *context_stop;
 };
 
 struct FprintDevicePrivate {
@@ -112,9 +219,12 @@ struct FprintDevicePrivate {
 	GHashTable *clients;
 
 	/* The data passed to fp_async_verify_start or
-	 * fp_async_identify_start */
+	 * fp_async_identify_start, owned by the session's print cache */
 	struct fp_print_data *verify_data;
 	struct fp_print_data **identify_data;
+	/* The fingers matching the above print data */
+	int verify_finger;
+	int *identify_fingers;
 
 	/* whether we're running an identify, or a verify */
 	FprintDeviceAction current_action;
@@ -122,6 +232,34 @@ struct FprintDevicePrivate {
 	gboolean action_done;
 	/* Whether the device was disconnected */
 	gboolean disconnected;
+
+	/* How many more no-match results will restart the verification
+	 * instead of finishing it, see VerifyStartWithOptions() */
+	guint attempts_left;
+	/* idle handler restarting the verification */
+	guint restart_id;
+	/* Whether the verification is being stopped to restart it */
+	gboolean restarting;
+	/* Whether the verification was already stopped in libfprint,
+	 * so VerifyStop only needs to clean up */
+	gboolean stopped;
+
+	/* Continuous identification, see IdentifyStart() */
+	struct continuous_data *continuous;
+
+	/* Counters and latency histograms, and when the current
+	 * verification, identification or enrollment stage started */
+	struct fprint_stats *stats;
+	guint64 action_start;
+
+	/* Where libfprint's results get recorded, if enabled */
+	struct recorder *recorder;
+
+	/* Timing of the verification in progress, and of the
+	 * last result sent out */
+	struct verify_timing timing;
+	struct verify_timing last_timing;
+	gboolean have_last_timing;
 };
 
 typedef struct FprintDevicePrivate FprintDevicePrivate;
@@ -140,6 +278,7 @@ enum fprint_device_signals {
 	SIGNAL_VERIFY_STATUS,
 	SIGNAL_VERIFY_FINGER_SELECTED,
 	SIGNAL_ENROLL_STATUS,
+	SIGNAL_IDENTIFY_RESULT,
 	NUM_SIGNALS,
 };
 
@@ -147,12 +286,28 @@ static GObjectClass *parent_class = NULL;
 static guint32 last_id = ~0;
 static guint signals[NUM_SIGNALS] = { 0, };
 
+/* Number of log messages dumped on driver errors */
+#define LOG_DUMP_ENTRIES 32
+
+/* Bumped every time we modify the store, so that print caches
+ * can tell when they are stale */
+static guint store_generation = 0;
+
+/* Budget for pre-warmed sessions, see fprint_device_prewarm() */
+static guint prewarm_max_concurrent = 1;
+static gsize prewarm_max_memory = 256 * 1024;
+static guint prewarm_window = 30;
+static guint prewarm_active = 0;
+static gsize prewarm_memory = 0;
+
 static void fprint_device_finalize(GObject *object)
 {
 	FprintDevice *self = (FprintDevice *) object;
 	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(self);
 
 	g_hash_table_destroy (priv->clients);
+	fprint_stats_free_device (priv->stats);
+	recorder_free (priv->recorder);
 	/* FIXME close and stuff */
 }
 
@@ -180,7 +335,8 @@ static void fprint_device_get_property(GObject *object, guint property_id,
 
 	switch (property_id) {
 	case FPRINT_DEVICE_IN_USE:
-		g_value_set_boolean(value, g_hash_table_size (priv->clients) != 0);
+		g_value_set_boolean(value, g_hash_table_size (priv->clients) != 0 ||
+				    (priv->session != NULL && priv->session->prewarm));
 		break;
 	case FPRINT_DEVICE_NAME:
 		g_value_set_static_string (value, fp_driver_get_full_name (fp_dscv_dev_get_driver (priv->ddev)));
@@ -261,6 +417,10 @@ static void fprint_device_class_init(FprintDeviceClass *klass)
 	signals[SIGNAL_VERIFY_FINGER_SELECTED] = g_signal_new("verify-finger-selected",
 		G_TYPE_FROM_CLASS(gobject_class), G_SIGNAL_RUN_LAST, 0, NULL, NULL,
 		g_cclosure_marshal_VOID__STRING, G_TYPE_NONE, 1, G_TYPE_STRING);
+	signals[SIGNAL_IDENTIFY_RESULT] = g_signal_new("identify-result",
+		G_TYPE_FROM_CLASS(gobject_class), G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+		fprintd_marshal_VOID__STRING_STRING_STRING_UINT, G_TYPE_NONE, 4,
+		G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT);
 }
 
 static gboolean
@@ -297,19 +457,38 @@ pk_io_remove_watch (PolKitContext *pk_context, int watch_id)
 	g_source_remove (watch_id);
 }
 
+/* One PolicyKit context, and its configuration watches, is shared
+ * by all the devices */
+static PolKitContext *
+get_polkit_context (void)
+{
+	static PolKitContext *pol_ctx = NULL;
+	static gboolean failed = FALSE;
+
+	if (pol_ctx != NULL || failed)
+		return pol_ctx;
+
+	pol_ctx = polkit_context_new ();
+	polkit_context_set_io_watch_functions (pol_ctx, pk_io_add_watch, pk_io_remove_watch);
+	if (!polkit_context_init (pol_ctx, NULL)) {
+		g_critical ("cannot initialize libpolkit");
+		polkit_context_unref (pol_ctx);
+		pol_ctx = NULL;
+		failed = TRUE;
+	}
+
+	return pol_ctx;
+}
+
 static void fprint_device_init(FprintDevice *device)
 {
 	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(device);
 	priv->id = ++last_id;
+	priv->stats = fprint_stats_new_device (priv->id);
+	priv->recorder = recorder_new (priv->id);
 
 	/* Setup PolicyKit */
-	priv->pol_ctx = polkit_context_new ();
-	polkit_context_set_io_watch_functions (priv->pol_ctx, pk_io_add_watch, pk_io_remove_watch);
-	if (!polkit_context_init (priv->pol_ctx, NULL)) {
-		g_critical ("cannot initialize libpolkit");
-		polkit_context_unref (priv->pol_ctx);
-		priv->pol_ctx = NULL;
-	}
+	priv->pol_ctx = get_polkit_context ();
 	priv->clients = g_hash_table_new_full (g_str_hash,
 					       g_str_equal,
 					       g_free,
@@ -328,6 +507,14 @@ guint32 _fprint_device_get_id(FprintDevice *rdev)
 	return DEVICE_GET_PRIVATE(rdev)->id;
 }
 
+void fprint_device_set_prewarm_budget(guint max_concurrent, gsize max_memory,
+	guint window)
+{
+	prewarm_max_concurrent = max_concurrent;
+	prewarm_max_memory = max_memory;
+	prewarm_window = window;
+}
+
 static const char *
 finger_num_to_name (int finger_num)
 {
@@ -411,6 +598,15 @@ set_disconnected (FprintDevicePrivate *priv, const char *res)
 		priv->disconnected = TRUE;
 }
 
+/* Driver errors get the last debug messages written out,
+ * if they were kept, see fprint_log_dump() */
+static void
+log_driver_error (int r)
+{
+	if (r < 0)
+		fprint_log_dump (LOG_DUMP_ENTRIES);
+}
+
 static gboolean
 _fprint_device_check_claimed (FprintDevice *rdev,
 			      DBusGMethodInvocation *context,
@@ -442,7 +638,7 @@ _fprint_device_check_claimed (FprintDevice *rdev,
 }
 
 static gboolean
-_fprint_device_check_polkit_for_action (FprintDevice *rdev, DBusGMethodInvocation *context, const char *action, GError **error)
+_fprint_device_query_polkit (FprintDevice *rdev, DBusGMethodInvocation *context, const char *action, GError **error)
 {
 	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
 	const char *sender;
@@ -499,6 +695,19 @@ _fprint_device_check_polkit_for_action (FprintDevice *rdev, DBusGMethodInvocatio
 	return TRUE;
 }
 
+static gboolean
+_fprint_device_check_polkit_for_action (FprintDevice *rdev, DBusGMethodInvocation *context, const char *action, GError **error)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	gboolean ret;
+
+	FPRINTD_PROBE2(polkit__start, priv->id, action);
+	ret = _fprint_device_query_polkit (rdev, context, action, error);
+	FPRINTD_PROBE3(polkit__done, priv->id, action, ret);
+
+	return ret;
+}
+
 static gboolean
 _fprint_device_check_polkit_for_actions (FprintDevice *rdev,
 					 DBusGMethodInvocation *context,
@@ -576,12 +785,152 @@ _fprint_device_check_for_username (FprintDevice *rdev,
 	return g_strdup (username);
 }
 
+static void
+session_flush_prints (struct session_data *session)
+{
+	guint i;
+
+	if (session->prefetch_id != 0) {
+		g_source_remove (session->prefetch_id);
+		session->prefetch_id = 0;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (session->print_data); i++) {
+		if (session->print_data[i] != NULL)
+			fp_print_data_free (session->print_data[i]);
+		session->print_data[i] = NULL;
+		session->print_loaded[i] = FALSE;
+	}
+
+	g_slist_free (session->prints);
+	session->prints = NULL;
+	session->prints_discovered = FALSE;
+}
+
+static void
+session_free (struct session_data *session)
+{
+	session_flush_prints (session);
+	g_slice_free (struct session_data, session);
+}
+
+static void
+session_discover_prints (FprintDevice *rdev)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct session_data *session = priv->session;
+	guint64 start;
+
+	/* Throw away anything loaded before the store was modified */
+	if (session->prints_discovered &&
+	    session->prints_generation != store_generation)
+		session_flush_prints (session);
+
+	if (session->prints_discovered)
+		return;
+
+	start = fprint_stats_now ();
+	FPRINTD_PROBE2(store__start, priv->id, PROBE_STORE_DISCOVER);
+	session->prints = store.discover_prints (priv->ddev, priv->username);
+	FPRINTD_PROBE3(store__done, priv->id, PROBE_STORE_DISCOVER, g_slist_length (session->prints));
+	fprint_stats_record (priv->stats, STATS_PHASE_STORE_DISCOVER, start);
+	session->prints = usage_stats_sort_prints (priv->username, priv->ddev, session->prints);
+	session->prints_discovered = TRUE;
+	session->prints_generation = store_generation;
+}
+
+static struct fp_print_data *
+session_get_print (FprintDevice *rdev, int finger, int *ret)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct session_data *session = priv->session;
+	struct fp_print_data *data = NULL;
+	guint64 start;
+	int r;
+
+	if (session->print_loaded[finger]) {
+		*ret = session->print_ret[finger];
+		return session->print_data[finger];
+	}
+
+	start = fprint_stats_now ();
+	FPRINTD_PROBE2(store__start, priv->id, PROBE_STORE_LOAD);
+	r = store.print_data_load (priv->dev, finger, &data, priv->username);
+	FPRINTD_PROBE3(store__done, priv->id, PROBE_STORE_LOAD, r);
+	fprint_stats_record (priv->stats, STATS_PHASE_STORE_LOAD, start);
+	if (r == -EUCLEAN)
+		fprint_stats_count (priv->stats, STATS_CORRUPT_PRINTS);
+	if (r < 0 || data == NULL) {
+		data = NULL;
+		if (r == 0)
+			r = -ENOENT;
+	}
+
+	session->print_data[finger] = data;
+	session->print_loaded[finger] = TRUE;
+	session->print_ret[finger] = r;
+	*ret = r;
+
+	if (session->prewarm && data != NULL) {
+		guchar *buf;
+		gsize len;
+
+		len = fp_print_data_get_data (data, &buf);
+		free (buf);
+		session->prewarm_memory += len;
+		prewarm_memory += len;
+	}
+
+	return data;
+}
+
+static gboolean
+session_prefetch_cb (gpointer user_data)
+{
+	FprintDevice *rdev = user_data;
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct session_data *session = priv->session;
+	GSList *l;
+	int r;
+
+	/* Pre-warmed sessions stop once over budget, the rest gets
+	 * loaded if they get claimed */
+	if (session->prewarm && prewarm_memory >= prewarm_max_memory) {
+		g_message ("pre-warm memory budget reached, not loading more prints");
+		session->prefetch_id = 0;
+		return FALSE;
+	}
+
+	/* Load one print per iteration, so that we don't hold up
+	 * VerifyStart, or other clients' requests */
+	for (l = session->prints; l != NULL; l = l->next) {
+		int finger = GPOINTER_TO_INT (l->data);
+
+		if (!session->print_loaded[finger]) {
+			session_get_print (rdev, finger, &r);
+			break;
+		}
+	}
+
+	/* Only the first finger is used for verification */
+	if (l != NULL && l->next != NULL &&
+	    fp_dev_supports_identification (priv->dev))
+		return TRUE;
+
+	session->prefetch_id = 0;
+	return FALSE;
+}
+
 static void action_stop_cb(struct fp_dev *dev, void *user_data)
 {
 	gboolean *done = (gboolean *) user_data;
 	*done = TRUE;
 }
 
+static void verify_cancel_restart(FprintDevice *rdev);
+static void continuous_cancel_rearm(FprintDevice *rdev);
+static void continuous_free(struct continuous_data *c);
+
 static void
 _fprint_device_client_disconnected (EggDbusMonitor *monitor, gboolean connected, FprintDevice *rdev)
 {
@@ -594,15 +943,21 @@ _fprint_device_client_disconnected (EggDbusMonitor *monitor, gboolean connected,
 		/* Was that the client that claimed the device? */
 		if (priv->sender != NULL) {
 			gboolean done = FALSE;
+
+			verify_cancel_restart (rdev);
 			switch (priv->current_action) {
 			case ACTION_NONE:
 				break;
 			case ACTION_IDENTIFY:
+				if (priv->stopped)
+					break;
 				fp_async_identify_stop(priv->dev, action_stop_cb, &done);
 				while (done == FALSE)
 					g_main_context_iteration (NULL, TRUE);
 				break;
 			case ACTION_VERIFY:
+				if (priv->stopped)
+					break;
 				fp_async_verify_stop(priv->dev, action_stop_cb, &done);
 				while (done == FALSE)
 					g_main_context_iteration (NULL, TRUE);
@@ -612,14 +967,37 @@ _fprint_device_client_disconnected (EggDbusMonitor *monitor, gboolean connected,
 				while (done == FALSE)
 					g_main_context_iteration (NULL, TRUE);
 				break;
+			case ACTION_IDENTIFY_CONTINUOUS:
+				continuous_cancel_rearm (rdev);
+				if (!priv->continuous->stopped) {
+					fp_async_identify_stop(priv->dev, action_stop_cb, &done);
+					while (done == FALSE)
+						g_main_context_iteration (NULL, TRUE);
+				}
+				continuous_free (priv->continuous);
+				priv->continuous = NULL;
+				break;
 			}
 			priv->current_action = ACTION_NONE;
+			priv->stopped = FALSE;
 			done = FALSE;
 
 			/* Close the claimed device as well */
 			fp_async_dev_close (priv->dev, action_stop_cb, &done);
 			while (done == FALSE)
 				g_main_context_iteration (NULL, TRUE);
+			priv->dev = NULL;
+
+			priv->verify_data = NULL;
+			g_free (priv->identify_data);
+			priv->identify_data = NULL;
+			g_free (priv->identify_fingers);
+			priv->identify_fingers = NULL;
+
+			if (priv->session != NULL) {
+				session_free (priv->session);
+				priv->session = NULL;
+			}
 
 			g_free (priv->sender);
 			priv->sender = NULL;
@@ -652,28 +1030,134 @@ _fprint_device_add_client (FprintDevice *rdev, const char *sender)
 	}
 }
 
+static void
+_fprint_device_prewarm_finish (FprintDevice *rdev)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct session_data *session = priv->session;
+
+	if (!session->prewarm)
+		return;
+
+	if (session->prewarm_id != 0) {
+		g_source_remove (session->prewarm_id);
+		session->prewarm_id = 0;
+	}
+
+	prewarm_active--;
+	prewarm_memory -= session->prewarm_memory;
+	session->prewarm_memory = 0;
+	session->prewarm = FALSE;
+
+	g_object_notify (G_OBJECT (rdev), "in-use");
+}
+
+static void
+_fprint_device_prewarm_close (FprintDevice *rdev)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	gboolean done = FALSE;
+
+	g_message ("closing pre-warmed device %d for '%s'", priv->id, priv->username);
+
+	session_free (priv->session);
+	priv->session = NULL;
+	g_free (priv->username);
+	priv->username = NULL;
+
+	fp_async_dev_close (priv->dev, action_stop_cb, &done);
+	while (done == FALSE)
+		g_main_context_iteration (NULL, TRUE);
+	priv->dev = NULL;
+}
+
+/* dev_open_cb() runs from within the libfprint event source, which
+ * can't dispatch the close completion, so it closes from here */
+static gboolean
+_fprint_device_prewarm_close_cb (gpointer user_data)
+{
+	FprintDevice *rdev = user_data;
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+
+	priv->session->prewarm_id = 0;
+	_fprint_device_prewarm_close (rdev);
+
+	return FALSE;
+}
+
+static gboolean
+_fprint_device_prewarm_expired_cb (gpointer user_data)
+{
+	FprintDevice *rdev = user_data;
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct session_data *session = priv->session;
+
+	session->prewarm_id = 0;
+	_fprint_device_prewarm_finish (rdev);
+
+	/* Still opening, dev_open_cb() will close it */
+	if (priv->dev == NULL)
+		session->prewarm_expired = TRUE;
+	else
+		_fprint_device_prewarm_close (rdev);
+
+	return FALSE;
+}
+
 static void dev_open_cb(struct fp_dev *dev, int status, void *user_data)
 {
 	FprintDevice *rdev = user_data;
 	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
 	struct session_data *session = priv->session;
 
-	g_message("device %d claim status %d", priv->id, status);
+	fprint_message(FPRINT_LOG_DEVICE, "device %d claim status %d", priv->id, status);
+	FPRINTD_PROBE2(dev__open, priv->id, status);
+	fprint_stats_record (priv->stats, STATS_PHASE_OPEN, session->open_start);
+	recorder_event (priv->recorder, "open", status, session->open_start, NULL);
 
 	if (status != 0) {
-		GError *error;
+		GError *error = NULL;
+
+		if (session->prewarm)
+			_fprint_device_prewarm_finish (rdev);
 
 		g_free (priv->sender);
 		priv->sender = NULL;
+		g_free (priv->username);
+		priv->username = NULL;
 
-		g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
-			"Open failed with error %d", status);
-		dbus_g_method_return_error(session->context_claim_device, error);
+		priv->session = NULL;
+
+		if (session->context_claim_device != NULL) {
+			FPRINTD_PROBE2(claim__done, priv->id, status);
+			g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
+				"Open failed with error %d", status);
+			dbus_g_method_return_error(session->context_claim_device, error);
+		}
+		session_free (session);
 		return;
 	}
 
 	priv->dev = dev;
-	dbus_g_method_return(session->context_claim_device);
+
+	/* Nobody claimed the pre-warmed device in time. A Claim that
+	 * came in meanwhile cleared the flag, and gets its reply below */
+	if (session->prewarm_expired && session->context_claim_device == NULL) {
+		session->prewarm_id = g_idle_add (_fprint_device_prewarm_close_cb, rdev);
+		return;
+	}
+
+	/* Start loading the prints while the client gets around
+	 * to calling VerifyStart */
+	if (session->prints != NULL)
+		session->prefetch_id = g_idle_add (session_prefetch_cb, rdev);
+
+	/* Nothing to reply to for pre-warmed devices */
+	if (session->context_claim_device != NULL) {
+		fprint_stats_record (priv->stats, STATS_PHASE_CLAIM, session->claim_start);
+		FPRINTD_PROBE2(claim__done, priv->id, 0);
+		dbus_g_method_return(session->context_claim_device);
+	}
 }
 
 static void fprint_device_claim(FprintDevice *rdev,
@@ -683,17 +1167,21 @@ static void fprint_device_claim(FprintDevice *rdev,
 	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
 	GError *error = NULL;
 	char *sender, *user;
+	guint64 start = fprint_stats_now ();
 	int r;
 
+	FPRINTD_PROBE1(claim__start, priv->id);
+
 	/* Is it already claimed? */
 	if (priv->sender != NULL) {
+		FPRINTD_PROBE2(claim__done, priv->id, -EBUSY);
 		g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_ALREADY_IN_USE,
 			    "Device was already claimed");
 		dbus_g_method_return_error(context, error);
 		return;
 	}
 
-	g_assert (priv->username == NULL);
+	g_assert (priv->username == NULL || priv->session != NULL);
 	g_assert (priv->sender == NULL);
 
 	sender = NULL;
@@ -703,6 +1191,7 @@ static void fprint_device_claim(FprintDevice *rdev,
 						  &sender,
 						  &error);
 	if (user == NULL) {
+		FPRINTD_PROBE2(claim__done, priv->id, -EPERM);
 		g_free (sender);
 		dbus_g_method_return_error (context, error);
 		g_error_free (error);
@@ -713,6 +1202,7 @@ static void fprint_device_claim(FprintDevice *rdev,
 						     "net.reactivated.fprint.device.verify",
 						     "net.reactivated.fprint.device.enroll",
 						     &error) == FALSE) {
+		FPRINTD_PROBE2(claim__done, priv->id, -EPERM);
 		g_free (sender);
 		g_free (user);
 		dbus_g_method_return_error (context, error);
@@ -721,6 +1211,46 @@ static void fprint_device_claim(FprintDevice *rdev,
 
 	_fprint_device_add_client (rdev, sender);
 
+	/* The device was pre-warmed, so it's either open or being
+	 * opened, and the prints for the expected user might be loaded */
+	if (priv->session != NULL) {
+		struct session_data *session = priv->session;
+
+		_fprint_device_prewarm_finish (rdev);
+		/* The window ran out while opening, the Claim keeps it open */
+		if (session->prewarm_expired) {
+			if (session->prewarm_id != 0) {
+				g_source_remove (session->prewarm_id);
+				session->prewarm_id = 0;
+			}
+			session->prewarm_expired = FALSE;
+		}
+
+		if (!g_str_equal (priv->username, user))
+			session_flush_prints (session);
+		g_free (priv->username);
+		priv->username = user;
+		priv->sender = sender;
+
+		g_message ("user '%s' claiming the pre-warmed device: %d", priv->username, priv->id);
+
+		if (priv->dev == NULL) {
+			/* Replied to from dev_open_cb() */
+			session->context_claim_device = context;
+			session->claim_start = start;
+			return;
+		}
+
+		session_discover_prints (rdev);
+		if (session->prints != NULL && session->prefetch_id == 0)
+			session->prefetch_id = g_idle_add (session_prefetch_cb, rdev);
+
+		fprint_stats_record (priv->stats, STATS_PHASE_CLAIM, start);
+		FPRINTD_PROBE2(claim__done, priv->id, 0);
+		dbus_g_method_return(context);
+		return;
+	}
+
 	priv->username = user;
 	priv->sender = sender;
 
@@ -728,10 +1258,12 @@ static void fprint_device_claim(FprintDevice *rdev,
 
 	priv->session = g_slice_new0(struct session_data);
 	priv->session->context_claim_device = context;
+	priv->session->claim_start = start;
 
+	priv->session->open_start = fprint_stats_now ();
 	r = fp_async_dev_open(priv->ddev, dev_open_cb, rdev);
 	if (r < 0) {
-		g_slice_free(struct session_data, priv->session);
+		session_free (priv->session);
 		priv->session = NULL;
 
 		g_free (priv->username);
@@ -739,10 +1271,71 @@ static void fprint_device_claim(FprintDevice *rdev,
 		g_free (priv->sender);
 		priv->sender = NULL;
 
+		FPRINTD_PROBE2(claim__done, priv->id, r);
 		g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
 			"Could not attempt device open, error %d", r);
 		dbus_g_method_return_error(context, error);
+		return;
+	}
+
+	/* We already know whose prints will be needed, so look for them
+	 * while the device is being opened */
+	session_discover_prints (rdev);
+}
+
+/* Opens the device and starts loading the prints for username, when we
+ * expect that user to authenticate soon, for example when their session
+ * gets locked. The session is handed over to the next Claim, or closed
+ * if none comes within the pre-warm window. */
+gboolean fprint_device_prewarm(FprintDevice *rdev, const char *username)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct session_data *session;
+	int r;
+
+	/* Claimed, or already pre-warmed */
+	if (priv->session != NULL || priv->sender != NULL)
+		return FALSE;
+
+	if (prewarm_active >= prewarm_max_concurrent) {
+		g_message ("not pre-warming device %d for '%s', too many pre-warmed devices",
+			   priv->id, username);
+		return FALSE;
 	}
+
+	session = g_slice_new0(struct session_data);
+	session->prewarm = TRUE;
+	priv->session = session;
+	priv->username = g_strdup (username);
+
+	/* No point in opening the device for users who can't
+	 * use it, such as the display manager's */
+	session_discover_prints (rdev);
+	if (session->prints == NULL)
+		goto bail;
+
+	g_message ("pre-warming device %d for '%s'", priv->id, username);
+
+	session->open_start = fprint_stats_now ();
+	r = fp_async_dev_open(priv->ddev, dev_open_cb, rdev);
+	if (r < 0)
+		goto bail;
+
+	prewarm_active++;
+	session->prewarm_id = g_timeout_add_seconds (prewarm_window,
+						     _fprint_device_prewarm_expired_cb,
+						     rdev);
+
+	g_object_notify (G_OBJECT (rdev), "in-use");
+
+	return TRUE;
+
+bail:
+	session_free (session);
+	priv->session = NULL;
+	g_free (priv->username);
+	priv->username = NULL;
+	return FALSE;
 }
 
 static void dev_close_cb(struct fp_dev *dev, void *user_data)
@@ -753,15 +1346,24 @@ static void dev_close_cb(struct fp_dev *dev, void *user_data)
 	DBusGMethodInvocation *context = session->context_release_device;
 
 	priv->dev = NULL;
-	g_slice_free(struct session_data, session);
+	session_free (session);
 	priv->session = NULL;
 
+	if (priv->continuous != NULL) {
+		continuous_free (priv->continuous);
+		priv->continuous = NULL;
+		priv->current_action = ACTION_NONE;
+	}
+
 	g_free (priv->sender);
 	priv->sender = NULL;
 
 	g_free (priv->username);
 	priv->username = NULL;
 
+	/* The next user doesn't get to see this one's results */
+	priv->have_last_timing = FALSE;
+
 	g_message("released device %d", priv->id);
 	dbus_g_method_return(context);
 }
@@ -787,70 +1389,226 @@ static void fprint_device_release(FprintDevice *rdev,
 		return;
 	}
 
+	if (priv->continuous != NULL)
+		continuous_cancel_rearm (rdev);
+
 	session->context_release_device = context;
 	fp_async_dev_close(priv->dev, dev_close_cb, rdev);
 }
 
 static void verify_cb(struct fp_dev *dev, int r, struct fp_img *img,
-		      void *user_data)
+		      void *user_data);
+static void identify_cb(struct fp_dev *dev, int r,
+			size_t match_offset, struct fp_img *img, void *user_data);
+
+static void verify_restart_stopped_cb(struct fp_dev *dev, void *user_data)
 {
-	struct FprintDevice *rdev = user_data;
+	FprintDevice *rdev = user_data;
 	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
-	const char *name = verify_result_to_name (r);
+	int r;
 
-	if (priv->action_done != FALSE)
+	priv->restarting = FALSE;
+	priv->stopped = TRUE;
+
+	/* Cancelled by VerifyStop() or the client going away */
+	if (priv->attempts_left == 0)
 		return;
 
-	g_message("verify_cb: result %s (%d)", name, r);
+	priv->action_done = FALSE;
+	/* The prints are still resident, so each attempt is
+	 * timed on its own */
+	priv->timing.start = fprint_stats_now ();
+	priv->timing.prints_loaded = priv->timing.start;
+	priv->timing.attempt++;
+	priv->timing.dispatches = loop_monitor_get_dispatches ();
+	FPRINTD_PROBE3(verify__start, priv->id, priv->current_action, priv->verify_finger);
+	if (priv->current_action == ACTION_IDENTIFY)
+		r = fp_async_identify_start(priv->dev, priv->identify_data, identify_cb, rdev);
+	else
+		r = fp_async_verify_start(priv->dev, priv->verify_data, verify_cb, rdev);
+	priv->action_start = fprint_stats_now ();
+	priv->timing.armed = priv->action_start;
 
-	if (r == FP_VERIFY_NO_MATCH || r == FP_VERIFY_MATCH || r < 0)
+	if (r < 0) {
+		fprint_message(FPRINT_LOG_DEVICE, "restarting verification on device %d failed with error %d", priv->id, r);
 		priv->action_done = TRUE;
-	set_disconnected (priv, name);
-	g_signal_emit(rdev, signals[SIGNAL_VERIFY_STATUS], 0, name, priv->action_done);
-	fp_img_free(img);
-
-	if (priv->action_done && priv->verify_data) {
-		fp_print_data_free (priv->verify_data);
-		priv->verify_data = NULL;
+		g_signal_emit(rdev, signals[SIGNAL_VERIFY_STATUS], 0,
+			      verify_result_to_name (r), TRUE);
+		return;
 	}
+	priv->stopped = FALSE;
 }
 
-static void identify_cb(struct fp_dev *dev, int r,
-			 size_t match_offset, struct fp_img *img, void *user_data)
+static gboolean verify_restart_cb(gpointer user_data)
 {
-	struct FprintDevice *rdev = user_data;
+	FprintDevice *rdev = user_data;
 	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
-	const char *name = verify_result_to_name (r);
+	int r;
 
-	if (priv->action_done != FALSE)
-		return;
+	priv->restart_id = 0;
+	priv->restarting = TRUE;
 
-	g_message("identify_cb: result %s (%d)", name, r);
+	if (priv->current_action == ACTION_IDENTIFY)
+		r = fp_async_identify_stop(priv->dev, verify_restart_stopped_cb, rdev);
+	else
+		r = fp_async_verify_stop(priv->dev, verify_restart_stopped_cb, rdev);
 
-	if (r == FP_VERIFY_NO_MATCH || r == FP_VERIFY_MATCH || r < 0)
+	if (r < 0) {
+		fprint_message(FPRINT_LOG_DEVICE, "stopping verification on device %d failed with error %d", priv->id, r);
+		priv->restarting = FALSE;
+		priv->attempts_left = 0;
 		priv->action_done = TRUE;
-	set_disconnected (priv, name);
-	g_signal_emit(rdev, signals[SIGNAL_VERIFY_STATUS], 0, name, priv->action_done);
-	fp_img_free(img);
-
-	if (priv->action_done && priv->identify_data != NULL) {
-		guint i;
-		for (i = 0; priv->identify_data[i] != NULL; i++)
-			fp_print_data_free(priv->identify_data[i]);
-		g_free (priv->identify_data);
-		priv->identify_data = NULL;
+		g_signal_emit(rdev, signals[SIGNAL_VERIFY_STATUS], 0,
+			      verify_result_to_name (r), TRUE);
 	}
+
+	return FALSE;
 }
 
-static void fprint_device_verify_start(FprintDevice *rdev,
-	const char *finger_name, DBusGMethodInvocation *context)
+/* Called on every verify or identify result, returns TRUE when a
+ * no-match was turned into an intermediate status, and the
+ * verification will be restarted with the same print data */
+static gboolean verify_should_restart(FprintDevice *rdev, int r, const char *name)
 {
 	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
-	struct fp_print_data **gallery = NULL;
-	struct fp_print_data *data = NULL;
-	GError *error = NULL;
-	guint finger_num = finger_name_to_num (finger_name);
-	int r;
+
+	if (r != FP_VERIFY_NO_MATCH || priv->attempts_left <= 1)
+		return FALSE;
+
+	priv->attempts_left--;
+	fprint_message(FPRINT_LOG_DEVICE, "restarting verification on device %d, %d attempts left",
+		       priv->id, priv->attempts_left);
+
+	/* Ignore anything else the driver sends until we restarted */
+	priv->action_done = TRUE;
+	g_signal_emit(rdev, signals[SIGNAL_VERIFY_STATUS], 0, name, FALSE);
+	priv->restart_id = g_idle_add (verify_restart_cb, rdev);
+
+	return TRUE;
+}
+
+/* Stops any pending restart, waiting for an in-flight stop to
+ * finish, after which priv->stopped tells whether libfprint
+ * still needs stopping */
+static void verify_cancel_restart(FprintDevice *rdev)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+
+	priv->attempts_left = 0;
+	if (priv->restart_id != 0) {
+		g_source_remove (priv->restart_id);
+		priv->restart_id = 0;
+	}
+	while (priv->restarting)
+		g_main_context_iteration (NULL, TRUE);
+}
+
+/* Called on every verify or identify result, before it is sent out */
+static void verify_timing_done(FprintDevicePrivate *priv, int r,
+			       int finger, struct fp_img *img)
+{
+	priv->timing.completed = fprint_stats_now ();
+	priv->timing.wakeups = loop_monitor_get_dispatches () - priv->timing.dispatches;
+	priv->timing.result = r;
+	priv->timing.finger = finger;
+	priv->timing.image = (img != NULL);
+	priv->last_timing = priv->timing;
+	priv->have_last_timing = TRUE;
+}
+
+static void verify_cb(struct fp_dev *dev, int r, struct fp_img *img,
+		      void *user_data)
+{
+	struct FprintDevice *rdev = user_data;
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	const char *name = verify_result_to_name (r);
+
+	if (priv->action_done != FALSE)
+		return;
+
+	fprint_message(FPRINT_LOG_DEVICE, "verify_cb: result %s (%d)", name, r);
+	recorder_event (priv->recorder, "verify", r, priv->action_start, img);
+	FPRINTD_PROBE3(verify__result, priv->id, ACTION_VERIFY, r);
+	fprint_stats_verify_result (priv->stats, r);
+	if (r == FP_VERIFY_NO_MATCH || r == FP_VERIFY_MATCH)
+		fprint_stats_record (priv->stats, STATS_PHASE_VERIFY, priv->action_start);
+	verify_timing_done (priv, r, priv->verify_finger, img);
+
+	if (verify_should_restart (rdev, r, name)) {
+		fp_img_free(img);
+		return;
+	}
+
+	if (r == FP_VERIFY_NO_MATCH || r == FP_VERIFY_MATCH || r < 0)
+		priv->action_done = TRUE;
+	if (r == FP_VERIFY_MATCH)
+		usage_stats_record_match (priv->username, priv->ddev, priv->verify_finger);
+	set_disconnected (priv, name);
+	log_driver_error (r);
+	g_signal_emit(rdev, signals[SIGNAL_VERIFY_STATUS], 0, name, priv->action_done);
+	fp_img_free(img);
+
+	if (priv->action_done)
+		priv->verify_data = NULL;
+}
+
+static void identify_cb(struct fp_dev *dev, int r,
+			 size_t match_offset, struct fp_img *img, void *user_data)
+{
+	struct FprintDevice *rdev = user_data;
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	const char *name = verify_result_to_name (r);
+
+	if (priv->action_done != FALSE)
+		return;
+
+	fprint_message(FPRINT_LOG_DEVICE, "identify_cb: result %s (%d)", name, r);
+	recorder_event (priv->recorder, "identify", r, priv->action_start, img);
+	FPRINTD_PROBE3(verify__result, priv->id, ACTION_IDENTIFY, r);
+	fprint_stats_verify_result (priv->stats, r);
+	if (r == FP_VERIFY_NO_MATCH || r == FP_VERIFY_MATCH)
+		fprint_stats_record (priv->stats, STATS_PHASE_IDENTIFY, priv->action_start);
+	verify_timing_done (priv, r,
+			    (r == FP_VERIFY_MATCH && priv->identify_fingers != NULL) ?
+			    priv->identify_fingers[match_offset] : -1,
+			    img);
+
+	if (verify_should_restart (rdev, r, name)) {
+		fp_img_free(img);
+		return;
+	}
+
+	if (r == FP_VERIFY_NO_MATCH || r == FP_VERIFY_MATCH || r < 0)
+		priv->action_done = TRUE;
+	if (r == FP_VERIFY_MATCH && priv->identify_fingers != NULL)
+		usage_stats_record_match (priv->username, priv->ddev,
+					  priv->identify_fingers[match_offset]);
+	set_disconnected (priv, name);
+	log_driver_error (r);
+	g_signal_emit(rdev, signals[SIGNAL_VERIFY_STATUS], 0, name, priv->action_done);
+	fp_img_free(img);
+
+	if (priv->action_done && priv->identify_data != NULL) {
+		g_free (priv->identify_data);
+		priv->identify_data = NULL;
+		g_free (priv->identify_fingers);
+		priv->identify_fingers = NULL;
+	}
+}
+
+static void _fprint_device_verify_start(FprintDevice *rdev,
+	const char *finger_name, guint max_attempts,
+	DBusGMethodInvocation *context)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct session_data *session = priv->session;
+	struct fp_print_data **gallery = NULL;
+	struct fp_print_data *data = NULL;
+	int *gallery_fingers = NULL;
+	GError *error = NULL;
+	guint finger_num = finger_name_to_num (finger_name);
+	gboolean corrupt = FALSE;
+	int r = 0;
 
 	if (_fprint_device_check_claimed(rdev, context, &error) == FALSE) {
 		dbus_g_method_return_error (context, error);
@@ -877,12 +1635,22 @@ static void fprint_device_verify_start(FprintDevice *rdev,
 		return;
 	}
 	priv->action_done = FALSE;
+	priv->stopped = FALSE;
+	memset (&priv->timing, 0, sizeof (priv->timing));
+	priv->timing.start = fprint_stats_now ();
+	priv->timing.attempt = 1;
+	priv->timing.dispatches = loop_monitor_get_dispatches ();
+
+	/* Whatever wasn't prefetched since Claim gets loaded now,
+	 * the prints are cached until the device is released */
+	if (session->prefetch_id != 0) {
+		g_source_remove (session->prefetch_id);
+		session->prefetch_id = 0;
+	}
+	session_discover_prints (rdev);
 
 	if (finger_num == -1) {
-		GSList *prints;
-
-		prints = store.discover_prints(priv->ddev, priv->username);
-		if (prints == NULL) {
+		if (session->prints == NULL) {
 			g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_NO_ENROLLED_PRINTS,
 				    "No fingerprints enrolled");
 			dbus_g_method_return_error(context, error);
@@ -893,13 +1661,17 @@ static void fprint_device_verify_start(FprintDevice *rdev,
 			GPtrArray *array;
 
 			array = g_ptr_array_new ();
+			gallery_fingers = g_new0 (int, g_slist_length (session->prints));
 
-			for (l = prints; l != NULL; l = l->next) {
-				g_message ("adding finger %d to the gallery", GPOINTER_TO_INT (l->data));
-				r = store.print_data_load(priv->dev, GPOINTER_TO_INT (l->data),
-							  &data, priv->username);
-				if (r == 0)
+			for (l = session->prints; l != NULL; l = l->next) {
+				fprint_debug(FPRINT_LOG_DEVICE, "adding finger %d to the gallery", GPOINTER_TO_INT (l->data));
+				data = session_get_print (rdev, GPOINTER_TO_INT (l->data), &r);
+				if (r == 0) {
+					gallery_fingers[array->len] = GPOINTER_TO_INT (l->data);
 					g_ptr_array_add (array, data);
+				} else if (r == -EUCLEAN) {
+					corrupt = TRUE;
+				}
 			}
 			data = NULL;
 
@@ -907,15 +1679,24 @@ static void fprint_device_verify_start(FprintDevice *rdev,
 				g_ptr_array_add (array,  NULL);
 				gallery = (struct fp_print_data **) g_ptr_array_free (array, FALSE);
 			} else {
+				g_ptr_array_free (array, TRUE);
+				g_free (gallery_fingers);
+				gallery_fingers = NULL;
 				gallery = NULL;
 			}
 		} else {
-			finger_num = GPOINTER_TO_INT (prints->data);
+			finger_num = GPOINTER_TO_INT (session->prints->data);
 		}
-		g_slist_free(prints);
 	}
 
 	if (fp_dev_supports_identification(priv->dev) && finger_num == -1) {
+		if (gallery == NULL && corrupt) {
+			g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_PRINT_CORRUPT,
+				    "Fingerprints on that device are corrupt");
+			dbus_g_method_return_error(context, error);
+			g_error_free (error);
+			return;
+		}
 		if (gallery == NULL) {
 			g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_NO_ENROLLED_PRINTS,
 				    "No fingerprints on that device");
@@ -925,25 +1706,40 @@ static void fprint_device_verify_start(FprintDevice *rdev,
 		}
 		priv->current_action = ACTION_IDENTIFY;
 
-		g_message ("start identification device %d", priv->id);
+		fprint_message(FPRINT_LOG_DEVICE, "start identification device %d", priv->id);
+		priv->timing.prints_loaded = fprint_stats_now ();
+		FPRINTD_PROBE3(verify__start, priv->id, ACTION_IDENTIFY, -1);
 		r = fp_async_identify_start (priv->dev, gallery, identify_cb, rdev);
+		priv->action_start = fprint_stats_now ();
 	} else {
 		priv->current_action = ACTION_VERIFY;
 
-		g_message("start verification device %d finger %d", priv->id, finger_num);
+		fprint_message(FPRINT_LOG_DEVICE, "start verification device %d finger %d", priv->id, finger_num);
 
-		r = store.print_data_load(priv->dev, (enum fp_finger)finger_num, 
-					  &data, priv->username);
+		if (finger_num >= LEFT_THUMB && finger_num <= RIGHT_LITTLE)
+			data = session_get_print (rdev, finger_num, &r);
 
-		if (r < 0 || !data) {
+		if (data == NULL && r == -EUCLEAN) {
+			priv->current_action = ACTION_NONE;
+			g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_PRINT_CORRUPT,
+				    "Print %d is corrupt", finger_num);
+			dbus_g_method_return_error(context, error);
+			return;
+		}
+		if (data == NULL) {
+			priv->current_action = ACTION_NONE;
 			g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
 				    "No such print %d", finger_num);
 			dbus_g_method_return_error(context, error);
 			return;
 		}
 
+		priv->timing.prints_loaded = fprint_stats_now ();
+		FPRINTD_PROBE3(verify__start, priv->id, ACTION_VERIFY, finger_num);
 		r = fp_async_verify_start(priv->dev, data, verify_cb, rdev);
+		priv->action_start = fprint_stats_now ();
 	}
+	priv->timing.armed = priv->action_start;
 
 	/* Emit VerifyFingerSelected telling the front-end which finger
 	 * we selected for auth */
@@ -952,25 +1748,62 @@ static void fprint_device_verify_start(FprintDevice *rdev,
 
 
 	if (r < 0) {
-		if (data != NULL) {
-			fp_print_data_free (data);
-		} else if (gallery != NULL) {
-			guint i;
-			for (i = 0; gallery[i] != NULL; i++)
-				fp_print_data_free(gallery[i]);
-			g_free (gallery);
-		}
+		/* The print data itself stays in the session's cache */
+		g_free (gallery);
+		g_free (gallery_fingers);
+		priv->current_action = ACTION_NONE;
 		g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
 			"Verify start failed with error %d", r);
 		dbus_g_method_return_error(context, error);
 		return;
 	}
 	priv->verify_data = data;
+	priv->verify_finger = finger_num;
 	priv->identify_data = gallery;
+	priv->identify_fingers = gallery_fingers;
+	priv->attempts_left = max_attempts;
 
 	dbus_g_method_return(context);
 }
 
+static void fprint_device_verify_start(FprintDevice *rdev,
+	const char *finger_name, DBusGMethodInvocation *context)
+{
+	_fprint_device_verify_start (rdev, finger_name, 1, context);
+}
+
+static void fprint_device_verify_start_with_options(FprintDevice *rdev,
+	const char *finger_name, GHashTable *options,
+	DBusGMethodInvocation *context)
+{
+	GValue *value;
+	guint max_attempts = 1;
+
+	/* Unknown options are ignored, so that newer clients
+	 * can still use the options this daemon knows about */
+	value = g_hash_table_lookup (options, "max-attempts");
+	if (value != NULL) {
+		if (G_VALUE_HOLDS_UINT (value))
+			max_attempts = g_value_get_uint (value);
+		else if (G_VALUE_HOLDS_INT (value) && g_value_get_int (value) > 0)
+			max_attempts = g_value_get_int (value);
+		else
+			max_attempts = 0;
+
+		if (max_attempts == 0) {
+			GError *error = NULL;
+
+			g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
+				    "Invalid max-attempts option");
+			dbus_g_method_return_error(context, error);
+			g_error_free (error);
+			return;
+		}
+	}
+
+	_fprint_device_verify_start (rdev, finger_name, max_attempts, context);
+}
+
 static void verify_stop_cb(struct fp_dev *dev, void *user_data)
 {
 	dbus_g_method_return((DBusGMethodInvocation *) user_data);
@@ -998,24 +1831,22 @@ static void fprint_device_verify_stop(FprintDevice *rdev,
 		return;
 	}
 
+	verify_cancel_restart (rdev);
+
 	if (priv->current_action == ACTION_VERIFY) {
-		if (priv->verify_data) {
-			fp_print_data_free (priv->verify_data);
-			priv->verify_data = NULL;
-		}
-		if (!priv->disconnected)
+		priv->verify_data = NULL;
+		if (!priv->disconnected && !priv->stopped)
 			r = fp_async_verify_stop(priv->dev, verify_stop_cb, context);
 		else
 			r = 0;
 	} else if (priv->current_action == ACTION_IDENTIFY) {
 		if (priv->identify_data != NULL) {
-			guint i;
-			for (i = 0; priv->identify_data[i] != NULL; i++)
-				fp_print_data_free(priv->identify_data[i]);
 			g_free (priv->identify_data);
 			priv->identify_data = NULL;
+			g_free (priv->identify_fingers);
+			priv->identify_fingers = NULL;
 		}
-		if (!priv->disconnected)
+		if (!priv->disconnected && !priv->stopped)
 			r = fp_async_identify_stop(priv->dev, identify_stop_cb, context);
 		else
 			r = 0;
@@ -1033,10 +1864,533 @@ static void fprint_device_verify_stop(FprintDevice *rdev,
 		dbus_g_method_return_error(context, error);
 		g_error_free (error);
 	}
-	if (priv->disconnected)
+	if (priv->disconnected || priv->stopped)
 		dbus_g_method_return(context);
 
 	priv->current_action = ACTION_NONE;
+	priv->stopped = FALSE;
+}
+
+static void timing_value_free(gpointer data)
+{
+	GValue *value = data;
+
+	g_value_unset (value);
+	g_free (value);
+}
+
+static void timing_insert_uint64(GHashTable *details, const char *key, guint64 v)
+{
+	GValue *value = g_new0 (GValue, 1);
+
+	g_value_init (value, G_TYPE_UINT64);
+	g_value_set_uint64 (value, v);
+	g_hash_table_insert (details, (gpointer) key, value);
+}
+
+static void timing_insert_string(GHashTable *details, const char *key, const char *s)
+{
+	GValue *value = g_new0 (GValue, 1);
+
+	g_value_init (value, G_TYPE_STRING);
+	g_value_set_static_string (value, s);
+	g_hash_table_insert (details, (gpointer) key, value);
+}
+
+static void fprint_device_get_last_result_details(FprintDevice *rdev,
+	DBusGMethodInvocation *context)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct verify_timing *t = &priv->last_timing;
+	GHashTable *details;
+	GValue *value;
+	GError *error = NULL;
+
+	if (_fprint_device_check_claimed(rdev, context, &error) == FALSE) {
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+		return;
+	}
+
+	if (priv->have_last_timing == FALSE) {
+		g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_NO_ACTION_IN_PROGRESS,
+			    "No verification result yet");
+		dbus_g_method_return_error(context, error);
+		g_error_free (error);
+		return;
+	}
+
+	details = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, timing_value_free);
+	timing_insert_string (details, "result", verify_result_to_name (t->result));
+	timing_insert_string (details, "finger", finger_num_to_name (t->finger));
+	timing_insert_uint64 (details, "start", t->start);
+	timing_insert_uint64 (details, "prints-loaded", t->prints_loaded);
+	timing_insert_uint64 (details, "armed", t->armed);
+	timing_insert_uint64 (details, "completed", t->completed);
+	timing_insert_uint64 (details, "wakeups", t->wakeups);
+
+	value = g_new0 (GValue, 1);
+	g_value_init (value, G_TYPE_UINT);
+	g_value_set_uint (value, t->attempt);
+	g_hash_table_insert (details, "attempt", value);
+
+	value = g_new0 (GValue, 1);
+	g_value_init (value, G_TYPE_BOOLEAN);
+	g_value_set_boolean (value, t->image);
+	g_hash_table_insert (details, "image", value);
+
+	dbus_g_method_return(context, details);
+	g_hash_table_destroy (details);
+}
+
+static void
+continuous_free (struct continuous_data *c)
+{
+	guint i;
+
+	if (c->rearm_id != 0)
+		g_source_remove (c->rearm_id);
+
+	for (i = 0; c->gallery[i] != NULL; i++)
+		fp_print_data_free (c->gallery[i]);
+	g_free (c->gallery);
+	g_free (c->gallery_users);
+	g_free (c->gallery_fingers);
+	g_strfreev (c->usernames);
+	g_slice_free (struct continuous_data, c);
+}
+
+/* Loads all the prints of the given users into one gallery, which
+ * stays resident until the identification is stopped */
+static struct continuous_data *
+continuous_load (FprintDevice *rdev, char **usernames, GError **error)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct continuous_data *c;
+	GPtrArray *gallery;
+	GArray *users, *fingers;
+	gboolean corrupt = FALSE;
+	guint64 start;
+	guint i;
+	int r;
+
+	gallery = g_ptr_array_new ();
+	users = g_array_new (FALSE, FALSE, sizeof (guint));
+	fingers = g_array_new (FALSE, FALSE, sizeof (int));
+
+	for (i = 0; usernames[i] != NULL; i++) {
+		GSList *prints, *l;
+
+		start = fprint_stats_now ();
+		FPRINTD_PROBE2(store__start, priv->id, PROBE_STORE_DISCOVER);
+		prints = store.discover_prints (priv->ddev, usernames[i]);
+		FPRINTD_PROBE3(store__done, priv->id, PROBE_STORE_DISCOVER, g_slist_length (prints));
+		fprint_stats_record (priv->stats, STATS_PHASE_STORE_DISCOVER, start);
+		prints = usage_stats_sort_prints (usernames[i], priv->ddev, prints);
+
+		for (l = prints; l != NULL; l = l->next) {
+			struct fp_print_data *data = NULL;
+			int finger = GPOINTER_TO_INT (l->data);
+
+			start = fprint_stats_now ();
+			FPRINTD_PROBE2(store__start, priv->id, PROBE_STORE_LOAD);
+			r = store.print_data_load (priv->dev, finger, &data, usernames[i]);
+			FPRINTD_PROBE3(store__done, priv->id, PROBE_STORE_LOAD, r);
+			fprint_stats_record (priv->stats, STATS_PHASE_STORE_LOAD, start);
+			if (r == -EUCLEAN) {
+				fprint_stats_count (priv->stats, STATS_CORRUPT_PRINTS);
+				corrupt = TRUE;
+			}
+			if (r != 0 || data == NULL)
+				continue;
+
+			g_ptr_array_add (gallery, data);
+			g_array_append_val (users, i);
+			g_array_append_val (fingers, finger);
+		}
+		g_slist_free (prints);
+	}
+
+	if (gallery->len == 0) {
+		g_ptr_array_free (gallery, TRUE);
+		g_array_free (users, TRUE);
+		g_array_free (fingers, TRUE);
+		if (corrupt)
+			g_set_error(error, FPRINT_ERROR, FPRINT_ERROR_PRINT_CORRUPT,
+				    "Fingerprints on that device are corrupt");
+		else
+			g_set_error(error, FPRINT_ERROR, FPRINT_ERROR_NO_ENROLLED_PRINTS,
+				    "No fingerprints on that device");
+		return NULL;
+	}
+
+	g_message ("loaded %d prints of %d users for continuous identification on device %d",
+		   gallery->len, i, priv->id);
+	g_ptr_array_add (gallery, NULL);
+
+	c = g_slice_new0 (struct continuous_data);
+	c->usernames = usernames;
+	c->gallery = (struct fp_print_data **) g_ptr_array_free (gallery, FALSE);
+	c->gallery_users = (guint *) g_array_free (users, FALSE);
+	c->gallery_fingers = (int *) g_array_free (fingers, FALSE);
+
+	return c;
+}
+
+static void continuous_cb(struct fp_dev *dev, int r,
+			  size_t match_offset, struct fp_img *img, void *user_data);
+
+static void
+continuous_fail (FprintDevice *rdev, int r)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	const char *name = verify_result_to_name (r);
+
+	fprint_message(FPRINT_LOG_DEVICE, "continuous identification on device %d failed with error %d", priv->id, r);
+	priv->action_done = TRUE;
+	set_disconnected (priv, name);
+	log_driver_error (r);
+	g_signal_emit(rdev, signals[SIGNAL_IDENTIFY_RESULT], 0, name, "", "", 0);
+}
+
+static void continuous_stopped_cb(struct fp_dev *dev, void *user_data)
+{
+	FprintDevice *rdev = user_data;
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct continuous_data *c = priv->continuous;
+	int r;
+
+	c->rearming = FALSE;
+	c->stopped = TRUE;
+
+	/* Cancelled by IdentifyStop() or the client going away */
+	if (c->max_unacked == 0)
+		return;
+
+	priv->action_done = FALSE;
+	FPRINTD_PROBE3(verify__start, priv->id, ACTION_IDENTIFY_CONTINUOUS, -1);
+	r = fp_async_identify_start(priv->dev, c->gallery, continuous_cb, rdev);
+	priv->action_start = fprint_stats_now ();
+	if (r < 0) {
+		continuous_fail (rdev, r);
+		return;
+	}
+	c->stopped = FALSE;
+}
+
+static gboolean continuous_rearm_cb(gpointer user_data)
+{
+	FprintDevice *rdev = user_data;
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct continuous_data *c = priv->continuous;
+	int r;
+
+	c->rearm_id = 0;
+	c->rearming = TRUE;
+
+	r = fp_async_identify_stop(priv->dev, continuous_stopped_cb, rdev);
+	if (r < 0) {
+		c->rearming = FALSE;
+		continuous_fail (rdev, r);
+	}
+
+	return FALSE;
+}
+
+/* Re-arms the sensor for the next customer, unless the client
+ * hasn't acknowledged enough of the results already sent */
+static void
+continuous_rearm (FprintDevice *rdev)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct continuous_data *c = priv->continuous;
+
+	if (c->serial - c->acked >= c->max_unacked) {
+		if (c->paused == FALSE && c->max_unacked != 0)
+			fprint_message(FPRINT_LOG_DEVICE, "client is %d results behind, pausing device %d",
+				       c->serial - c->acked, priv->id);
+		c->paused = TRUE;
+		return;
+	}
+
+	c->paused = FALSE;
+	if (c->rearm_id == 0 && c->rearming == FALSE)
+		c->rearm_id = g_idle_add (continuous_rearm_cb, rdev);
+}
+
+static void
+continuous_cancel_rearm (FprintDevice *rdev)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct continuous_data *c = priv->continuous;
+
+	c->max_unacked = 0;
+	if (c->rearm_id != 0) {
+		g_source_remove (c->rearm_id);
+		c->rearm_id = 0;
+	}
+	while (c->rearming)
+		g_main_context_iteration (NULL, TRUE);
+}
+
+static void continuous_cb(struct fp_dev *dev, int r,
+			  size_t match_offset, struct fp_img *img, void *user_data)
+{
+	struct FprintDevice *rdev = user_data;
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct continuous_data *c = priv->continuous;
+	const char *name = verify_result_to_name (r);
+	const char *username = "";
+	const char *finger_name = "";
+
+	if (priv->action_done != FALSE)
+		return;
+
+	FPRINTD_PROBE3(verify__result, priv->id, ACTION_IDENTIFY_CONTINUOUS, r);
+	recorder_event (priv->recorder, "identify", r, priv->action_start, img);
+	fprint_stats_verify_result (priv->stats, r);
+	if (r != FP_VERIFY_NO_MATCH && r != FP_VERIFY_MATCH) {
+		fp_img_free(img);
+		if (r < 0) {
+			continuous_fail (rdev, r);
+			return;
+		}
+		/* Retry statuses, the identification is still going */
+		g_signal_emit(rdev, signals[SIGNAL_IDENTIFY_RESULT], 0, name, "", "", 0);
+		return;
+	}
+
+	fprint_stats_record (priv->stats, STATS_PHASE_IDENTIFY, priv->action_start);
+	if (r == FP_VERIFY_MATCH) {
+		username = c->usernames[c->gallery_users[match_offset]];
+		finger_name = finger_num_to_name (c->gallery_fingers[match_offset]);
+		usage_stats_record_match (username, priv->ddev,
+					  c->gallery_fingers[match_offset]);
+	}
+
+	c->serial++;
+	fprint_message(FPRINT_LOG_DEVICE, "continuous_cb: result %s (%d) serial %u", name, r, c->serial);
+
+	/* Ignore anything else the driver sends until re-armed */
+	priv->action_done = TRUE;
+	g_signal_emit(rdev, signals[SIGNAL_IDENTIFY_RESULT], 0,
+		      name, username, finger_name, c->serial);
+	fp_img_free(img);
+
+	continuous_rearm (rdev);
+}
+
+static void fprint_device_identify_start(FprintDevice *rdev,
+	const char **usernames, GHashTable *options,
+	DBusGMethodInvocation *context)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct session_data *session = priv->session;
+	struct continuous_data *c;
+	GError *error = NULL;
+	GValue *value;
+	GPtrArray *users;
+	guint max_unacked = 1;
+	guint i;
+	int r;
+
+	if (_fprint_device_check_claimed(rdev, context, &error) == FALSE) {
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+		return;
+	}
+
+	if (_fprint_device_check_polkit_for_action (rdev, context, "net.reactivated.fprint.device.verify", &error) == FALSE) {
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+		return;
+	}
+
+	if (priv->current_action != ACTION_NONE) {
+		if (priv->current_action == ACTION_ENROLL) {
+			g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_ALREADY_IN_USE,
+				    "Enrollment in progress");
+		} else {
+			g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_ALREADY_IN_USE,
+				    "Verification already in progress");
+		}
+		dbus_g_method_return_error(context, error);
+		g_error_free (error);
+		return;
+	}
+
+	if (!fp_dev_supports_identification (priv->dev)) {
+		g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
+			    "Device does not support identification");
+		dbus_g_method_return_error(context, error);
+		g_error_free (error);
+		return;
+	}
+
+	value = g_hash_table_lookup (options, "max-unacked");
+	if (value != NULL) {
+		if (G_VALUE_HOLDS_UINT (value))
+			max_unacked = g_value_get_uint (value);
+		else
+			max_unacked = 0;
+
+		if (max_unacked == 0) {
+			g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
+				    "Invalid max-unacked option");
+			dbus_g_method_return_error(context, error);
+			g_error_free (error);
+			return;
+		}
+	}
+
+	/* Identifying anyone but the claiming user needs the
+	 * same permissions as passing their username elsewhere */
+	users = g_ptr_array_new ();
+	if (usernames == NULL || usernames[0] == NULL)
+		g_ptr_array_add (users, g_strdup (priv->username));
+	for (i = 0; usernames != NULL && usernames[i] != NULL; i++) {
+		char *user;
+
+		user = _fprint_device_check_for_username (rdev, context,
+							  usernames[i], NULL, &error);
+		if (user == NULL) {
+			g_ptr_array_add (users, NULL);
+			g_strfreev ((char **) g_ptr_array_free (users, FALSE));
+			dbus_g_method_return_error (context, error);
+			g_error_free (error);
+			return;
+		}
+		g_ptr_array_add (users, user);
+	}
+	g_ptr_array_add (users, NULL);
+
+	/* The claiming user's prints are loaded into the gallery
+	 * below, no need to keep prefetching them */
+	if (session->prefetch_id != 0) {
+		g_source_remove (session->prefetch_id);
+		session->prefetch_id = 0;
+	}
+
+	c = continuous_load (rdev, (char **) g_ptr_array_free (users, FALSE), &error);
+	if (c == NULL) {
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+		return;
+	}
+	c->max_unacked = max_unacked;
+
+	priv->action_done = FALSE;
+	fprint_message(FPRINT_LOG_DEVICE, "start continuous identification device %d", priv->id);
+	FPRINTD_PROBE3(verify__start, priv->id, ACTION_IDENTIFY_CONTINUOUS, -1);
+	r = fp_async_identify_start (priv->dev, c->gallery, continuous_cb, rdev);
+	priv->action_start = fprint_stats_now ();
+	if (r < 0) {
+		continuous_free (c);
+		g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
+			"Identify start failed with error %d", r);
+		dbus_g_method_return_error(context, error);
+		g_error_free (error);
+		return;
+	}
+
+	priv->continuous = c;
+	priv->current_action = ACTION_IDENTIFY_CONTINUOUS;
+
+	dbus_g_method_return(context);
+}
+
+static void fprint_device_identify_ack(FprintDevice *rdev,
+	guint serial, DBusGMethodInvocation *context)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	struct continuous_data *c = priv->continuous;
+	GError *error = NULL;
+
+	if (_fprint_device_check_claimed(rdev, context, &error) == FALSE) {
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+		return;
+	}
+
+	if (priv->current_action != ACTION_IDENTIFY_CONTINUOUS) {
+		g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_NO_ACTION_IN_PROGRESS,
+			    "No identification in progress");
+		dbus_g_method_return_error(context, error);
+		g_error_free (error);
+		return;
+	}
+
+	/* Acks can be batched, and ones for results not sent yet
+	 * are ignored */
+	if (serial > c->acked && serial <= c->serial) {
+		c->acked = serial;
+		if (c->paused)
+			continuous_rearm (rdev);
+	}
+
+	dbus_g_method_return(context);
+}
+
+static void continuous_stop_cb(struct fp_dev *dev, void *user_data)
+{
+	FprintDevice *rdev = user_data;
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	DBusGMethodInvocation *context = priv->continuous->context_stop;
+
+	continuous_free (priv->continuous);
+	priv->continuous = NULL;
+	dbus_g_method_return(context);
+}
+
+static void fprint_device_identify_stop(FprintDevice *rdev,
+	DBusGMethodInvocation *context)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+	GError *error = NULL;
+	int r;
+
+	if (_fprint_device_check_claimed(rdev, context, &error) == FALSE) {
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+		return;
+	}
+
+	if (_fprint_device_check_polkit_for_action (rdev, context, "net.reactivated.fprint.device.verify", &error) == FALSE) {
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+		return;
+	}
+
+	if (priv->current_action != ACTION_IDENTIFY_CONTINUOUS) {
+		g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_NO_ACTION_IN_PROGRESS,
+			    "No identification in progress");
+		dbus_g_method_return_error(context, error);
+		g_error_free (error);
+		return;
+	}
+
+	continuous_cancel_rearm (rdev);
+	priv->current_action = ACTION_NONE;
+
+	if (priv->continuous->stopped == FALSE && priv->disconnected == FALSE) {
+		/* The gallery is only freed once libfprint is done with it */
+		priv->continuous->context_stop = context;
+		r = fp_async_identify_stop(priv->dev, continuous_stop_cb, rdev);
+		if (r >= 0)
+			return;
+		g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
+			"Identify stop failed with error %d", r);
+	}
+
+	continuous_free (priv->continuous);
+	priv->continuous = NULL;
+
+	if (error != NULL) {
+		dbus_g_method_return_error(context, error);
+		g_error_free (error);
+	} else {
+		dbus_g_method_return(context);
+	}
 }
 
 static void enroll_stage_cb(struct fp_dev *dev, int result,
@@ -1052,16 +2406,27 @@ static void enroll_stage_cb(struct fp_dev *dev, int result,
 	if (priv->action_done != FALSE)
 		return;
 
-	g_message("enroll_stage_cb: result %d", result);
+	fprint_message(FPRINT_LOG_DEVICE, "enroll_stage_cb: result %d", result);
+	recorder_event (priv->recorder, "enroll", result, priv->action_start, img);
+	FPRINTD_PROBE2(enroll__stage, priv->id, result);
+	fprint_stats_enroll_result (priv->stats, result);
+	fprint_stats_record (priv->stats, STATS_PHASE_ENROLL_STAGE, priv->action_start);
+	priv->action_start = fprint_stats_now ();
+
 	if (result == FP_ENROLL_COMPLETE) {
+		FPRINTD_PROBE2(store__start, priv->id, PROBE_STORE_SAVE);
 		r = store.print_data_save(print, session->enroll_finger, priv->username);
+		FPRINTD_PROBE3(store__done, priv->id, PROBE_STORE_SAVE, r);
+		fprint_stats_record (priv->stats, STATS_PHASE_STORE_SAVE, priv->action_start);
 		if (r < 0)
 			result = FP_ENROLL_FAIL;
+		store_generation++;
 	}
 
 	if (result == FP_ENROLL_COMPLETE || result == FP_ENROLL_FAIL || result < 0)
 		priv->action_done = TRUE;
 	set_disconnected (priv, name);
+	log_driver_error (result);
 
 	g_signal_emit(rdev, signals[SIGNAL_ENROLL_STATUS], 0, name, priv->action_done);
 
@@ -1109,11 +2474,12 @@ static void fprint_device_enroll_start(FprintDevice *rdev,
 		return;
 	}
 
-	g_message("start enrollment device %d finger %d", priv->id, finger_num);
+	fprint_message(FPRINT_LOG_DEVICE, "start enrollment device %d finger %d", priv->id, finger_num);
 	session->enroll_finger = finger_num;
 	priv->action_done = FALSE;
 	
 	r = fp_async_enroll_start(priv->dev, enroll_stage_cb, rdev);
+	priv->action_start = fprint_stats_now ();
 	if (r < 0) {
 		g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
 			"Enroll start failed with error %d", r);
@@ -1182,6 +2548,7 @@ static void fprint_device_list_enrolled_fingers(FprintDevice *rdev,
 	GSList *item;
 	GPtrArray *ret;
 	char *user, *sender;
+	guint64 start;
 
 	user = _fprint_device_check_for_username (rdev,
 						  context,
@@ -1204,7 +2571,11 @@ static void fprint_device_list_enrolled_fingers(FprintDevice *rdev,
 	_fprint_device_add_client (rdev, sender);
 	g_free (sender);
 
+	start = fprint_stats_now ();
+	FPRINTD_PROBE2(store__start, priv->id, PROBE_STORE_DISCOVER);
 	prints = store.discover_prints(priv->ddev, user);
+	FPRINTD_PROBE3(store__done, priv->id, PROBE_STORE_DISCOVER, g_slist_length (prints));
+	fprint_stats_record (priv->stats, STATS_PHASE_STORE_DISCOVER, start);
 	g_free (user);
 	if (!prints) {
 		g_set_error(&error, FPRINT_ERROR, FPRINT_ERROR_NO_ENROLLED_PRINTS,
@@ -1256,10 +2627,43 @@ static void fprint_device_delete_enrolled_fingers(FprintDevice *rdev,
 	g_free (sender);
 
 	for (i = LEFT_THUMB; i <= RIGHT_LITTLE; i++) {
-		store.print_data_delete(priv->ddev, i, user);
+		guint64 start = fprint_stats_now ();
+		int r;
+
+		FPRINTD_PROBE2(store__start, priv->id, PROBE_STORE_DELETE);
+		r = store.print_data_delete(priv->ddev, i, user);
+		FPRINTD_PROBE3(store__done, priv->id, PROBE_STORE_DELETE, r);
+		fprint_stats_record (priv->stats, STATS_PHASE_STORE_DELETE, start);
 	}
+	store_generation++;
+	usage_stats_forget (user, priv->ddev);
 	g_free (user);
 
 	dbus_g_method_return(context);
 }
 
+static gboolean fprint_device_get_counters(FprintDevice *rdev,
+	GHashTable **counters, GError **error)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+
+	*counters = fprint_stats_get_counters (priv->stats);
+	return TRUE;
+}
+
+static gboolean fprint_device_get_histograms(FprintDevice *rdev,
+	GHashTable **histograms, GError **error)
+{
+	FprintDevicePrivate *priv = DEVICE_GET_PRIVATE(rdev);
+
+	*histograms = fprint_stats_get_histograms (priv->stats);
+	return TRUE;
+}
+
+static gboolean fprint_device_get_histogram_buckets(FprintDevice *rdev,
+	GArray **buckets, GError **error)
+{
+	*buckets = fprint_stats_get_buckets ();
+	return TRUE;
+}
+
@@ -0,0 +1,337 @@
+/*
+ * Fault-injecting storage wrapper for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* A storage plugin, loaded with type=faulty in fprintd.conf, passing
+ * everything to another backend, the built-in file storage by
+ * default, while adding latency and failures, as configured in the
+ * [faulty] section, to see how fprintd copes with slow or failing
+ * storage.
+ *
+ * The delays are spent blocking, as a slow disk would, in whichever
+ * thread the storage gets called from.
+ *
+ * The backend, and the file storage, are those of the program loading
+ * the module, see storage.c, so that they get set up the same way as
+ * without it.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <libfprint/fprint.h>
+
+#include "file_storage.h"
+#include "storage.h"
+
+enum faulty_op {
+	FAULTY_SAVE = 0,
+	FAULTY_LOAD,
+	FAULTY_DELETE,
+	FAULTY_DISCOVER,
+	FAULTY_NUM_OPS
+};
+
+static const char *op_names[FAULTY_NUM_OPS] = {
+	"save",
+	"load",
+	"delete",
+	"discover"
+};
+
+enum latency_type {
+	LATENCY_NONE = 0,
+	LATENCY_CONSTANT,
+	LATENCY_UNIFORM,
+	LATENCY_EXPONENTIAL
+};
+
+struct faulty_config {
+	/* in milliseconds */
+	enum latency_type latency;
+	double latency_a;
+	double latency_b;
+	/* Occasional much longer delays */
+	double spike_probability;
+	double spike_latency;
+	/* Failing without calling the backend */
+	double error_probability;
+	int error;
+	/* Failing after the backend did the work, or for discover,
+	 * the probability of each print to be left out */
+	double partial_probability;
+};
+
+static struct faulty_config config[FAULTY_NUM_OPS];
+static struct storage backend;
+static GRand *prng = NULL;
+/* Loading itself as the backend would come back here */
+static gboolean configuring = FALSE;
+
+static const struct {
+	const char *name;
+	int value;
+} errnos[] = {
+	{ "EIO", EIO },
+	{ "ENOENT", ENOENT },
+	{ "ENOSPC", ENOSPC },
+	{ "EACCES", EACCES },
+	{ "EROFS", EROFS },
+	{ "ETIMEDOUT", ETIMEDOUT },
+	{ "ENOMEM", ENOMEM },
+};
+
+static int parse_errno(const char *name)
+{
+	guint i;
+
+	if (name == NULL)
+		return EIO;
+	for (i = 0; i < G_N_ELEMENTS(errnos); i++) {
+		if (g_str_equal(name, errnos[i].name))
+			return errnos[i].value;
+	}
+	if (atoi(name) > 0)
+		return atoi(name);
+	return EIO;
+}
+
+/* constant:MS, uniform:MIN:MAX or exponential:MEAN */
+static void parse_latency(struct faulty_config *c, const char *value)
+{
+	char **parts;
+
+	c->latency = LATENCY_NONE;
+	if (value == NULL)
+		return;
+
+	parts = g_strsplit(value, ":", 3);
+	if (parts[0] != NULL && parts[1] != NULL) {
+		c->latency_a = g_ascii_strtod(parts[1], NULL);
+		c->latency_b = parts[2] ? g_ascii_strtod(parts[2], NULL) : c->latency_a;
+		if (g_str_equal(parts[0], "constant"))
+			c->latency = LATENCY_CONSTANT;
+		else if (g_str_equal(parts[0], "uniform") && c->latency_b >= c->latency_a)
+			c->latency = LATENCY_UNIFORM;
+		else if (g_str_equal(parts[0], "exponential"))
+			c->latency = LATENCY_EXPONENTIAL;
+	}
+	if (c->latency == LATENCY_NONE)
+		g_warning("invalid storage latency '%s'", value);
+	g_strfreev(parts);
+}
+
+static double get_double(GKeyFile *conf, const char *op, const char *key)
+{
+	char *name, *value;
+	double ret = 0;
+
+	name = g_strdup_printf("%s-%s", op, key);
+	value = g_key_file_get_string(conf, "faulty", name, NULL);
+	if (value != NULL)
+		ret = g_ascii_strtod(value, NULL);
+	g_free(value);
+	g_free(name);
+
+	return ret;
+}
+
+static char *get_string(GKeyFile *conf, const char *op, const char *key)
+{
+	char *name, *value;
+
+	name = g_strdup_printf("%s-%s", op, key);
+	value = g_key_file_get_string(conf, "faulty", name, NULL);
+	g_free(name);
+
+	return value;
+}
+
+static gboolean chance(double probability)
+{
+	return probability > 0 && g_rand_double(prng) < probability;
+}
+
+static void inject_latency(enum faulty_op op)
+{
+	struct faulty_config *c = &config[op];
+	double ms = 0;
+
+	switch (c->latency) {
+	case LATENCY_NONE:
+		break;
+	case LATENCY_CONSTANT:
+		ms = c->latency_a;
+		break;
+	case LATENCY_UNIFORM:
+		ms = g_rand_double_range(prng, c->latency_a, c->latency_b);
+		break;
+	case LATENCY_EXPONENTIAL:
+		ms = -c->latency_a * log1p(-g_rand_double(prng));
+		break;
+	}
+	if (chance(c->spike_probability))
+		ms += c->spike_latency;
+
+	if (ms > 0)
+		g_usleep(ms * 1000);
+}
+
+int init(void);
+
+void configure(GKeyFile *conf)
+{
+	char *name;
+	guint i;
+
+	if (configuring)
+		return;
+	configuring = TRUE;
+
+	name = g_key_file_get_string(conf, "faulty", "backend", NULL);
+	if (name == NULL || g_str_equal(name, "file") ||
+	    !storage_load_module(name, conf, &backend) || backend.init == &init) {
+		if (name != NULL && !g_str_equal(name, "file"))
+			g_warning("could not load storage '%s', using files", name);
+		storage_set_file(&backend);
+		if (!file_storage_configure(conf))
+			g_warning("unknown storage layout, using the default");
+	}
+	g_free(name);
+
+	if (g_key_file_has_key(conf, "faulty", "seed", NULL))
+		prng = g_rand_new_with_seed(g_key_file_get_integer(conf, "faulty", "seed", NULL));
+	else
+		prng = g_rand_new();
+
+	for (i = 0; i < FAULTY_NUM_OPS; i++) {
+		struct faulty_config *c = &config[i];
+		char *value;
+
+		value = get_string(conf, op_names[i], "latency");
+		parse_latency(c, value);
+		g_free(value);
+		c->spike_probability = get_double(conf, op_names[i], "spike-probability");
+		c->spike_latency = get_double(conf, op_names[i], "spike-latency");
+		c->error_probability = get_double(conf, op_names[i], "error-probability");
+		value = get_string(conf, op_names[i], "error");
+		c->error = parse_errno(value);
+		g_free(value);
+		c->partial_probability = get_double(conf, op_names[i], "partial-probability");
+	}
+
+	configuring = FALSE;
+}
+
+int init(void)
+{
+	/* Loaded without a configuration */
+	if (prng == NULL) {
+		GKeyFile *conf = g_key_file_new();
+
+		configure(conf);
+		g_key_file_free(conf);
+	}
+
+	return backend.init();
+}
+
+int deinit(void)
+{
+	return backend.deinit();
+}
+
+int print_data_save(struct fp_print_data *data,
+	enum fp_finger finger, const char *username)
+{
+	struct faulty_config *c = &config[FAULTY_SAVE];
+	int r;
+
+	inject_latency(FAULTY_SAVE);
+	if (chance(c->error_probability))
+		return -c->error;
+
+	r = backend.print_data_save(data, finger, username);
+	if (r == 0 && chance(c->partial_probability))
+		return -c->error;
+	return r;
+}
+
+int print_data_load(struct fp_dev *dev,
+	enum fp_finger finger, struct fp_print_data **data, const char *username)
+{
+	struct faulty_config *c = &config[FAULTY_LOAD];
+	int r;
+
+	inject_latency(FAULTY_LOAD);
+	if (chance(c->error_probability))
+		return -c->error;
+
+	r = backend.print_data_load(dev, finger, data, username);
+	if (r == 0 && chance(c->partial_probability)) {
+		fp_print_data_free(*data);
+		*data = NULL;
+		return -c->error;
+	}
+	return r;
+}
+
+int print_data_delete(struct fp_dscv_dev *dev,
+	enum fp_finger finger, const char *username)
+{
+	struct faulty_config *c = &config[FAULTY_DELETE];
+	int r;
+
+	inject_latency(FAULTY_DELETE);
+	if (chance(c->error_probability))
+		return -c->error;
+
+	r = backend.print_data_delete(dev, finger, username);
+	if (r == 0 && chance(c->partial_probability))
+		return -c->error;
+	return r;
+}
+
+GSList *discover_prints(struct fp_dscv_dev *dev, const char *username)
+{
+	struct faulty_config *c = &config[FAULTY_DISCOVER];
+	GSList *prints, *l;
+
+	inject_latency(FAULTY_DISCOVER);
+	if (chance(c->error_probability))
+		return NULL;
+
+	prints = backend.discover_prints(dev, username);
+	l = prints;
+	while (l != NULL) {
+		GSList *next = l->next;
+
+		if (chance(c->partial_probability))
+			prints = g_slist_delete_link(prints, l);
+		l = next;
+	}
+
+	return prints;
+}
+
@@ -0,0 +1,699 @@
+/*
+ * Write-ahead journal for the fprintd file storage
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Saving a print into its own file durably takes writing a temporary
+ * file, syncing it, renaming it and syncing up to three directories.
+ * With the journal, saves and deletes get appended to a single file
+ * instead, synced once, and kept in memory, and a compaction thread
+ * moves them to the usual layout every few seconds, or once the
+ * journal grows large, syncing each directory once for the lot.
+ *
+ * On startup, journals left over are replayed, records being
+ * checksummed so that a torn last write is ignored. A journal only
+ * gets removed once everything in it made it to the layout, and
+ * replaying a record twice is harmless.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "file_journal.h"
+
+#define DIR_PERMS 0700
+#define JOURNAL_NAME ".journal"
+/* The journal being compacted, or that failed to be */
+#define COMPACTING_NAME ".journal.compacting"
+#define JOURNAL_MAGIC 0x314a5046 /* "FPJ1" */
+/* Compact without waiting past this size, in bytes */
+#define JOURNAL_COMPACT_SIZE (256 * 1024)
+
+enum record_type {
+	RECORD_SAVE = 'S',
+	RECORD_DELETE = 'D'
+};
+
+/* Followed by the type, the path length on 2 bytes, the path,
+ * relative to the store, and the print data */
+struct record_header {
+	guint32 magic;
+	/* of what follows the header */
+	guint32 length;
+	guint32 checksum;
+};
+
+struct pending_print {
+	char *data;
+	gsize len;
+};
+
+static char *base = NULL;
+static char *journal_path = NULL;
+static char *compacting_path = NULL;
+static int journal_fd = -1;
+static gsize journal_size = 0;
+
+/* Saved prints not compacted yet, by path, and the directories of
+ * deleted ones, that need syncing */
+static GHashTable *pending = NULL;
+static GHashTable *dirty_dirs = NULL;
+/* Directories known to exist */
+static GHashTable *known_dirs = NULL;
+
+static GMutex *mutex = NULL;
+static GCond *cond = NULL;
+static GThread *compactor = NULL;
+static gboolean stopping = FALSE;
+static guint interval = 5;
+
+static guint32 checksum(const guchar *p, gsize len)
+{
+	/* FNV-1a */
+	guint32 h = 2166136261u;
+
+	while (len-- > 0) {
+		h ^= *p++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static int write_all(int fd, const char *data, gsize len)
+{
+	while (len > 0) {
+		ssize_t r = write(fd, data, len);
+
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		data += r;
+		len -= r;
+	}
+	return 0;
+}
+
+int file_journal_sync_dir(const char *dirpath)
+{
+	int fd, r = 0;
+
+	fd = open(dirpath, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return -errno;
+	if (fsync(fd) < 0)
+		r = -errno;
+	close(fd);
+	return r;
+}
+
+/* Without a journal, or with the journal lock held */
+int file_journal_ensure_dir(const char *dirpath)
+{
+	char *dir;
+
+	if (known_dirs == NULL)
+		known_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	if (g_hash_table_lookup(known_dirs, dirpath) != NULL)
+		return 0;
+
+	if (!g_file_test(dirpath, G_FILE_TEST_IS_DIR)) {
+		if (g_mkdir_with_parents(dirpath, DIR_PERMS) < 0)
+			return -errno;
+
+		/* The new directories need their parents synced */
+		dir = g_path_get_dirname(dirpath);
+		while (base == NULL || g_str_has_prefix(dir, base)) {
+			char *parent;
+
+			file_journal_sync_dir(dir);
+			if (base == NULL || strcmp(dir, base) == 0)
+				break;
+			parent = g_path_get_dirname(dir);
+			g_free(dir);
+			dir = parent;
+		}
+		g_free(dir);
+	}
+
+	g_hash_table_insert(known_dirs, g_strdup(dirpath), GINT_TO_POINTER(1));
+	return 0;
+}
+
+/* Replaces the file, syncing it but not its directory */
+int file_journal_write_durably(const char *path, const char *data, gsize len)
+{
+	char *tmp;
+	int fd, r;
+
+	tmp = g_strconcat(path, ".tmp", NULL);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		r = -errno;
+		/* The directory went away behind our back */
+		if (r == -ENOENT && known_dirs != NULL) {
+			char *dirpath = g_path_get_dirname(path);
+
+			g_hash_table_remove(known_dirs, dirpath);
+			g_free(dirpath);
+		}
+		g_free(tmp);
+		return r;
+	}
+
+	r = write_all(fd, data, len);
+	if (r == 0 && fsync(fd) < 0)
+		r = -errno;
+	close(fd);
+	if (r == 0 && rename(tmp, path) < 0)
+		r = -errno;
+	if (r < 0)
+		g_unlink(tmp);
+	g_free(tmp);
+
+	return r;
+}
+
+static const char *relative_path(const char *path)
+{
+	gsize len = strlen(base);
+
+	if (strncmp(path, base, len) == 0 && path[len] == G_DIR_SEPARATOR)
+		return path + len + 1;
+	return path;
+}
+
+/* Called with the lock held */
+static int journal_append(enum record_type type, const char *path,
+	const char *data, gsize len)
+{
+	struct record_header header;
+	const char *rel = relative_path(path);
+	guint16 path_len = strlen(rel);
+	GByteArray *record;
+	guchar t = type;
+	int r;
+
+	record = g_byte_array_sized_new(sizeof(header) + 3 + path_len + len);
+	g_byte_array_append(record, (guchar *) &header, sizeof(header));
+	g_byte_array_append(record, &t, 1);
+	g_byte_array_append(record, (guchar *) &path_len, 2);
+	g_byte_array_append(record, (guchar *) rel, path_len);
+	if (len > 0)
+		g_byte_array_append(record, (guchar *) data, len);
+
+	header.magic = JOURNAL_MAGIC;
+	header.length = record->len - sizeof(header);
+	header.checksum = checksum(record->data + sizeof(header), header.length);
+	memcpy(record->data, &header, sizeof(header));
+
+	r = write_all(journal_fd, (char *) record->data, record->len);
+	if (r == 0 && fdatasync(journal_fd) < 0)
+		r = -errno;
+
+	if (r == 0) {
+		journal_size += record->len;
+	} else {
+		/* A partial record would hide the ones after it */
+		if (ftruncate(journal_fd, journal_size) < 0)
+			g_warning("could not truncate the storage journal: %s", g_strerror(errno));
+	}
+	g_byte_array_free(record, TRUE);
+
+	return r;
+}
+
+static void pending_free(gpointer data)
+{
+	struct pending_print *p = data;
+
+	g_free(p->data);
+	g_free(p);
+}
+
+gboolean file_journal_enabled(void)
+{
+	return journal_fd >= 0;
+}
+
+int file_journal_save(const char *path, const char *data, gsize len)
+{
+	struct pending_print *p;
+	gboolean full;
+	int r;
+
+	g_mutex_lock(mutex);
+	r = journal_append(RECORD_SAVE, path, data, len);
+	if (r == 0) {
+		p = g_new(struct pending_print, 1);
+		p->data = g_memdup(data, len);
+		p->len = len;
+		g_hash_table_insert(pending, g_strdup(path), p);
+	}
+	full = journal_size >= JOURNAL_COMPACT_SIZE;
+	g_mutex_unlock(mutex);
+
+	if (full)
+		g_cond_signal(cond);
+
+	return r;
+}
+
+/* Creates a file that isn't a print, such as a key, durably and
+ * creating its directory, or fails with -EEXIST if it exists, other
+ * processes possibly creating it at the same time. Linked into place,
+ * so that nobody reads it half-written. Takes the journal lock if
+ * there's a journal, the compactor creating directories too */
+int file_journal_create_file(const char *path, const char *data, gsize len)
+{
+	char *dirpath = g_path_get_dirname(path);
+	char *tmp = g_strdup_printf("%s.%d.tmp", path, (int) getpid());
+	gboolean locked = file_journal_enabled();
+	int fd = -1, r;
+
+	if (locked)
+		g_mutex_lock(mutex);
+	r = file_journal_ensure_dir(dirpath);
+	if (r == 0) {
+		fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0)
+			r = -errno;
+	}
+	if (r == 0) {
+		r = write_all(fd, data, len);
+		if (r == 0 && fsync(fd) < 0)
+			r = -errno;
+		close(fd);
+		if (r == 0 && link(tmp, path) < 0)
+			r = -errno;
+		g_unlink(tmp);
+	}
+	if (r == 0)
+		r = file_journal_sync_dir(dirpath);
+	if (locked)
+		g_mutex_unlock(mutex);
+	g_free(tmp);
+	g_free(dirpath);
+
+	return r;
+}
+
+/* Removes the directory, and its parents up to top, while empty.
+ * Without a journal, or with the journal lock held */
+void file_journal_prune_dirs(const char *dirpath, const char *top)
+{
+	char *dir = g_strdup(dirpath);
+
+	while (g_str_has_prefix(dir, top) && g_rmdir(dir) == 0) {
+		char *parent;
+
+		if (known_dirs != NULL)
+			g_hash_table_remove(known_dirs, dir);
+		if (strcmp(dir, top) == 0)
+			break;
+		parent = g_path_get_dirname(dir);
+		g_free(dir);
+		dir = parent;
+	}
+	g_free(dir);
+}
+
+/* top is the user's directory, removed with the last print */
+int file_journal_delete(const char *path, const char *top)
+{
+	char *dirpath;
+	gboolean had;
+	int r;
+
+	g_mutex_lock(mutex);
+	had = g_hash_table_lookup(pending, path) != NULL;
+	/* Deleting all the fingers is common, only journal real deletions */
+	if (!had && !g_file_test(path, G_FILE_TEST_EXISTS)) {
+		g_mutex_unlock(mutex);
+		return -ENOENT;
+	}
+
+	r = journal_append(RECORD_DELETE, path, NULL, 0);
+	if (r == 0) {
+		g_hash_table_remove(pending, path);
+		if (g_unlink(path) < 0 && !had)
+			r = -errno;
+		dirpath = g_path_get_dirname(path);
+		file_journal_prune_dirs(dirpath, top);
+		g_hash_table_insert(dirty_dirs, dirpath, GINT_TO_POINTER(1));
+	}
+	g_mutex_unlock(mutex);
+
+	return r;
+}
+
+gboolean file_journal_lookup(const char *path, char **data, gsize *len)
+{
+	struct pending_print *p;
+
+	g_mutex_lock(mutex);
+	p = g_hash_table_lookup(pending, path);
+	if (p != NULL) {
+		*data = g_memdup(p->data, p->len);
+		*len = p->len;
+	}
+	g_mutex_unlock(mutex);
+
+	return p != NULL;
+}
+
+/* Names of the prints saved in the directory but not compacted yet */
+GSList *file_journal_list(const char *dirpath)
+{
+	GHashTableIter iter;
+	gpointer key;
+	GSList *names = NULL;
+
+	g_mutex_lock(mutex);
+	g_hash_table_iter_init(&iter, pending);
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		char *dir = g_path_get_dirname(key);
+
+		if (strcmp(dir, dirpath) == 0)
+			names = g_slist_prepend(names, g_path_get_basename(key));
+		g_free(dir);
+	}
+	g_mutex_unlock(mutex);
+
+	return names;
+}
+
+static int open_journal(void)
+{
+	journal_fd = open(journal_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (journal_fd < 0)
+		return -errno;
+	journal_size = 0;
+	return 0;
+}
+
+/* Moves the compacted prints to the layout, returns FALSE if some
+ * couldn't be, in which case the journal stays */
+static gboolean compact(void)
+{
+	GHashTable *snapshot, *dirs;
+	GHashTableIter iter;
+	gpointer key, value;
+	gboolean ok = TRUE;
+
+	g_mutex_lock(mutex);
+	if (journal_size == 0 && !g_file_test(compacting_path, G_FILE_TEST_EXISTS)) {
+		g_mutex_unlock(mutex);
+		return TRUE;
+	}
+
+	/* A previous compaction that failed keeps its journal */
+	if (!g_file_test(compacting_path, G_FILE_TEST_EXISTS)) {
+		close(journal_fd);
+		journal_fd = -1;
+		if (rename(journal_path, compacting_path) < 0 || open_journal() < 0) {
+			g_warning("could not rotate the storage journal: %s", g_strerror(errno));
+			if (journal_fd < 0)
+				open_journal();
+			g_mutex_unlock(mutex);
+			return FALSE;
+		}
+		file_journal_sync_dir(base);
+	}
+
+	snapshot = g_hash_table_new(g_str_hash, g_str_equal);
+	g_hash_table_iter_init(&iter, pending);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		g_hash_table_insert(snapshot, key, value);
+	dirs = dirty_dirs;
+	dirty_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	g_mutex_unlock(mutex);
+
+	/* One print at a time, so that saves don't wait for long */
+	g_hash_table_iter_init(&iter, snapshot);
+	while (ok && g_hash_table_iter_next(&iter, &key, &value)) {
+		struct pending_print *p = value;
+		char *dirpath;
+		int r = 0;
+
+		g_mutex_lock(mutex);
+		/* Saved again, or deleted, since */
+		if (g_hash_table_lookup(pending, key) != p) {
+			g_hash_table_iter_remove(&iter);
+			g_mutex_unlock(mutex);
+			continue;
+		}
+		dirpath = g_path_get_dirname(key);
+		r = file_journal_ensure_dir(dirpath);
+		if (r == 0)
+			r = file_journal_write_durably(key, p->data, p->len);
+		g_mutex_unlock(mutex);
+
+		if (r < 0) {
+			g_warning("could not compact %s: %s", (char *) key, g_strerror(-r));
+			ok = FALSE;
+		}
+		g_hash_table_insert(dirs, dirpath, GINT_TO_POINTER(1));
+	}
+
+	g_hash_table_iter_init(&iter, dirs);
+	while (ok && g_hash_table_iter_next(&iter, &key, NULL)) {
+		int r = file_journal_sync_dir(key);
+
+		if (r < 0 && r != -ENOENT) {
+			g_warning("could not sync %s: %s", (char *) key, g_strerror(-r));
+			ok = FALSE;
+		}
+	}
+
+	g_mutex_lock(mutex);
+	if (ok) {
+		g_hash_table_iter_init(&iter, snapshot);
+		while (g_hash_table_iter_next(&iter, &key, &value)) {
+			if (g_hash_table_lookup(pending, key) == value)
+				g_hash_table_remove(pending, key);
+		}
+		g_unlink(compacting_path);
+		file_journal_sync_dir(base);
+	} else {
+		/* Sync those again next time */
+		g_hash_table_iter_init(&iter, dirs);
+		while (g_hash_table_iter_next(&iter, &key, NULL))
+			g_hash_table_insert(dirty_dirs, g_strdup(key), GINT_TO_POINTER(1));
+	}
+	g_mutex_unlock(mutex);
+
+	g_hash_table_destroy(snapshot);
+	g_hash_table_destroy(dirs);
+
+	return ok;
+}
+
+static gpointer compactor_thread(gpointer data)
+{
+	GTimeVal until;
+
+	g_mutex_lock(mutex);
+	while (!stopping) {
+		g_get_current_time(&until);
+		g_time_val_add(&until, (glong) interval * G_USEC_PER_SEC);
+		g_cond_timed_wait(cond, mutex, &until);
+		if (stopping)
+			break;
+
+		g_mutex_unlock(mutex);
+		compact();
+		g_mutex_lock(mutex);
+	}
+	g_mutex_unlock(mutex);
+
+	return NULL;
+}
+
+/* Applies the records of a journal to the layout, stopping at the
+ * first damaged one */
+static gboolean replay(const char *path, GHashTable *dirs)
+{
+	char *contents;
+	gsize length, pos = 0;
+	gboolean ok = TRUE;
+
+	if (!g_file_get_contents(path, &contents, &length, NULL))
+		return TRUE;
+
+	while (pos + sizeof(struct record_header) <= length) {
+		struct record_header header;
+		const guchar *record;
+		guint16 path_len;
+		char *rel, *full;
+		int r = 0;
+
+		memcpy(&header, contents + pos, sizeof(header));
+		record = (guchar *) contents + pos + sizeof(header);
+		if (header.magic != JOURNAL_MAGIC || header.length < 3 ||
+		    header.length > length - pos - sizeof(header) ||
+		    checksum(record, header.length) != header.checksum) {
+			g_warning("ignoring the damaged end of %s", path);
+			break;
+		}
+
+		memcpy(&path_len, record + 1, 2);
+		if (3 + (gsize) path_len > header.length) {
+			g_warning("ignoring the damaged end of %s", path);
+			break;
+		}
+		rel = g_strndup((char *) record + 3, path_len);
+		full = g_path_is_absolute(rel) ? g_strdup(rel) : g_build_filename(base, rel, NULL);
+
+		if (record[0] == RECORD_SAVE) {
+			char *dirpath = g_path_get_dirname(full);
+
+			r = file_journal_ensure_dir(dirpath);
+			if (r == 0)
+				r = file_journal_write_durably(full, (char *) record + 3 + path_len,
+							       header.length - 3 - path_len);
+			g_hash_table_insert(dirs, dirpath, GINT_TO_POINTER(1));
+		} else if (record[0] == RECORD_DELETE) {
+			if (g_unlink(full) < 0 && errno != ENOENT)
+				r = -errno;
+			g_hash_table_insert(dirs, g_path_get_dirname(full), GINT_TO_POINTER(1));
+		}
+		if (r < 0) {
+			g_warning("could not replay %s: %s", full, g_strerror(-r));
+			ok = FALSE;
+		}
+		g_free(rel);
+		g_free(full);
+
+		pos += sizeof(header) + header.length;
+	}
+	g_free(contents);
+
+	return ok;
+}
+
+static gboolean recover(void)
+{
+	GHashTable *dirs;
+	GHashTableIter iter;
+	gpointer key;
+	gboolean ok;
+
+	dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	ok = replay(compacting_path, dirs);
+	if (ok)
+		ok = replay(journal_path, dirs);
+
+	g_hash_table_iter_init(&iter, dirs);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		file_journal_sync_dir(key);
+	g_hash_table_destroy(dirs);
+
+	if (ok) {
+		g_unlink(compacting_path);
+		g_unlink(journal_path);
+		file_journal_sync_dir(base);
+	}
+
+	return ok;
+}
+
+int file_journal_open(const char *path, guint compact_interval)
+{
+	GError *error = NULL;
+	int r;
+
+	base = g_strdup(path);
+	/* So that paths under it are recognised */
+	while (strlen(base) > 1 && g_str_has_suffix(base, G_DIR_SEPARATOR_S))
+		base[strlen(base) - 1] = '\0';
+	journal_path = g_build_filename(base, JOURNAL_NAME, NULL);
+	compacting_path = g_build_filename(base, COMPACTING_NAME, NULL);
+	if (compact_interval > 0)
+		interval = compact_interval;
+
+	r = file_journal_ensure_dir(base);
+	if (r < 0)
+		return r;
+	if (!recover())
+		return -EIO;
+
+	r = open_journal();
+	if (r < 0)
+		return r;
+
+	pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, pending_free);
+	dirty_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	mutex = g_mutex_new();
+	cond = g_cond_new();
+	compactor = g_thread_create(compactor_thread, NULL, TRUE, &error);
+	if (compactor == NULL) {
+		g_warning("could not start the storage compactor: %s", error->message);
+		g_error_free(error);
+	}
+
+	return 0;
+}
+
+/* Whether the journal under base, this process' or another's, holds
+ * saves or deletes not moved to the layout yet */
+gboolean file_journal_pending(const char *path)
+{
+	char *journal = g_build_filename(path, JOURNAL_NAME, NULL);
+	char *compacting = g_build_filename(path, COMPACTING_NAME, NULL);
+	struct stat st;
+	gboolean ret;
+
+	ret = (g_stat(journal, &st) == 0 && st.st_size > 0) ||
+		g_file_test(compacting, G_FILE_TEST_EXISTS);
+	g_free(journal);
+	g_free(compacting);
+
+	return ret;
+}
+
+void file_journal_close(void)
+{
+	if (journal_fd < 0)
+		return;
+
+	if (compactor != NULL) {
+		g_mutex_lock(mutex);
+		stopping = TRUE;
+		g_cond_signal(cond);
+		g_mutex_unlock(mutex);
+		g_thread_join(compactor);
+		compactor = NULL;
+	}
+
+	/* Whatever can't be compacted now gets replayed next time */
+	compact();
+	close(journal_fd);
+	journal_fd = -1;
+}
+
@@ -0,0 +1,43 @@
+/*
+ * Write-ahead journal for the fprintd file storage
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef FILE_JOURNAL_H
+
+#define FILE_JOURNAL_H
+
+int file_journal_open(const char *base, guint compact_interval);
+void file_journal_close(void);
+gboolean file_journal_enabled(void);
+
+int file_journal_save(const char *path, const char *data, gsize len);
+int file_journal_delete(const char *path, const char *top);
+gboolean file_journal_lookup(const char *path, char **data, gsize *len);
+GSList *file_journal_list(const char *dirpath);
+gboolean file_journal_pending(const char *base);
+int file_journal_create_file(const char *path, const char *data, gsize len);
+
+/* Also used without a journal */
+int file_journal_ensure_dir(const char *dirpath);
+int file_journal_write_durably(const char *path, const char *data, gsize len);
+int file_journal_sync_dir(const char *dirpath);
+void file_journal_prune_dirs(const char *dirpath, const char *top);
+
+#endif
+
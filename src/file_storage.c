@@ -38,13 +38,40 @@
 #include <libfprint/fprint.h>
 
 #include "file_storage.h"
-
-#define DIR_PERMS 0700
+#include "file_journal.h"
+#include "store_index.h"
+#include "print_crypt.h"
+#include "crc32c.h"
 
 #ifndef FILE_STORAGE_PATH
 #define FILE_STORAGE_PATH "/var/lib/fprint/"
 #endif
 
+/* Can be changed in fprintd.conf, see file_storage_set_path() */
+static char *storage_path = FILE_STORAGE_PATH;
+
+/* See file_storage_set_layout() */
+static gboolean hashed_layout = FALSE;
+
+/* See file_storage_set_journal() */
+static gboolean use_journal = FALSE;
+static guint journal_interval = 0;
+
+/* See file_storage_set_index() */
+static gboolean use_index = FALSE;
+
+/* See file_storage_set_encryption() */
+static gboolean encrypt = FALSE;
+
+/* See file_storage_set_checksums() */
+static gboolean checksums = FALSE;
+
+/* Checksummed print: "FPS1" | CRC32C (4) | length (4) | print, the
+ * CRC32C being of the print, which can be encrypted, and the numbers
+ * little-endian */
+#define CHECKSUM_MAGIC "FPS1"
+#define CHECKSUM_HEADER_LEN 12
+
 #define FP_FINGER_IS_VALID(finger) \
 	((finger) >= LEFT_THUMB && (finger) <= RIGHT_LITTLE)
 
@@ -86,70 +113,230 @@ static char *get_path_to_print_dscv(struct fp_dscv_dev *dev, enum fp_finger fing
 		fp_dscv_dev_get_devtype(dev), finger, base_store);
 }
 
+/* The hashed layout spreads users over two levels of 256 directories,
+ * named after the FNV-1a hash of the username, so that no directory
+ * gets more than a few entries with hundreds of thousands of users */
+char *file_storage_get_user_dir(const char *username, gboolean hashed)
+{
+	const guchar *p;
+	guint32 h = 2166136261u;
+	char level1[3], level2[3];
+
+	if (!hashed)
+		return g_build_filename(storage_path, username, NULL);
+
+	for (p = (const guchar *) username; *p != '\0'; p++) {
+		h ^= *p;
+		h *= 16777619u;
+	}
+	g_snprintf(level1, sizeof(level1), "%02x", h >> 24);
+	g_snprintf(level2, sizeof(level2), "%02x", (h >> 16) & 0xff);
+
+	return g_build_filename(storage_path, FILE_STORAGE_HASHED_DIR,
+				level1, level2, username, NULL);
+}
+
 static int file_storage_get_basestore_for_username(const char *username, char **base_store)
 {
-	char *dirpath = FILE_STORAGE_PATH;
+	char *other;
+
+	*base_store = file_storage_get_user_dir(username, hashed_layout);
+
+	/* Users not migrated to the configured layout yet */
+	if (!g_file_test(*base_store, G_FILE_TEST_IS_DIR)) {
+		other = file_storage_get_user_dir(username, !hashed_layout);
+		if (g_file_test(other, G_FILE_TEST_IS_DIR)) {
+			g_free(*base_store);
+			*base_store = other;
+		} else {
+			g_free(other);
+		}
+	}
 
-	*base_store = g_build_filename(dirpath, username, NULL);
 	return 0;
 }
 
-/* if username == NULL function will use current username */
-int file_storage_print_data_save(struct fp_print_data *data,
-	enum fp_finger finger, const char *username)
+static void put_le32(guchar *p, guint32 v)
 {
-	GError *err = NULL;
-	char *path, *dirpath, *buf;
-	size_t len;
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = v >> 24;
+}
+
+static guint32 get_le32(const guchar *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+/* Returns 0 if the print file's checksum matches, 1 if it has none,
+ * and -EUCLEAN if it's corrupt or truncated */
+int file_storage_verify(const char *data, gsize len)
+{
+	const guchar *p = (const guchar *) data;
+
+	if (len < CHECKSUM_HEADER_LEN || memcmp(p, CHECKSUM_MAGIC, 4) != 0)
+		return 1;
+	if (get_le32(p + 8) != len - CHECKSUM_HEADER_LEN ||
+	    get_le32(p + 4) != crc32c(p + CHECKSUM_HEADER_LEN, len - CHECKSUM_HEADER_LEN))
+		return -EUCLEAN;
+	return 0;
+}
+
+/* Whether a print's file was saved with the checksum and encryption
+ * settings in use */
+gboolean file_storage_is_current(const char *data, gsize len)
+{
+	gboolean checksummed = file_storage_verify(data, len) == 0;
+
+	if (checksummed) {
+		data += CHECKSUM_HEADER_LEN;
+		len -= CHECKSUM_HEADER_LEN;
+	}
+	return checksummed == checksums &&
+		print_crypt_is_sealed((const guchar *) data, len) == encrypt;
+}
+
+/* What gets written to the print's file, encrypted and checksummed
+ * if enabled */
+int file_storage_encode(const char *username, const char *user_dir,
+	guint16 driver_id, guint32 devtype, int finger,
+	const char *data, gsize len, char **out, gsize *out_len)
+{
+	guchar *inner, *p;
+	gsize inner_len;
 	int r;
-	char *base_store = NULL;
 
-	r = file_storage_get_basestore_for_username(username, &base_store);
+	if (encrypt) {
+		r = print_crypt_seal(user_dir, username, driver_id, devtype, finger,
+				     (const guchar *) data, len, &inner, &inner_len);
+		if (r < 0)
+			return r;
+	} else {
+		inner = g_memdup(data, len);
+		inner_len = len;
+	}
 
-	if (r < 0) {
+	if (!checksums) {
+		*out = (char *) inner;
+		*out_len = inner_len;
+		return 0;
+	}
+
+	p = g_malloc(CHECKSUM_HEADER_LEN + inner_len);
+	memcpy(p, CHECKSUM_MAGIC, 4);
+	put_le32(p + 4, crc32c(inner, inner_len));
+	put_le32(p + 8, inner_len);
+	memcpy(p + CHECKSUM_HEADER_LEN, inner, inner_len);
+	g_free(inner);
+
+	*out = (char *) p;
+	*out_len = CHECKSUM_HEADER_LEN + inner_len;
+	return 0;
+}
+
+/* The print data from a print's file, returns -EUCLEAN if its
+ * checksum doesn't match, and -EBADMSG if it was encrypted and fails
+ * to authenticate. Prints saved before checksums or encryption were
+ * enabled are returned as they are. */
+int file_storage_decode(const char *username, const char *user_dir,
+	guint16 driver_id, guint32 devtype, int finger,
+	const char *data, gsize len, char **out, gsize *out_len)
+{
+	int r;
+
+	r = file_storage_verify(data, len);
+	if (r < 0)
 		return r;
+	if (r == 0) {
+		data += CHECKSUM_HEADER_LEN;
+		len -= CHECKSUM_HEADER_LEN;
 	}
 
+	if (print_crypt_is_sealed((const guchar *) data, len))
+		return print_crypt_unseal(user_dir, username, driver_id, devtype, finger,
+					  (const guchar *) data, len, (guchar **) out, out_len);
+
+	*out = g_memdup(data, len);
+	*out_len = len;
+	return 0;
+}
+
+/* if username == NULL function will use current username */
+int file_storage_print_data_save(struct fp_print_data *data,
+	enum fp_finger finger, const char *username)
+{
+	char *path, *dirpath, *buf, *blob;
+	size_t len;
+	gsize blob_len;
+	int r, attempt;
+	char *base_store = NULL;
+	guint16 driver_id = fp_print_data_get_driver_id(data);
+	guint32 devtype = fp_print_data_get_devtype(data);
+
 	len = fp_print_data_get_data(data, (guchar **) &buf);
-	if (!len) {
-		g_free(base_store);
+	if (!len)
 		return -ENOMEM;
-	}
 
-	path = __get_path_to_print(fp_print_data_get_driver_id(data), fp_print_data_get_devtype(data), finger, base_store);
-	dirpath = g_path_get_dirname(path);
-	r = g_mkdir_with_parents(dirpath, DIR_PERMS);
-	if (r < 0) {
+	/* The directory can be removed, or the user migrated to
+	 * another layout, since we last looked */
+	for (attempt = 0; attempt < 2; attempt++) {
+		r = file_storage_get_basestore_for_username(username, &base_store);
+		if (r < 0)
+			break;
+
+		r = file_storage_encode(username, base_store, driver_id, devtype,
+					finger, buf, len, &blob, &blob_len);
+		if (r < 0) {
+			g_free(base_store);
+			break;
+		}
+
+		path = __get_path_to_print(driver_id, devtype, finger, base_store);
 		g_free(base_store);
-		g_free(path);
+
+		/* Durable once it's in the journal */
+		if (file_journal_enabled()) {
+			r = file_journal_save(path, blob, blob_len);
+			g_free(blob);
+			g_free(path);
+			break;
+		}
+
+		dirpath = g_path_get_dirname(path);
+		r = file_journal_ensure_dir(dirpath);
+		//fp_dbg("saving to %s", path);
+		if (r == 0)
+			r = file_journal_write_durably(path, blob, blob_len);
+		/* So that the rename survives a crash */
+		if (r == 0)
+			r = file_journal_sync_dir(dirpath);
 		g_free(dirpath);
-		return r;
+		g_free(blob);
+		g_free(path);
+		if (r != -ENOENT)
+			break;
 	}
-
-	//fp_dbg("saving to %s", path);
-	g_file_set_contents(path, buf, len, &err);
 	free(buf);
-	g_free(dirpath);
-	g_free(path);
-	if (err) {
-		r = err->code;
-		//fp_err("save failed: %s", err->message);
-		g_error_free(err);
-		/* FIXME interpret error codes */
-		return r;
-	}
 
-	return 0;
+	if (r == 0)
+		store_index_update(username, driver_id, devtype, finger, TRUE);
+
+	return r;
 }
 
-static int load_from_file(char *path, struct fp_print_data **data)
+static int load_from_file(char *path, const char *username, const char *base_store,
+	guint16 driver_id, guint32 devtype, int finger, struct fp_print_data **data)
 {
 	gsize length;
-	char *contents;
+	char *contents, *decoded;
 	GError *err = NULL;
 	struct fp_print_data *fdata;
+	int r;
 
 	//fp_dbg("from %s", path);
+	if (file_journal_enabled() && file_journal_lookup(path, &contents, &length))
+		goto parse;
 	g_file_get_contents(path, &contents, &length, &err);
 	if (err) {
 		int r = err->code;
@@ -161,8 +348,20 @@ static int load_from_file(char *path, struct fp_print_data **data)
 			return r;
 	}
 
-	fdata = fp_print_data_from_data((guchar *) contents, length);
+parse:
+	r = file_storage_decode(username, base_store, driver_id, devtype, finger,
+				contents, length, &decoded, &length);
 	g_free(contents);
+	if (r < 0) {
+		if (r == -EUCLEAN)
+			g_warning("%s is corrupt, its checksum doesn't match", path);
+		else if (r == -EBADMSG)
+			g_warning("%s failed to authenticate", path);
+		return r;
+	}
+	fdata = fp_print_data_from_data((guchar *) decoded, length);
+	memset(decoded, 0, length);
+	g_free(decoded);
 	if (!fdata)
 		return -EIO;
 	*data = fdata;
@@ -184,7 +383,9 @@ int file_storage_print_data_load(struct fp_dev *dev,
 	}
 
 	path = get_path_to_print(dev, finger, base_store);
-	r = load_from_file(path, &fdata);
+	r = load_from_file(path, username, base_store,
+			   fp_driver_get_driver_id(fp_dev_get_driver(dev)),
+			   fp_dev_get_devtype(dev), finger, &fdata);
 	g_free(path);
 	g_free(base_store);
 	if (r)
@@ -213,11 +414,24 @@ int file_storage_print_data_delete(struct fp_dscv_dev *dev,
 
 	gchar *path = get_path_to_print_dscv(dev, finger, base_store);
 
-	r = g_unlink(path);
+	store_index_update(username, fp_driver_get_driver_id(fp_dscv_dev_get_driver(dev)),
+			   fp_dscv_dev_get_devtype(dev), finger, FALSE);
+
+	if (file_journal_enabled()) {
+		r = file_journal_delete(path, base_store);
+	} else {
+		r = g_unlink(path);
+		/* Leave no empty directories behind */
+		if (r == 0) {
+			char *dirpath = g_path_get_dirname(path);
+
+			file_journal_prune_dirs(dirpath, base_store);
+			g_free(dirpath);
+		}
+	}
 	g_free(path);
 	g_free(base_store);
 
-	/* FIXME: cleanup empty directory */
 	return r;
 }
 
@@ -262,7 +476,10 @@ GSList *file_storage_discover_prints(struct fp_dscv_dev *dev, const char *userna
 	char *storedir = NULL;
 	int r;
 
-	
+	if (store_index_lookup(username, fp_driver_get_driver_id(fp_dscv_dev_get_driver(dev)),
+			       fp_dscv_dev_get_devtype(dev), &list))
+		return list;
+
 	r = file_storage_get_basestore_for_username(username, &base_store);
 
 	if (r < 0) {
@@ -275,20 +492,151 @@ GSList *file_storage_discover_prints(struct fp_dscv_dev *dev, const char *userna
 	list = scan_dev_storedir(storedir, fp_driver_get_driver_id(fp_dscv_dev_get_driver(dev)), 
 		fp_dscv_dev_get_devtype(dev), list);
 
+	/* Saved, but not compacted yet */
+	if (file_journal_enabled()) {
+		GSList *names, *l;
+
+		names = file_journal_list(storedir);
+		for (l = names; l != NULL; l = l->next) {
+			guint64 val = g_ascii_strtoull(l->data, NULL, 16);
+
+			if (FP_FINGER_IS_VALID(val) &&
+			    g_slist_find(list, GINT_TO_POINTER(val)) == NULL)
+				list = g_slist_prepend(list, GINT_TO_POINTER(val));
+			g_free(l->data);
+		}
+		g_slist_free(names);
+	}
+
+	store_index_set(username, fp_driver_get_driver_id(fp_dscv_dev_get_driver(dev)),
+			fp_dscv_dev_get_devtype(dev), list);
+
 	g_free(base_store);
 	g_free(storedir);
 
 	return list;
 }
 
+void file_storage_set_path(const char *path)
+{
+	storage_path = g_strdup(path);
+}
+
+const char *file_storage_get_path(void)
+{
+	return storage_path;
+}
+
+/* "flat" or "hashed", users stored in the other one are still found */
+gboolean file_storage_set_layout(const char *layout)
+{
+	if (g_str_equal(layout, "flat"))
+		hashed_layout = FALSE;
+	else if (g_str_equal(layout, "hashed"))
+		hashed_layout = TRUE;
+	else
+		return FALSE;
+
+	return TRUE;
+}
+
+gboolean file_storage_get_hashed_layout(void)
+{
+	return hashed_layout;
+}
+
+/* Appends saves and deletes to a journal, moved to the usual layout
+ * by a thread every interval seconds, 0 for the default */
+void file_storage_set_journal(gboolean enabled, guint interval)
+{
+	use_journal = enabled;
+	journal_interval = interval;
+}
+
+/* Lists prints from an index built in the background at init */
+void file_storage_set_index(gboolean enabled)
+{
+	use_index = enabled;
+}
+
+/* Adds a CRC32C to the prints saved from now on, checked on load */
+void file_storage_set_checksums(gboolean enabled)
+{
+	checksums = enabled;
+}
+
+gboolean file_storage_get_checksums(void)
+{
+	return checksums;
+}
+
+gboolean file_storage_get_encryption(void)
+{
+	return encrypt;
+}
+
+/* Encrypts the prints saved from now on, see print_crypt.c, with
+ * the host key in key_file, NULL for the default */
+void file_storage_set_encryption(gboolean enabled, const char *key_file)
+{
+	encrypt = enabled;
+	if (key_file != NULL)
+		print_crypt_set_key_file(key_file);
+}
+
+/* Applies fprintd.conf's [storage] section, FALSE if the layout is
+ * unknown */
+gboolean file_storage_configure(GKeyFile *conf)
+{
+	char *value;
+	gboolean ret = TRUE;
+
+	value = g_key_file_get_string(conf, "storage", "path", NULL);
+	if (value != NULL)
+		file_storage_set_path(value);
+	g_free(value);
+
+	value = g_key_file_get_string(conf, "storage", "layout", NULL);
+	if (value != NULL && !file_storage_set_layout(value))
+		ret = FALSE;
+	g_free(value);
+
+	file_storage_set_journal(g_key_file_get_boolean(conf, "storage", "journal", NULL),
+				 g_key_file_get_integer(conf, "storage", "journal-interval", NULL));
+	file_storage_set_index(g_key_file_get_boolean(conf, "storage", "index", NULL));
+
+	value = g_key_file_get_string(conf, "storage", "key-file", NULL);
+	file_storage_set_encryption(g_key_file_get_boolean(conf, "storage", "encrypt", NULL), value);
+	g_free(value);
+	file_storage_set_checksums(g_key_file_get_boolean(conf, "storage", "checksums", NULL));
+
+	return ret;
+}
+
 int file_storage_init(void)
 {
-	/* Nothing to do */
-	return 0;
+	int r = 0;
+
+	if (encrypt && !print_crypt_available())
+		g_warning("fprintd was built without print encryption, prints can't be saved");
+
+	if (use_journal) {
+		r = file_journal_open(storage_path, journal_interval);
+		if (r < 0)
+			g_warning("could not open the storage journal in %s: %s",
+				  storage_path, g_strerror(-r));
+	}
+
+	/* After the journal was replayed */
+	if (use_index)
+		store_index_start();
+
+	return r;
 }
 
 int file_storage_deinit(void)
 {
-	/* Nothing to do */
+	file_journal_close();
+	print_crypt_forget();
 	return 0;
 }
@@ -22,6 +22,9 @@
 
 #define FILE_STORAGE_H
 
+/* Holds the hashed layout, under the storage path */
+#define FILE_STORAGE_HASHED_DIR ".hashed"
+
 int file_storage_print_data_save(struct fp_print_data *data,
 	enum fp_finger finger, const char *username);
 
@@ -32,6 +35,31 @@ int file_storage_print_data_load(struct fp_dev *dev,
 int file_storage_print_data_delete(struct fp_dscv_dev *dev,
 	enum fp_finger finger, const char *username);
 
+void file_storage_set_path(const char *path);
+const char *file_storage_get_path(void);
+
+gboolean file_storage_set_layout(const char *layout);
+gboolean file_storage_get_hashed_layout(void);
+char *file_storage_get_user_dir(const char *username, gboolean hashed);
+
+void file_storage_set_journal(gboolean enabled, guint interval);
+void file_storage_set_index(gboolean enabled);
+void file_storage_set_encryption(gboolean enabled, const char *key_file);
+gboolean file_storage_get_encryption(void);
+void file_storage_set_checksums(gboolean enabled);
+gboolean file_storage_get_checksums(void);
+gboolean file_storage_configure(GKeyFile *conf);
+
+int file_storage_verify(const char *data, gsize len);
+gboolean file_storage_is_current(const char *data, gsize len);
+
+int file_storage_encode(const char *username, const char *user_dir,
+	guint16 driver_id, guint32 devtype, int finger,
+	const char *data, gsize len, char **out, gsize *out_len);
+int file_storage_decode(const char *username, const char *user_dir,
+	guint16 driver_id, guint32 devtype, int finger,
+	const char *data, gsize len, char **out, gsize *out_len);
+
 int file_storage_init(void);
 
 int file_storage_deinit(void);
@@ -27,6 +27,8 @@
 #define TIMEOUT 30
 #define FPRINT_SERVICE_NAME "net.reactivated.Fprint"
 extern DBusGConnection *fprintd_dbus_conn;
+/* Quit once no devices are in use, for fprintd to clean up */
+extern GMainLoop *fprintd_loop;
 
 /* Errors */
 GQuark fprint_error_quark(void);
@@ -44,6 +46,7 @@ typedef enum {
 	FPRINT_ERROR_NO_ACTION_IN_PROGRESS, /* No actions currently in progress */
 	FPRINT_ERROR_INVALID_FINGERNAME, /* the finger name passed was invalid */
 	FPRINT_ERROR_NO_SUCH_DEVICE, /* device does not exist */
+	FPRINT_ERROR_PRINT_CORRUPT, /* the stored print's checksum doesn't match */
 } FprintError;
 
 /* Manager */
@@ -67,6 +70,7 @@ typedef struct FprintManagerClass FprintManagerClass;
 
 FprintManager *fprint_manager_new(gboolean no_timeout);
 GType fprint_manager_get_type(void);
+void fprint_manager_prewarm(FprintManager *manager, const char *username);
 
 /* Device */
 #define FPRINT_TYPE_DEVICE            (fprint_device_get_type())
@@ -90,6 +94,9 @@ typedef struct FprintDeviceClass FprintDeviceClass;
 FprintDevice *fprint_device_new(struct fp_dscv_dev *ddev);
 GType fprint_device_get_type(void);
 guint32 _fprint_device_get_id(FprintDevice *rdev);
+gboolean fprint_device_prewarm(FprintDevice *rdev, const char *username);
+void fprint_device_set_prewarm_budget(guint max_concurrent, gsize max_memory,
+	guint window);
 /* Print */
 /* TODO */
 
@@ -0,0 +1,404 @@
+/*
+ * Key-value storage for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* A storage plugin, loaded with type=kv in fprintd.conf, keeping all
+ * the prints in one LMDB environment, memory-mapped, each operation
+ * being a transaction, instead of a file per print.
+ *
+ * The "prints" database is keyed by username, a NUL, the driver ID
+ * and devtype, big-endian, and the finger, so that a user's prints,
+ * and their prints for a device, are next to each other, and get
+ * listed with a range lookup. The "devices" database indexes the
+ * same prints by device first, to list the users enrolled on one.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <lmdb.h>
+#include <libfprint/fprint.h>
+
+#include "storage.h"
+
+#ifndef KV_STORAGE_PATH
+#define KV_STORAGE_PATH "/var/lib/fprint/kv"
+#endif
+
+/* In MiB, only address space until used */
+#define DEFAULT_MAP_SIZE 1024
+
+/* Driver ID, devtype and finger */
+#define DEVICE_KEY_LEN 6
+#define FINGER_KEY_LEN (DEVICE_KEY_LEN + 1)
+
+static char *kv_path = NULL;
+static guint map_size = DEFAULT_MAP_SIZE;
+
+static MDB_env *env = NULL;
+static MDB_dbi prints_db;
+static MDB_dbi devices_db;
+
+static int kv_error(int rc)
+{
+	switch (rc) {
+	case 0:
+		return 0;
+	case MDB_NOTFOUND:
+		return -ENOENT;
+	case MDB_MAP_FULL:
+		return -ENOSPC;
+	default:
+		/* LMDB's own errors are negative, system ones positive */
+		return rc > 0 ? -rc : -EIO;
+	}
+}
+
+static void put_device(guchar *p, uint16_t driver_id, uint32_t devtype)
+{
+	p[0] = driver_id >> 8;
+	p[1] = driver_id & 0xff;
+	p[2] = devtype >> 24;
+	p[3] = (devtype >> 16) & 0xff;
+	p[4] = (devtype >> 8) & 0xff;
+	p[5] = devtype & 0xff;
+}
+
+/* Username, NUL, device and finger, prefixes of it list prints */
+static GByteArray *print_key(const char *username, uint16_t driver_id,
+	uint32_t devtype, int finger)
+{
+	GByteArray *key;
+	guchar device[FINGER_KEY_LEN];
+
+	key = g_byte_array_sized_new(strlen(username) + 1 + FINGER_KEY_LEN);
+	g_byte_array_append(key, (guchar *) username, strlen(username) + 1);
+	put_device(device, driver_id, devtype);
+	device[DEVICE_KEY_LEN] = finger;
+	g_byte_array_append(key, device, finger < 0 ? DEVICE_KEY_LEN : FINGER_KEY_LEN);
+
+	return key;
+}
+
+/* Device, username, NUL and finger */
+static GByteArray *device_key(const char *username, uint16_t driver_id,
+	uint32_t devtype, int finger)
+{
+	GByteArray *key;
+	guchar device[DEVICE_KEY_LEN], f = finger;
+
+	key = g_byte_array_sized_new(FINGER_KEY_LEN + strlen(username) + 1);
+	put_device(device, driver_id, devtype);
+	g_byte_array_append(key, device, DEVICE_KEY_LEN);
+	if (username != NULL) {
+		g_byte_array_append(key, (guchar *) username, strlen(username) + 1);
+		g_byte_array_append(key, &f, 1);
+	}
+
+	return key;
+}
+
+static void set_val(MDB_val *val, GByteArray *array)
+{
+	val->mv_size = array->len;
+	val->mv_data = array->data;
+}
+
+int print_data_save(struct fp_print_data *data,
+	enum fp_finger finger, const char *username)
+{
+	GByteArray *pkey, *dkey;
+	MDB_txn *txn;
+	MDB_val key, val;
+	guchar *buf;
+	size_t len;
+	int rc;
+
+	if (env == NULL)
+		return -EIO;
+
+	len = fp_print_data_get_data(data, &buf);
+	if (!len)
+		return -ENOMEM;
+
+	pkey = print_key(username, fp_print_data_get_driver_id(data),
+			 fp_print_data_get_devtype(data), finger);
+	dkey = device_key(username, fp_print_data_get_driver_id(data),
+			  fp_print_data_get_devtype(data), finger);
+	if (pkey->len > (guint) mdb_env_get_maxkeysize(env)) {
+		rc = ENAMETOOLONG;
+		goto out;
+	}
+
+	rc = mdb_txn_begin(env, NULL, 0, &txn);
+	if (rc != 0)
+		goto out;
+
+	set_val(&key, pkey);
+	val.mv_size = len;
+	val.mv_data = buf;
+	rc = mdb_put(txn, prints_db, &key, &val, 0);
+	if (rc == 0) {
+		set_val(&key, dkey);
+		val.mv_size = 0;
+		val.mv_data = NULL;
+		rc = mdb_put(txn, devices_db, &key, &val, 0);
+	}
+
+	/* Synced to disk on commit */
+	if (rc == 0)
+		rc = mdb_txn_commit(txn);
+	else
+		mdb_txn_abort(txn);
+
+out:
+	free(buf);
+	g_byte_array_free(pkey, TRUE);
+	g_byte_array_free(dkey, TRUE);
+
+	return kv_error(rc);
+}
+
+int print_data_load(struct fp_dev *dev,
+	enum fp_finger finger, struct fp_print_data **data, const char *username)
+{
+	struct fp_print_data *fdata;
+	GByteArray *pkey;
+	MDB_txn *txn;
+	MDB_val key, val;
+	int rc;
+
+	if (env == NULL)
+		return -EIO;
+
+	pkey = print_key(username, fp_driver_get_driver_id(fp_dev_get_driver(dev)),
+			 fp_dev_get_devtype(dev), finger);
+
+	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+	if (rc != 0) {
+		g_byte_array_free(pkey, TRUE);
+		return kv_error(rc);
+	}
+
+	set_val(&key, pkey);
+	rc = mdb_get(txn, prints_db, &key, &val);
+	fdata = NULL;
+	/* The data is only valid during the transaction */
+	if (rc == 0)
+		fdata = fp_print_data_from_data(val.mv_data, val.mv_size);
+	mdb_txn_abort(txn);
+	g_byte_array_free(pkey, TRUE);
+
+	if (rc != 0)
+		return kv_error(rc);
+	if (fdata == NULL)
+		return -EIO;
+
+	if (!fp_dev_supports_print_data(dev, fdata)) {
+		fp_print_data_free(fdata);
+		return -EINVAL;
+	}
+
+	*data = fdata;
+	return 0;
+}
+
+int print_data_delete(struct fp_dscv_dev *dev,
+	enum fp_finger finger, const char *username)
+{
+	uint16_t driver_id = fp_driver_get_driver_id(fp_dscv_dev_get_driver(dev));
+	uint32_t devtype = fp_dscv_dev_get_devtype(dev);
+	GByteArray *pkey, *dkey;
+	MDB_txn *txn;
+	MDB_val key;
+	int rc;
+
+	if (env == NULL)
+		return -EIO;
+
+	pkey = print_key(username, driver_id, devtype, finger);
+	dkey = device_key(username, driver_id, devtype, finger);
+
+	rc = mdb_txn_begin(env, NULL, 0, &txn);
+	if (rc == 0) {
+		set_val(&key, pkey);
+		rc = mdb_del(txn, prints_db, &key, NULL);
+		if (rc == 0) {
+			set_val(&key, dkey);
+			rc = mdb_del(txn, devices_db, &key, NULL);
+		}
+
+		if (rc == 0)
+			rc = mdb_txn_commit(txn);
+		else
+			mdb_txn_abort(txn);
+	}
+
+	g_byte_array_free(pkey, TRUE);
+	g_byte_array_free(dkey, TRUE);
+
+	return kv_error(rc);
+}
+
+/* Calls func with each key of the database starting with prefix,
+ * and the part of the key after it */
+static int foreach_prefix(MDB_dbi dbi, GByteArray *prefix,
+	void (*func)(const guchar *rest, gsize len, gpointer user_data), gpointer user_data)
+{
+	MDB_txn *txn;
+	MDB_cursor *cursor;
+	MDB_val key, val;
+	int rc;
+
+	if (env == NULL)
+		return -EIO;
+
+	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+	if (rc != 0)
+		return kv_error(rc);
+	rc = mdb_cursor_open(txn, dbi, &cursor);
+	if (rc != 0) {
+		mdb_txn_abort(txn);
+		return kv_error(rc);
+	}
+
+	set_val(&key, prefix);
+	rc = mdb_cursor_get(cursor, &key, &val, MDB_SET_RANGE);
+	while (rc == 0 && key.mv_size >= prefix->len &&
+	       memcmp(key.mv_data, prefix->data, prefix->len) == 0) {
+		func((guchar *) key.mv_data + prefix->len, key.mv_size - prefix->len, user_data);
+		rc = mdb_cursor_get(cursor, &key, &val, MDB_NEXT);
+	}
+
+	mdb_cursor_close(cursor);
+	mdb_txn_abort(txn);
+
+	return rc == MDB_NOTFOUND ? 0 : kv_error(rc);
+}
+
+static void add_finger(const guchar *rest, gsize len, gpointer user_data)
+{
+	GSList **list = user_data;
+
+	if (len == 1)
+		*list = g_slist_prepend(*list, GINT_TO_POINTER((int) rest[0]));
+}
+
+GSList *discover_prints(struct fp_dscv_dev *dev, const char *username)
+{
+	GByteArray *prefix;
+	GSList *list = NULL;
+
+	prefix = print_key(username, fp_driver_get_driver_id(fp_dscv_dev_get_driver(dev)),
+			   fp_dscv_dev_get_devtype(dev), -1);
+	foreach_prefix(prints_db, prefix, add_finger, &list);
+	g_byte_array_free(prefix, TRUE);
+
+	return list;
+}
+
+static void add_user(const guchar *rest, gsize len, gpointer user_data)
+{
+	GSList **list = user_data;
+	const char *username = (const char *) rest;
+
+	/* Keys are sorted, so a user's fingers come one after the other */
+	if (*list != NULL && g_str_equal((*list)->data, username))
+		return;
+	*list = g_slist_prepend(*list, g_strdup(username));
+}
+
+/* Users with prints for the device, from the device index, also
+ * when it isn't attached, see fprintd-store users */
+GSList *discover_users(uint16_t driver_id, uint32_t devtype)
+{
+	GByteArray *prefix;
+	GSList *list = NULL;
+
+	prefix = device_key(NULL, driver_id, devtype, -1);
+	foreach_prefix(devices_db, prefix, add_user, &list);
+	g_byte_array_free(prefix, TRUE);
+
+	return list;
+}
+
+void configure(GKeyFile *conf)
+{
+	int size;
+
+	g_free(kv_path);
+	kv_path = g_key_file_get_string(conf, "kv", "path", NULL);
+	size = g_key_file_get_integer(conf, "kv", "map-size", NULL);
+	if (size > 0)
+		map_size = size;
+}
+
+int init(void)
+{
+	MDB_txn *txn;
+	int rc;
+
+	if (kv_path == NULL)
+		kv_path = g_strdup(KV_STORAGE_PATH);
+	if (g_mkdir_with_parents(kv_path, 0700) < 0)
+		return -errno;
+
+	rc = mdb_env_create(&env);
+	if (rc == 0)
+		rc = mdb_env_set_maxdbs(env, 2);
+	if (rc == 0)
+		rc = mdb_env_set_mapsize(env, (size_t) map_size * 1024 * 1024);
+	if (rc == 0)
+		rc = mdb_env_open(env, kv_path, 0, 0600);
+	if (rc == 0)
+		rc = mdb_txn_begin(env, NULL, 0, &txn);
+	if (rc == 0) {
+		rc = mdb_dbi_open(txn, "prints", MDB_CREATE, &prints_db);
+		if (rc == 0)
+			rc = mdb_dbi_open(txn, "devices", MDB_CREATE, &devices_db);
+		if (rc == 0)
+			rc = mdb_txn_commit(txn);
+		else
+			mdb_txn_abort(txn);
+	}
+
+	if (rc != 0) {
+		g_warning("could not open the key-value store in %s: %s",
+			  kv_path, mdb_strerror(rc));
+		if (env != NULL)
+			mdb_env_close(env);
+		env = NULL;
+	}
+
+	return kv_error(rc);
+}
+
+int deinit(void)
+{
+	if (env != NULL)
+		mdb_env_close(env);
+	env = NULL;
+	return 0;
+}
+
@@ -0,0 +1,305 @@
+/*
+ * Logging for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Messages from the main loop are formatted into a preallocated ring
+ * buffer, and written out by a flusher thread, so that logging from
+ * libfprint callbacks doesn't cost a write to the journal each time.
+ *
+ * The main thread is the only producer, and the flusher the only
+ * consumer, so the ring needs no locking. Messages are dropped, and
+ * counted, if the flusher falls behind.
+ *
+ * Categories can keep messages more verbose than the ones written out,
+ * those stay in the ring, to be dumped when something goes wrong.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "stats.h"
+#include "log.h"
+
+#define LOG_RING_SIZE 1024
+#define LOG_MESSAGE_SIZE 160
+/* in milliseconds */
+#define LOG_FLUSH_INTERVAL 100
+
+struct log_entry {
+	/* see fprint_stats_now() */
+	guint64 time;
+	enum fprint_log_category category;
+	GLogLevelFlags level;
+	char message[LOG_MESSAGE_SIZE];
+};
+
+static struct log_entry ring[LOG_RING_SIZE];
+/* Written by the main thread, and the flusher, respectively */
+static volatile guint head = 0;
+static volatile guint tail = 0;
+static volatile guint dropped = 0;
+static guint dropped_reported = 0;
+
+static GThread *flusher = NULL;
+static GMutex *flush_mutex = NULL;
+static GCond *flush_cond = NULL;
+
+GLogLevelFlags fprint_log_levels[FPRINT_LOG_NUM_CATEGORIES] = {
+	G_LOG_LEVEL_MESSAGE,
+	G_LOG_LEVEL_MESSAGE,
+	G_LOG_LEVEL_MESSAGE
+};
+/* Most verbose level written out */
+static GLogLevelFlags output_level = G_LOG_LEVEL_MESSAGE;
+
+static const char *category_names[FPRINT_LOG_NUM_CATEGORIES] = {
+	"main",
+	"device",
+	"manager"
+};
+
+static const struct {
+	const char *name;
+	GLogLevelFlags level;
+} level_names[] = {
+	{ "warning", G_LOG_LEVEL_WARNING },
+	{ "message", G_LOG_LEVEL_MESSAGE },
+	{ "info", G_LOG_LEVEL_INFO },
+	{ "debug", G_LOG_LEVEL_DEBUG },
+	{ NULL, 0 }
+};
+
+static gboolean level_from_name(const char *name, GLogLevelFlags *level)
+{
+	guint i;
+
+	for (i = 0; level_names[i].name != NULL; i++) {
+		if (g_str_equal(level_names[i].name, name)) {
+			*level = level_names[i].level;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* Needs flush_mutex held */
+static void flush_locked(void)
+{
+	guint d;
+
+	while (tail != head) {
+		struct log_entry *entry = &ring[tail % LOG_RING_SIZE];
+
+		/* Don't read the entry before seeing head move */
+		__sync_synchronize();
+		if (entry->level <= output_level)
+			g_log(G_LOG_DOMAIN, entry->level, "%s", entry->message);
+		/* Or let the main thread overwrite it too early */
+		__sync_synchronize();
+		tail++;
+	}
+
+	d = dropped;
+	if (d != dropped_reported) {
+		g_log(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING,
+		      "%u log messages dropped", d - dropped_reported);
+		dropped_reported = d;
+	}
+}
+
+static gpointer flusher_thread(gpointer data)
+{
+	GTimeVal until;
+
+	g_mutex_lock(flush_mutex);
+	for (;;) {
+		flush_locked();
+		g_get_current_time(&until);
+		g_time_val_add(&until, LOG_FLUSH_INTERVAL * 1000);
+		g_cond_timed_wait(flush_cond, flush_mutex, &until);
+	}
+
+	return NULL;
+}
+
+void fprint_log_record(enum fprint_log_category category, GLogLevelFlags level,
+	const char *format, ...)
+{
+	struct log_entry *entry;
+	va_list args;
+
+	/* Before the flusher is started, or if it couldn't be */
+	if (flusher == NULL) {
+		if (level <= output_level) {
+			va_start(args, format);
+			g_logv(G_LOG_DOMAIN, level, format, args);
+			va_end(args);
+		}
+		return;
+	}
+
+	if (head - tail >= LOG_RING_SIZE) {
+		dropped++;
+		return;
+	}
+
+	entry = &ring[head % LOG_RING_SIZE];
+	entry->time = fprint_stats_now();
+	entry->category = category;
+	entry->level = level;
+	va_start(args, format);
+	g_vsnprintf(entry->message, LOG_MESSAGE_SIZE, format, args);
+	va_end(args);
+
+	/* The entry needs to be complete before the flusher sees it */
+	__sync_synchronize();
+	head++;
+
+	/* Warnings don't wait for the next flush */
+	if (level <= G_LOG_LEVEL_WARNING)
+		g_cond_signal(flush_cond);
+}
+
+void fprint_log_flush(void)
+{
+	if (flusher == NULL)
+		return;
+
+	g_mutex_lock(flush_mutex);
+	flush_locked();
+	g_mutex_unlock(flush_mutex);
+}
+
+static char *format_entry(const struct log_entry *entry)
+{
+	return g_strdup_printf("[%" G_GUINT64_FORMAT ".%06u] %s: %s",
+			       entry->time / G_USEC_PER_SEC,
+			       (guint) (entry->time % G_USEC_PER_SEC),
+			       category_names[entry->category],
+			       entry->message);
+}
+
+/* The last entries are only overwritten by the main thread, so it
+ * can read them while the flusher is running */
+static guint recent_start(guint count)
+{
+	guint n = head;
+
+	if (n > LOG_RING_SIZE)
+		n = LOG_RING_SIZE;
+	if (count > n)
+		count = n;
+	return head - count;
+}
+
+/* Writes out the last entries that were kept, but too verbose to
+ * be written out already, called from the main thread on errors */
+void fprint_log_dump(guint count)
+{
+	guint i;
+
+	for (i = recent_start(count); i != head; i++) {
+		struct log_entry *entry = &ring[i % LOG_RING_SIZE];
+		char *line;
+
+		if (entry->level <= output_level)
+			continue;
+		line = format_entry(entry);
+		g_log(G_LOG_DOMAIN, G_LOG_LEVEL_MESSAGE, "recent: %s", line);
+		g_free(line);
+	}
+}
+
+char **fprint_log_get_recent(guint count)
+{
+	GPtrArray *array;
+	guint i;
+
+	array = g_ptr_array_new();
+	for (i = recent_start(count); i != head; i++)
+		g_ptr_array_add(array, format_entry(&ring[i % LOG_RING_SIZE]));
+	g_ptr_array_add(array, NULL);
+
+	return (char **) g_ptr_array_free(array, FALSE);
+}
+
+/* category is a category name, "all", or "output" for the level
+ * written out */
+gboolean fprint_log_set_level(const char *category, const char *level)
+{
+	GLogLevelFlags l;
+	guint i;
+
+	if (!level_from_name(level, &l))
+		return FALSE;
+
+	if (g_str_equal(category, "output")) {
+		output_level = l;
+		return TRUE;
+	}
+
+	for (i = 0; i < FPRINT_LOG_NUM_CATEGORIES; i++) {
+		if (g_str_equal(category, "all") || g_str_equal(category, category_names[i])) {
+			fprint_log_levels[i] = l;
+			if (!g_str_equal(category, "all"))
+				return TRUE;
+		}
+	}
+
+	return g_str_equal(category, "all");
+}
+
+void fprint_log_init(GKeyFile *conf)
+{
+	GError *error = NULL;
+	char **keys;
+	guint i;
+
+	/* Unknown categories or levels are ignored */
+	keys = g_key_file_get_keys(conf, "log", NULL, NULL);
+	for (i = 0; keys != NULL && keys[i] != NULL; i++) {
+		char *level;
+
+		level = g_key_file_get_string(conf, "log", keys[i], NULL);
+		if (level == NULL || !fprint_log_set_level(keys[i], level)) {
+			/* As written, the string can fail to parse */
+			char *value = g_key_file_get_value(conf, "log", keys[i], NULL);
+
+			g_warning("invalid log level '%s' for '%s'", value, keys[i]);
+			g_free(value);
+		}
+		g_free(level);
+	}
+	g_strfreev(keys);
+
+	flush_mutex = g_mutex_new();
+	flush_cond = g_cond_new();
+	flusher = g_thread_create(flusher_thread, NULL, FALSE, &error);
+	if (flusher == NULL) {
+		g_warning("could not start the log flusher, logging synchronously: %s",
+			  error->message);
+		g_error_free(error);
+		return;
+	}
+
+	atexit(fprint_log_flush);
+}
+
@@ -0,0 +1,53 @@
+/*
+ * Logging for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LOG_H
+
+#define LOG_H
+
+enum fprint_log_category {
+	FPRINT_LOG_MAIN = 0,
+	FPRINT_LOG_DEVICE,
+	FPRINT_LOG_MANAGER,
+	FPRINT_LOG_NUM_CATEGORIES
+};
+
+/* Most verbose level kept for each category, see fprint_log() */
+extern GLogLevelFlags fprint_log_levels[FPRINT_LOG_NUM_CATEGORIES];
+
+void fprint_log_init(GKeyFile *conf);
+void fprint_log_record(enum fprint_log_category category, GLogLevelFlags level,
+	const char *format, ...) G_GNUC_PRINTF(3, 4);
+void fprint_log_flush(void);
+void fprint_log_dump(guint count);
+char **fprint_log_get_recent(guint count);
+gboolean fprint_log_set_level(const char *category, const char *level);
+
+/* Only the level check happens in the caller, messages that are kept
+ * are formatted into the ring buffer, and written out by another thread */
+#define fprint_log(category, level, ...) G_STMT_START {			\
+	if ((level) <= fprint_log_levels[category])				\
+		fprint_log_record((category), (level), __VA_ARGS__);	\
+} G_STMT_END
+
+#define fprint_message(category, ...) fprint_log((category), G_LOG_LEVEL_MESSAGE, __VA_ARGS__)
+#define fprint_debug(category, ...) fprint_log((category), G_LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif
+
@@ -0,0 +1,145 @@
+/*
+ * Login session monitoring for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Watches for new and locked login sessions, and pre-warms the
+ * fingerprint readers for the session's user, so that the unlock
+ * or login prompt doesn't need to wait for the device to be opened,
+ * or the prints to be loaded.
+ *
+ * The signals are the ones sent by logind, but the service name can
+ * be changed in fprintd.conf, to use a stand-in for testing.
+ */
+
+#include "config.h"
+
+#include <dbus/dbus-glib-bindings.h>
+#include <dbus/dbus-glib-lowlevel.h>
+#include <glib.h>
+#include <libfprint/fprint.h>
+
+#include "fprintd.h"
+#include "login_monitor.h"
+
+#define LOGIN_SERVICE "org.freedesktop.login1"
+#define LOGIN_MANAGER_INTERFACE "org.freedesktop.login1.Manager"
+#define LOGIN_SESSION_INTERFACE "org.freedesktop.login1.Session"
+
+static FprintManager *prewarm_manager = NULL;
+static char *login_service = NULL;
+
+static void get_name_cb(DBusGProxy *proxy, DBusGProxyCall *call, gpointer user_data)
+{
+	GError *error = NULL;
+	GValue value = { 0, };
+
+	if (!dbus_g_proxy_end_call(proxy, call, &error,
+				   G_TYPE_VALUE, &value, G_TYPE_INVALID)) {
+		g_message("could not get the session's user: %s", error->message);
+		g_error_free(error);
+		g_object_unref(proxy);
+		return;
+	}
+
+	if (G_VALUE_HOLDS_STRING(&value))
+		fprint_manager_prewarm(prewarm_manager, g_value_get_string(&value));
+
+	g_value_unset(&value);
+	g_object_unref(proxy);
+}
+
+static void prewarm_session(const char *path)
+{
+	DBusGProxy *proxy;
+
+	proxy = dbus_g_proxy_new_for_name(fprintd_dbus_conn, login_service,
+		path, "org.freedesktop.DBus.Properties");
+	dbus_g_proxy_begin_call(proxy, "Get", get_name_cb, NULL, NULL,
+		G_TYPE_STRING, LOGIN_SESSION_INTERFACE,
+		G_TYPE_STRING, "Name",
+		G_TYPE_INVALID);
+}
+
+static DBusHandlerResult login_filter(DBusConnection *conn,
+	DBusMessage *message, void *user_data)
+{
+	if (dbus_message_is_signal(message, LOGIN_MANAGER_INTERFACE, "SessionNew")) {
+		const char *id, *path;
+
+		if (dbus_message_get_args(message, NULL,
+					  DBUS_TYPE_STRING, &id,
+					  DBUS_TYPE_OBJECT_PATH, &path,
+					  DBUS_TYPE_INVALID)) {
+			g_message("new login session %s", id);
+			prewarm_session(path);
+		}
+	} else if (dbus_message_is_signal(message, LOGIN_SESSION_INTERFACE, "Lock")) {
+		g_message("login session %s locked", dbus_message_get_path(message));
+		prewarm_session(dbus_message_get_path(message));
+	}
+
+	/* Others might be interested in those as well */
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static void add_match(DBusConnection *conn, const char *interface, const char *member)
+{
+	char *rule;
+
+	rule = g_strdup_printf("type='signal',sender='%s',interface='%s',member='%s'",
+		login_service, interface, member);
+	dbus_bus_add_match(conn, rule, NULL);
+	g_free(rule);
+}
+
+gboolean login_monitor_start(FprintManager *manager, GKeyFile *conf)
+{
+	DBusConnection *conn;
+	int max_concurrent, max_memory, window;
+
+	if (!g_key_file_get_boolean(conf, "prewarm", "enabled", NULL))
+		return FALSE;
+
+	login_service = g_key_file_get_string(conf, "prewarm", "service", NULL);
+	if (login_service == NULL)
+		login_service = g_strdup(LOGIN_SERVICE);
+
+	/* Defaults are used for unset or invalid values */
+	max_concurrent = g_key_file_get_integer(conf, "prewarm", "max-concurrent", NULL);
+	if (max_concurrent <= 0)
+		max_concurrent = 1;
+	max_memory = g_key_file_get_integer(conf, "prewarm", "max-memory", NULL);
+	if (max_memory <= 0)
+		max_memory = 256;
+	window = g_key_file_get_integer(conf, "prewarm", "window", NULL);
+	if (window <= 0)
+		window = 30;
+	fprint_device_set_prewarm_budget(max_concurrent, max_memory * 1024, window);
+
+	prewarm_manager = manager;
+
+	conn = dbus_g_connection_get_connection(fprintd_dbus_conn);
+	add_match(conn, LOGIN_MANAGER_INTERFACE, "SessionNew");
+	add_match(conn, LOGIN_SESSION_INTERFACE, "Lock");
+	dbus_connection_add_filter(conn, login_filter, NULL, NULL);
+
+	g_message("pre-warming devices for sessions from %s", login_service);
+
+	return TRUE;
+}
+
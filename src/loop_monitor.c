@@ -0,0 +1,331 @@
+/*
+ * Main loop lag monitoring for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Everything, USB transfers included, runs from the one main loop,
+ * so a slow D-Bus handler or storage call delays libfprint. This
+ * measures how late the libfprint event source gets dispatched after
+ * its file descriptors became ready, or its timeout expired, how
+ * busy the loop is, and for how long each D-Bus method handler kept
+ * the loop blocked.
+ *
+ * D-Bus handlers can't be wrapped, so a message filter notes when a
+ * method call gets dispatched, and the handler is considered done
+ * when the loop gets back to the depth it was called from. Any
+ * client can call made up methods, so past HANDLERS_MAX different
+ * ones, the rest are all counted as "other".
+ */
+
+#include "config.h"
+
+#include <dbus/dbus-glib-bindings.h>
+#include <dbus/dbus-glib-lowlevel.h>
+#include <glib.h>
+#include <libfprint/fprint.h>
+
+#include "fprintd.h"
+#include "stats.h"
+#include "loop_monitor.h"
+
+struct handler_times {
+	guint64 count;
+	/* in microseconds */
+	guint64 total;
+	guint64 max;
+};
+
+struct pending_call {
+	char *name;
+	guint64 start;
+	int depth;
+};
+
+static struct {
+	guint64 iterations;
+	/* Iterations in the current second, and the most seen in one */
+	guint64 window_start;
+	guint64 window_iterations;
+	guint64 max_iterations_per_second;
+
+	guint64 dispatches;
+	guint64 fd_dispatches;
+	guint64 timer_dispatches;
+
+	/* When libfprint's timeout expires, and when its file
+	 * descriptors were seen ready, 0 if not */
+	guint64 deadline;
+	guint64 ready;
+
+	/* Between readiness and fp_handle_events_timeout() */
+	guint64 lag_total;
+	guint64 lag_max;
+	guint64 lag_warnings;
+
+	/* Spent in fp_handle_events_timeout() */
+	guint64 dispatch_start;
+	guint64 dispatch_total;
+	guint64 dispatch_max;
+
+	guint64 blocking_warnings;
+} loop;
+
+/* Far more than the daemon exports */
+#define HANDLERS_MAX 64
+#define HANDLERS_OTHER "other"
+
+/* Handler times, indexed by "interface.method" */
+static GHashTable *handlers = NULL;
+/* Method calls being handled, innermost first */
+static GSList *pending = NULL;
+
+/* In microseconds, 0 to never warn */
+static guint64 lag_warning = 0;
+static guint64 blocking_warning = 0;
+
+static void handler_done(struct pending_call *call, guint64 now)
+{
+	struct handler_times *times;
+	guint64 usecs = now - call->start;
+
+	if (blocking_warning != 0 && usecs > blocking_warning) {
+		loop.blocking_warnings++;
+		g_message("%s blocked the main loop for %" G_GUINT64_FORMAT " ms",
+			  call->name, usecs / 1000);
+	}
+
+	times = g_hash_table_lookup(handlers, call->name);
+	if (times == NULL && g_hash_table_size(handlers) >= HANDLERS_MAX) {
+		g_free(call->name);
+		call->name = g_strdup(HANDLERS_OTHER);
+		times = g_hash_table_lookup(handlers, call->name);
+	}
+	if (times == NULL) {
+		times = g_new0(struct handler_times, 1);
+		g_hash_table_insert(handlers, call->name, times);
+	} else {
+		g_free(call->name);
+	}
+
+	times->count++;
+	times->total += usecs;
+	if (usecs > times->max)
+		times->max = usecs;
+
+	g_slice_free(struct pending_call, call);
+}
+
+/* Finishes the calls dispatched at the given depth, or deeper */
+static void handlers_done(int depth, guint64 now)
+{
+	while (pending != NULL) {
+		struct pending_call *call = pending->data;
+
+		if (call->depth < depth)
+			break;
+		pending = g_slist_delete_link(pending, pending);
+		handler_done(call, now);
+	}
+}
+
+static DBusHandlerResult loop_filter(DBusConnection *conn,
+	DBusMessage *message, void *user_data)
+{
+	struct pending_call *call;
+	const char *interface;
+	guint64 now;
+
+	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	now = fprint_stats_now();
+	handlers_done(g_main_depth(), now);
+
+	interface = dbus_message_get_interface(message);
+	call = g_slice_new(struct pending_call);
+	call->name = g_strdup_printf("%s.%s", interface ? interface : "",
+				     dbus_message_get_member(message));
+	call->start = now;
+	call->depth = g_main_depth();
+	pending = g_slist_prepend(pending, call);
+
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+void loop_monitor_start(GKeyFile *conf)
+{
+	int ms;
+
+	ms = g_key_file_get_integer(conf, "debug", "lag-warning", NULL);
+	if (ms > 0)
+		lag_warning = (guint64) ms * 1000;
+	ms = g_key_file_get_integer(conf, "debug", "blocking-warning", NULL);
+	if (ms > 0)
+		blocking_warning = (guint64) ms * 1000;
+
+	handlers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	loop.window_start = fprint_stats_now();
+
+	dbus_connection_add_filter(dbus_g_connection_get_connection(fprintd_dbus_conn),
+				   loop_filter, NULL, NULL);
+}
+
+void loop_monitor_prepare(gint64 timeout)
+{
+	guint64 now = fprint_stats_now();
+
+	/* Handlers called from this depth have returned */
+	if (pending != NULL)
+		handlers_done(g_main_depth() + 1, now);
+
+	loop.iterations++;
+	loop.window_iterations++;
+	if (now - loop.window_start >= G_USEC_PER_SEC) {
+		guint64 rate;
+
+		rate = loop.window_iterations * G_USEC_PER_SEC / (now - loop.window_start);
+		if (rate > loop.max_iterations_per_second)
+			loop.max_iterations_per_second = rate;
+		loop.window_start = now;
+		loop.window_iterations = 0;
+	}
+
+	loop.deadline = timeout < 0 ? 0 : now + timeout;
+	loop.ready = 0;
+}
+
+void loop_monitor_ready(void)
+{
+	if (loop.ready == 0)
+		loop.ready = fprint_stats_now();
+}
+
+void loop_monitor_dispatch_start(void)
+{
+	guint64 now = fprint_stats_now();
+	guint64 since;
+
+	loop.dispatches++;
+	loop.dispatch_start = now;
+
+	if (loop.ready != 0 &&
+	    (loop.deadline == 0 || loop.ready <= loop.deadline)) {
+		loop.fd_dispatches++;
+		since = loop.ready;
+	} else if (loop.deadline != 0 && loop.deadline <= now) {
+		loop.timer_dispatches++;
+		since = loop.deadline;
+	} else {
+		return;
+	}
+
+	loop.lag_total += now - since;
+	if (now - since > loop.lag_max)
+		loop.lag_max = now - since;
+	if (lag_warning != 0 && now - since > lag_warning) {
+		loop.lag_warnings++;
+		g_message("libfprint events handled %" G_GUINT64_FORMAT " ms late",
+			  (now - since) / 1000);
+	}
+}
+
+void loop_monitor_dispatch_done(void)
+{
+	guint64 usecs = fprint_stats_now() - loop.dispatch_start;
+
+	loop.dispatch_total += usecs;
+	if (usecs > loop.dispatch_max)
+		loop.dispatch_max = usecs;
+	if (blocking_warning != 0 && usecs > blocking_warning) {
+		loop.blocking_warnings++;
+		g_message("libfprint callbacks blocked the main loop for %" G_GUINT64_FORMAT " ms",
+			  usecs / 1000);
+	}
+}
+
+guint64 loop_monitor_get_dispatches(void)
+{
+	return loop.dispatches;
+}
+
+static void value_free(gpointer data)
+{
+	GValue *value = data;
+
+	g_value_unset(value);
+	g_free(value);
+}
+
+static void insert_uint64(GHashTable *table, const char *key, guint64 v)
+{
+	GValue *value = g_new0(GValue, 1);
+
+	g_value_init(value, G_TYPE_UINT64);
+	g_value_set_uint64(value, v);
+	g_hash_table_insert(table, (gpointer) key, value);
+}
+
+GHashTable *loop_monitor_get_statistics(void)
+{
+	GHashTable *table;
+
+	table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, value_free);
+	insert_uint64(table, "iterations", loop.iterations);
+	insert_uint64(table, "max-iterations-per-second", loop.max_iterations_per_second);
+	insert_uint64(table, "dispatches", loop.dispatches);
+	insert_uint64(table, "fd-dispatches", loop.fd_dispatches);
+	insert_uint64(table, "timer-dispatches", loop.timer_dispatches);
+	insert_uint64(table, "lag-total", loop.lag_total);
+	insert_uint64(table, "lag-max", loop.lag_max);
+	insert_uint64(table, "lag-warnings", loop.lag_warnings);
+	insert_uint64(table, "dispatch-total", loop.dispatch_total);
+	insert_uint64(table, "dispatch-max", loop.dispatch_max);
+	insert_uint64(table, "blocking-warnings", loop.blocking_warnings);
+
+	return table;
+}
+
+static void add_handler_times(gpointer key, gpointer data, gpointer user_data)
+{
+	struct handler_times *times = data;
+	GHashTable *table = user_data;
+	GValue *value = g_new0(GValue, 1);
+	GArray *array;
+
+	array = g_array_sized_new(FALSE, FALSE, sizeof(guint64), 3);
+	g_array_append_val(array, times->count);
+	g_array_append_val(array, times->total);
+	g_array_append_val(array, times->max);
+
+	g_value_init(value, dbus_g_type_get_collection("GArray", G_TYPE_UINT64));
+	g_value_take_boxed(value, array);
+	g_hash_table_insert(table, key, value);
+}
+
+/* Each method's times are sent as an array made of the number of
+ * calls, the total and the longest time spent in the handler */
+GHashTable *loop_monitor_get_handler_times(void)
+{
+	GHashTable *table;
+
+	table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, value_free);
+	if (handlers != NULL)
+		g_hash_table_foreach(handlers, add_handler_times, table);
+
+	return table;
+}
+
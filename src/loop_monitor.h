@@ -0,0 +1,38 @@
+/*
+ * Main loop lag monitoring for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LOOP_MONITOR_H
+
+#define LOOP_MONITOR_H
+
+void loop_monitor_start(GKeyFile *conf);
+
+/* Hooks for the libfprint event source, timeout is in microseconds,
+ * or -1 if libfprint has no pending timeout */
+void loop_monitor_prepare(gint64 timeout);
+void loop_monitor_ready(void);
+void loop_monitor_dispatch_start(void);
+void loop_monitor_dispatch_done(void);
+
+guint64 loop_monitor_get_dispatches(void);
+GHashTable *loop_monitor_get_statistics(void);
+GHashTable *loop_monitor_get_handler_times(void);
+
+#endif
+
@@ -27,14 +27,23 @@
 #include <glib/gi18n.h>
 #include <libfprint/fprint.h>
 #include <glib-object.h>
-#include <gmodule.h>
 
 #include "fprintd.h"
 #include "storage.h"
 #include "file_storage.h"
+#include "usage_stats.h"
+#include "stats.h"
+#include "probes.h"
+#include "login_monitor.h"
+#include "loop_monitor.h"
+#include "log.h"
+#include "recorder.h"
+#include "capture.h"
 
 extern DBusGConnection *fprintd_dbus_conn;
+GMainLoop *fprintd_loop = NULL;
 static gboolean no_timeout = FALSE;
+static char *conf_path = NULL;
 static gboolean g_fatal_warnings = FALSE;
 
 struct fdsource {
@@ -49,10 +58,12 @@ static gboolean source_prepare(GSource *source, gint *timeout)
 
 	r = fp_get_next_timeout(&tv);
 	if (r == 0) {
+		loop_monitor_prepare(-1);
 		*timeout = -1;
 		return FALSE;
 	}
 
+	loop_monitor_prepare((gint64) tv.tv_sec * G_USEC_PER_SEC + tv.tv_usec);
 	if (!timerisset(&tv))
 		return TRUE;
 
@@ -72,8 +83,10 @@ static gboolean source_check(GSource *source)
 
 	do {
 		GPollFD *pollfd = elem->data;
-		if (pollfd->revents)
+		if (pollfd->revents) {
+			loop_monitor_ready();
 			return TRUE;
+		}
 	} while ((elem = g_slist_next(elem)));
 
 	r = fp_get_next_timeout(&tv);
@@ -91,8 +104,12 @@ static gboolean source_dispatch(GSource *source, GSourceFunc callback,
 		.tv_usec = 0,
 	};
 
+	FPRINTD_PROBE0(dispatch__start);
+	loop_monitor_dispatch_start();
 	/* FIXME error handling */
 	fp_handle_events_timeout(&zerotimeout);
+	loop_monitor_dispatch_done();
+	FPRINTD_PROBE0(dispatch__done);
 
 	/* FIXME whats the return value used for? */
 	return TRUE;
@@ -140,14 +157,14 @@ static void pollfd_add(int fd, short events)
 
 static void pollfd_added_cb(int fd, short events)
 {
-	g_message("now monitoring fd %d", fd);
+	fprint_message(FPRINT_LOG_MAIN, "now monitoring fd %d", fd);
 	pollfd_add(fd, events);
 }
 
 static void pollfd_removed_cb(int fd)
 {
 	GSList *elem = fdsource->pollfds;
-	g_message("no longer monitoring fd %d", fd);
+	fprint_message(FPRINT_LOG_MAIN, "no longer monitoring fd %d", fd);
 
 	if (!elem) {
 		g_warning("cannot remove from list as list is empty?");
@@ -196,99 +213,79 @@ static int setup_pollfds(void)
 	return 0;
 }
 
-static void
-set_storage_file (void)
-{
-	store.init = &file_storage_init;
-	store.deinit = &file_storage_deinit;
-	store.print_data_save = &file_storage_print_data_save;
-	store.print_data_load = &file_storage_print_data_load;
-	store.print_data_delete = &file_storage_print_data_delete;
-	store.discover_prints = &file_storage_discover_prints;
-}
-
-static gboolean
-load_storage_module (const char *module_name)
+static GKeyFile *
+load_conf_file (void)
 {
-	GModule *module;
+	GKeyFile *file;
 	char *filename;
+	GError *error = NULL;
 
-	filename = g_module_build_path (PLUGINDIR, module_name);
-	module = g_module_open (filename, 0);
-	g_free (filename);
-	if (module == NULL)
-		return FALSE;
-
-	if (!g_module_symbol (module, "init", (gpointer *) &store.init) ||
-	    !g_module_symbol (module, "deinit", (gpointer *) &store.deinit) ||
-	    !g_module_symbol (module, "print_data_save", (gpointer *) &store.print_data_save) ||
-	    !g_module_symbol (module, "print_data_load", (gpointer *) &store.print_data_load) ||
-	    !g_module_symbol (module, "print_data_delete", (gpointer *) &store.print_data_delete) ||
-	    !g_module_symbol (module, "discover_prints", (gpointer *) &store.discover_prints)) {
-	    	g_module_close (module);
-	    	return FALSE;
+	if (conf_path != NULL)
+		filename = g_strdup (conf_path);
+	else
+		filename = g_build_filename (SYSCONFDIR, "fprintd.conf", NULL);
+	file = g_key_file_new ();
+	if (!g_key_file_load_from_file (file, filename, G_KEY_FILE_NONE, &error)) {
+		g_print ("Could not open fprintd.conf: %s\n", error->message);
+		g_error_free (error);
 	}
+	g_free (filename);
 
-	g_module_make_resident (module);
-
-	return TRUE;
+	/* An empty configuration gives us the defaults */
+	return file;
 }
 
 static gboolean
-load_conf (void)
+load_conf (GKeyFile *file)
 {
-	GKeyFile *file;
-	char *filename;
-	char *module_name;
-	GError *error = NULL;
+	char *module_name, *path;
 	gboolean ret;
 
-	filename = g_build_filename (SYSCONFDIR, "fprintd.conf", NULL);
-	file = g_key_file_new ();
-	if (!g_key_file_load_from_file (file, filename, G_KEY_FILE_NONE, &error)) {
-		g_print ("Could not open fprintd.conf: %s\n", error->message);
-		goto bail;
-	}
+	/* The usage statistics live with the prints, also with a module
+	 * wrapping the file storage */
+	path = g_key_file_get_string (file, "storage", "path", NULL);
+	if (path != NULL) {
+		char *usage_path;
 
-	g_free (filename);
-	filename = NULL;
+		usage_path = g_build_filename (path, ".usage", NULL);
+		usage_stats_set_path (usage_path);
+		g_free (usage_path);
+		g_free (path);
+	}
 
-	module_name = g_key_file_get_string (file, "storage", "type", &error);
+	module_name = g_key_file_get_string (file, "storage", "type", NULL);
 	if (module_name == NULL)
-		goto bail;
-
-	g_key_file_free (file);
+		return FALSE;
 
 	if (g_str_equal (module_name, "file")) {
 		g_free (module_name);
-		set_storage_file ();
+		storage_set_file (&store);
+		if (!file_storage_configure (file)) {
+			path = g_key_file_get_string (file, "storage", "layout", NULL);
+			g_warning ("Unknown storage layout %s", path);
+			g_free (path);
+		}
 		return TRUE;
 	}
 
-	ret = load_storage_module (module_name);
+	ret = storage_load_module (module_name, file, &store);
 	g_free (module_name);
 
 	return ret;
-
-bail:
-	g_key_file_free (file);
-	g_free (filename);
-	g_error_free (error);
-
-	return FALSE;
 }
 
 static const GOptionEntry entries[] = {
 	{"g-fatal-warnings", 0, 0, G_OPTION_ARG_NONE, &g_fatal_warnings, "Make all warnings fatal", NULL},
 	{"no-timeout", 't', 0, G_OPTION_ARG_NONE, &no_timeout, "Do not exit after unused for a while", NULL},
+	{"config", 'c', 0, G_OPTION_ARG_FILENAME, &conf_path, "Use another configuration file", "FILE"},
 	{ NULL }
 };
 
 int main(int argc, char **argv)
 {
 	GOptionContext *context;
-	GMainLoop *loop;
 	GError *error = NULL;
+	GKeyFile *conf;
 	FprintManager *manager;
 	DBusGProxy *driver_proxy;
 	guint32 request_name_ret;
@@ -300,6 +297,8 @@ int main(int argc, char **argv)
 
 	context = g_option_context_new ("Fingerprint handler daemon");
 	g_option_context_add_main_entries (context, entries, GETTEXT_PACKAGE);
+	if (!g_thread_supported ())
+		g_thread_init (NULL);
 	g_type_init();
 
 	if (g_option_context_parse (context, &argc, &argv, &error) == FALSE) {
@@ -318,9 +317,14 @@ int main(int argc, char **argv)
 
 	/* Load the configuration file,
 	 * and the default storage plugin */
-	if (!load_conf())
-		set_storage_file ();
+	conf = load_conf_file ();
+	fprint_log_init (conf);
+	if (!load_conf(conf))
+		storage_set_file (&store);
 	store.init ();
+	usage_stats_load ();
+	fprint_stats_init ();
+	recorder_init (conf);
 
 	r = fp_init();
 	if (r < 0) {
@@ -328,7 +332,7 @@ int main(int argc, char **argv)
 		return r;
 	}
 
-	loop = g_main_loop_new(NULL, FALSE);
+	fprintd_loop = g_main_loop_new(NULL, FALSE);
 
 	r = setup_pollfds();
 	if (r < 0) {
@@ -342,6 +346,8 @@ int main(int argc, char **argv)
 	fprintd_dbus_conn = dbus_g_bus_get(DBUS_BUS_SYSTEM, &error);
 	if (fprintd_dbus_conn == NULL)
 		g_error("Failed to open connection to bus: %s", error->message);
+	loop_monitor_start(conf);
+	capture_start(conf);
 
 	/* create the one instance of the Manager object to be shared between
 	 * all fprintd users */
@@ -361,9 +367,13 @@ int main(int argc, char **argv)
 
 	g_message("D-Bus service launched with name: %s", FPRINT_SERVICE_NAME);
 
+	login_monitor_start (manager, conf);
+
 	g_message("entering main loop");
-	g_main_loop_run(loop);
+	g_main_loop_run(fprintd_loop);
 	g_message("main loop completed");
+	usage_stats_flush ();
+	store.deinit ();
 
 err:
 	fp_exit();
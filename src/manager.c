@@ -20,12 +20,16 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <dbus/dbus-glib-bindings.h>
+#include <dbus/dbus-glib-lowlevel.h>
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <libfprint/fprint.h>
 #include <glib-object.h>
 
 #include "fprintd.h"
+#include "stats.h"
+#include "loop_monitor.h"
+#include "log.h"
 
 DBusGConnection *fprintd_dbus_conn;
 
@@ -33,6 +37,21 @@ static gboolean fprint_manager_get_devices(FprintManager *manager,
 	GPtrArray **devices, GError **error);
 static gboolean fprint_manager_get_default_device(FprintManager *manager,
 	const char **device, GError **error);
+static gboolean fprint_manager_get_counters(FprintManager *manager,
+	GHashTable **counters, GError **error);
+static gboolean fprint_manager_get_histograms(FprintManager *manager,
+	GHashTable **histograms, GError **error);
+static gboolean fprint_manager_get_histogram_buckets(FprintManager *manager,
+	GArray **buckets, GError **error);
+static gboolean fprint_manager_get_loop_statistics(FprintManager *manager,
+	GHashTable **statistics, GError **error);
+static gboolean fprint_manager_get_handler_times(FprintManager *manager,
+	GHashTable **times, GError **error);
+static void fprint_manager_get_recent_log(FprintManager *manager,
+	guint count, DBusGMethodInvocation *context);
+static void fprint_manager_set_log_level(FprintManager *manager,
+	const char *category, const char *level,
+	DBusGMethodInvocation *context);
 #include "manager-dbus-glue.h"
 
 static GObjectClass *parent_class = NULL;
@@ -42,6 +61,10 @@ G_DEFINE_TYPE(FprintManager, fprint_manager, G_TYPE_OBJECT);
 typedef struct
 {
 	GSList *dev_registry;
+	/* Object paths of the devices, in discovery order */
+	GPtrArray *dev_paths;
+	/* Devices currently in use */
+	GHashTable *devs_in_use;
 	gboolean no_timeout;
 	guint timeout_id;
 } FprintManagerPrivate;
@@ -54,6 +77,9 @@ static void fprint_manager_finalize(GObject *object)
 	FprintManagerPrivate *priv = FPRINT_MANAGER_GET_PRIVATE (object);
 
 	g_slist_free(priv->dev_registry);
+	g_ptr_array_foreach(priv->dev_paths, (GFunc) g_free, NULL);
+	g_ptr_array_free(priv->dev_paths, TRUE);
+	g_hash_table_destroy(priv->devs_in_use);
 
 	G_OBJECT_CLASS(parent_class)->finalize(object);
 }
@@ -81,7 +107,8 @@ fprint_manager_timeout_cb (FprintManager *manager)
 {
 	g_message ("No devices in use, exit");
 	//FIXME kill all the devices
-	exit(0);
+	/* Back in main(), for the storage to be shut down cleanly */
+	g_main_loop_quit (fprintd_loop);
 	return FALSE;
 }
 
@@ -89,10 +116,15 @@ static void
 fprint_manager_in_use_notified (FprintDevice *rdev, GParamSpec *spec, FprintManager *manager)
 {
 	FprintManagerPrivate *priv = FPRINT_MANAGER_GET_PRIVATE (manager);
-	guint num_devices_used = 0;
-	GSList *l;
 	gboolean in_use;
 
+	/* Only the notifying device can have changed */
+	g_object_get (G_OBJECT(rdev), "in-use", &in_use, NULL);
+	if (in_use != FALSE)
+		g_hash_table_insert (priv->devs_in_use, rdev, rdev);
+	else
+		g_hash_table_remove (priv->devs_in_use, rdev);
+
 	if (priv->timeout_id > 0) {
 		g_source_remove (priv->timeout_id);
 		priv->timeout_id = 0;
@@ -100,15 +132,7 @@ fprint_manager_in_use_notified (FprintDevice *rdev, GParamSpec *spec, FprintMana
 	if (priv->no_timeout)
 		return;
 
-	for (l = priv->dev_registry; l != NULL; l = l->next) {
-		FprintDevice *dev = l->data;
-
-		g_object_get (G_OBJECT(dev), "in-use", &in_use, NULL);
-		if (in_use != FALSE)
-			num_devices_used++;
-	}
-
-	if (num_devices_used == 0)
+	if (g_hash_table_size (priv->devs_in_use) == 0)
 		priv->timeout_id = g_timeout_add_seconds (TIMEOUT, (GSourceFunc) fprint_manager_timeout_cb, manager);
 }
 
@@ -120,6 +144,9 @@ fprint_manager_init (FprintManager *manager)
 	struct fp_dscv_dev *ddev;
 	int i = 0;
 
+	priv->dev_paths = g_ptr_array_new();
+	priv->devs_in_use = g_hash_table_new(g_direct_hash, g_direct_equal);
+
 	dbus_g_connection_register_g_object(fprintd_dbus_conn,
 		"/net/reactivated/Fprint/Manager", G_OBJECT(manager));
 
@@ -137,7 +164,7 @@ fprint_manager_init (FprintManager *manager)
 		path = get_device_path(rdev);
 		dbus_g_connection_register_g_object(fprintd_dbus_conn, path,
 			G_OBJECT(rdev));
-		g_free(path);
+		g_ptr_array_add(priv->dev_paths, path);
 	}
 }
 
@@ -156,19 +183,25 @@ FprintManager *fprint_manager_new(gboolean no_timeout)
 	return FPRINT_MANAGER (object);
 }
 
+void fprint_manager_prewarm(FprintManager *manager, const char *username)
+{
+	FprintManagerPrivate *priv = FPRINT_MANAGER_GET_PRIVATE (manager);
+	GSList *l;
+
+	for (l = priv->dev_registry; l != NULL; l = l->next)
+		fprint_device_prewarm (l->data, username);
+}
+
 static gboolean fprint_manager_get_devices(FprintManager *manager,
 	GPtrArray **devices, GError **error)
 {
 	FprintManagerPrivate *priv = FPRINT_MANAGER_GET_PRIVATE (manager);
-	GSList *elem = priv->dev_registry;
-	int num_open = g_slist_length(elem);
-	GPtrArray *devs = g_ptr_array_sized_new(num_open);
+	GPtrArray *devs = g_ptr_array_sized_new(priv->dev_paths->len);
+	guint i;
 
-	if (num_open > 0)
-		do {
-			FprintDevice *rdev = elem->data;
-			g_ptr_array_add(devs, get_device_path(rdev));
-		} while ((elem = g_slist_next(elem)) != NULL);
+	/* Most recently discovered first */
+	for (i = priv->dev_paths->len; i > 0; i--)
+		g_ptr_array_add(devs, g_strdup(g_ptr_array_index(priv->dev_paths, i - 1)));
 
 	*devices = devs;
 	return TRUE;
@@ -178,11 +211,10 @@ static gboolean fprint_manager_get_default_device(FprintManager *manager,
 	const char **device, GError **error)
 {
 	FprintManagerPrivate *priv = FPRINT_MANAGER_GET_PRIVATE (manager);
-	GSList *elem = priv->dev_registry;
-	int num_open = g_slist_length(elem);
+	guint num_open = priv->dev_paths->len;
 
 	if (num_open > 0) {
-		*device = get_device_path (elem->data);
+		*device = g_strdup (g_ptr_array_index (priv->dev_paths, num_open - 1));
 		return TRUE;
 	} else {
 		g_set_error (error, FPRINT_ERROR, FPRINT_ERROR_NO_SUCH_DEVICE,
@@ -217,9 +249,117 @@ fprint_error_get_type (void)
 			ENUM_ENTRY (FPRINT_ERROR_NO_ACTION_IN_PROGRESS, "NoActionInProgress"),
 			ENUM_ENTRY (FPRINT_ERROR_INVALID_FINGERNAME, "InvalidFingername"),
 			ENUM_ENTRY (FPRINT_ERROR_NO_SUCH_DEVICE, "NoSuchDevice"),
+			ENUM_ENTRY (FPRINT_ERROR_PRINT_CORRUPT, "PrintCorrupt"),
 			{ 0, 0, 0 }
 		};
 		etype = g_enum_register_static ("FprintError", values);
 	}
 	return etype;
 }
+
+static gboolean fprint_manager_get_counters(FprintManager *manager,
+	GHashTable **counters, GError **error)
+{
+	*counters = fprint_stats_get_counters (fprint_stats_get_total ());
+	return TRUE;
+}
+
+static gboolean fprint_manager_get_histograms(FprintManager *manager,
+	GHashTable **histograms, GError **error)
+{
+	*histograms = fprint_stats_get_histograms (fprint_stats_get_total ());
+	return TRUE;
+}
+
+static gboolean fprint_manager_get_histogram_buckets(FprintManager *manager,
+	GArray **buckets, GError **error)
+{
+	*buckets = fprint_stats_get_buckets ();
+	return TRUE;
+}
+
+static gboolean fprint_manager_get_loop_statistics(FprintManager *manager,
+	GHashTable **statistics, GError **error)
+{
+	*statistics = loop_monitor_get_statistics ();
+	return TRUE;
+}
+
+static gboolean fprint_manager_get_handler_times(FprintManager *manager,
+	GHashTable **times, GError **error)
+{
+	*times = loop_monitor_get_handler_times ();
+	return TRUE;
+}
+
+/* The log can contain usernames, so only root gets to read it,
+ * or change what goes in there */
+static gboolean
+_fprint_manager_check_root (DBusGMethodInvocation *context, GError **error)
+{
+	DBusError dbus_error;
+	unsigned long uid;
+	char *sender;
+
+	sender = dbus_g_method_get_sender (context);
+	dbus_error_init (&dbus_error);
+	uid = dbus_bus_get_unix_user (dbus_g_connection_get_connection (fprintd_dbus_conn),
+				      sender, &dbus_error);
+	g_free (sender);
+
+	if (dbus_error_is_set (&dbus_error)) {
+		g_set_error (error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
+			     "%s", dbus_error.message);
+		dbus_error_free (&dbus_error);
+		return FALSE;
+	}
+	if (uid != 0) {
+		g_set_error (error, FPRINT_ERROR, FPRINT_ERROR_PERMISSION_DENIED,
+			     "Only root can access the log");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void fprint_manager_get_recent_log(FprintManager *manager,
+	guint count, DBusGMethodInvocation *context)
+{
+	GError *error = NULL;
+	char **lines;
+
+	if (_fprint_manager_check_root (context, &error) == FALSE) {
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+		return;
+	}
+
+	lines = fprint_log_get_recent (count);
+	dbus_g_method_return (context, lines);
+	g_strfreev (lines);
+}
+
+static void fprint_manager_set_log_level(FprintManager *manager,
+	const char *category, const char *level,
+	DBusGMethodInvocation *context)
+{
+	GError *error = NULL;
+
+	if (_fprint_manager_check_root (context, &error) == FALSE) {
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+		return;
+	}
+
+	if (!fprint_log_set_level (category, level)) {
+		g_set_error (&error, FPRINT_ERROR, FPRINT_ERROR_INTERNAL,
+			     "Invalid log category '%s' or level '%s'", category, level);
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+		return;
+	}
+
+	g_message ("log level of '%s' set to '%s'", category, level);
+	dbus_g_method_return (context);
+}
+
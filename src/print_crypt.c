@@ -0,0 +1,397 @@
+/*
+ * Print encryption for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Prints are sealed with AES-256-GCM, using a data key of their user,
+ * kept in the user's directory wrapped, with AES-256-GCM again, by
+ * the host key, a file outside of the storage. Copying the storage
+ * elsewhere, or swapping print files between users, fingers or
+ * devices, leaves prints that fail to authenticate rather than
+ * prints that can be read or that match someone else.
+ *
+ * OpenSSL picks the AES-NI and PCLMULQDQ code paths on processors
+ * that have them, and portable ones otherwise. Unwrapped data keys
+ * are kept in memory, so that only the first load of a user's
+ * prints reads the key file.
+ *
+ * Sealed print:  "FPE1" | nonce (12) | ciphertext | tag (16)
+ * Wrapped key:   "FPK1" | nonce (12) | wrapped key (32) | tag (16)
+ *
+ * The print's additional data is the username, a nul, the driver ID,
+ * devtype and finger in little-endian, the wrapped key's is the
+ * username.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#ifdef HAVE_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#endif
+
+#include "file_journal.h"
+#include "print_crypt.h"
+
+#ifndef PRINT_CRYPT_KEY_FILE
+#define PRINT_CRYPT_KEY_FILE "/etc/fprintd.key"
+#endif
+
+#define SEALED_MAGIC "FPE1"
+#define WRAPPED_MAGIC "FPK1"
+#define MAGIC_LEN 4
+#define KEY_LEN 32
+#define NONCE_LEN 12
+#define TAG_LEN 16
+#define SEAL_OVERHEAD (MAGIC_LEN + NONCE_LEN + TAG_LEN)
+
+static char *key_file = NULL;
+
+static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+static guchar host_key[KEY_LEN];
+static gboolean host_key_loaded = FALSE;
+/* Unwrapped data keys, by username */
+static GHashTable *user_keys = NULL;
+
+void print_crypt_set_key_file(const char *path)
+{
+	g_free(key_file);
+	key_file = g_strdup(path);
+}
+
+gboolean print_crypt_available(void)
+{
+#ifdef HAVE_OPENSSL
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+gboolean print_crypt_is_sealed(const guchar *data, gsize len)
+{
+	return len >= SEAL_OVERHEAD && memcmp(data, SEALED_MAGIC, MAGIC_LEN) == 0;
+}
+
+#ifdef HAVE_OPENSSL
+
+/* out gets len bytes, followed by the tag */
+static int gcm_encrypt(const guchar *key, const guchar *nonce,
+	const guchar *aad, gsize aad_len, const guchar *in, gsize len, guchar *out)
+{
+	EVP_CIPHER_CTX *ctx;
+	int n, r = -EIO;
+
+	ctx = EVP_CIPHER_CTX_new();
+	if (ctx == NULL)
+		return -ENOMEM;
+	if (EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, key, nonce) == 1 &&
+	    EVP_EncryptUpdate(ctx, NULL, &n, aad, aad_len) == 1 &&
+	    EVP_EncryptUpdate(ctx, out, &n, in, len) == 1 &&
+	    EVP_EncryptFinal_ex(ctx, out + n, &n) == 1 &&
+	    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, TAG_LEN, out + len) == 1)
+		r = 0;
+	EVP_CIPHER_CTX_free(ctx);
+
+	return r;
+}
+
+/* in is len bytes, followed by the tag */
+static int gcm_decrypt(const guchar *key, const guchar *nonce,
+	const guchar *aad, gsize aad_len, const guchar *in, gsize len, guchar *out)
+{
+	EVP_CIPHER_CTX *ctx;
+	int n, r = -EIO;
+
+	ctx = EVP_CIPHER_CTX_new();
+	if (ctx == NULL)
+		return -ENOMEM;
+	if (EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, key, nonce) == 1 &&
+	    EVP_DecryptUpdate(ctx, NULL, &n, aad, aad_len) == 1 &&
+	    EVP_DecryptUpdate(ctx, out, &n, in, len) == 1 &&
+	    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_LEN, (guchar *) in + len) == 1)
+		r = EVP_DecryptFinal_ex(ctx, out + n, &n) == 1 ? 0 : -EBADMSG;
+	EVP_CIPHER_CTX_free(ctx);
+
+	return r;
+}
+
+static int read_key_file(const char *path, guchar *data, gsize len)
+{
+	char *contents;
+	gsize length;
+	GError *err = NULL;
+	int r = 0;
+
+	if (!g_file_get_contents(path, &contents, &length, &err)) {
+		r = err->code == G_FILE_ERROR_NOENT ? -ENOKEY : -EIO;
+		g_error_free(err);
+		return r;
+	}
+	if (length == len)
+		memcpy(data, contents, len);
+	else
+		r = -EBADMSG;
+	memset(contents, 0, length);
+	g_free(contents);
+
+	return r;
+}
+
+/* Called with the lock held */
+static int load_host_key(gboolean create)
+{
+	const char *path = key_file ? key_file : PRINT_CRYPT_KEY_FILE;
+	int fd, r;
+
+	if (host_key_loaded)
+		return 0;
+
+	r = read_key_file(path, host_key, KEY_LEN);
+	if (r == -ENOKEY && create) {
+		/* Not renamed into place, so that fprintd and
+		 * fprintd-store can't both create one */
+		if (RAND_bytes(host_key, KEY_LEN) != 1)
+			return -EIO;
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+		if (fd < 0)
+			return errno == EEXIST ? load_host_key(FALSE) : -errno;
+		if (write(fd, host_key, KEY_LEN) != KEY_LEN || fsync(fd) < 0)
+			r = -EIO;
+		else
+			r = 0;
+		close(fd);
+		if (r < 0)
+			g_unlink(path);
+		else
+			g_message("created the print encryption key %s", path);
+	}
+	if (r == -EBADMSG)
+		g_warning("%s is not a print encryption key", path);
+	if (r == 0)
+		host_key_loaded = TRUE;
+
+	return r;
+}
+
+/* Called with the lock held, returns the user's data key */
+static int load_user_key(const char *user_dir, const char *username,
+	gboolean create, const guchar **key)
+{
+	guchar wrapped[MAGIC_LEN + NONCE_LEN + KEY_LEN + TAG_LEN];
+	guchar *data_key;
+	char *path;
+	int r;
+
+	if (user_keys != NULL) {
+		*key = g_hash_table_lookup(user_keys, username);
+		if (*key != NULL)
+			return 0;
+	}
+
+	r = load_host_key(create);
+	if (r < 0)
+		return r;
+
+	data_key = g_malloc(KEY_LEN);
+	path = g_build_filename(user_dir, PRINT_CRYPT_USER_KEY, NULL);
+	r = read_key_file(path, wrapped, sizeof(wrapped));
+	if (r == 0 && memcmp(wrapped, WRAPPED_MAGIC, MAGIC_LEN) != 0)
+		r = -EBADMSG;
+	if (r == 0)
+		r = gcm_decrypt(host_key, wrapped + MAGIC_LEN,
+				(const guchar *) username, strlen(username),
+				wrapped + MAGIC_LEN + NONCE_LEN, KEY_LEN, data_key);
+	else if (r == -ENOKEY && create) {
+		memcpy(wrapped, WRAPPED_MAGIC, MAGIC_LEN);
+		if (RAND_bytes(data_key, KEY_LEN) != 1 ||
+		    RAND_bytes(wrapped + MAGIC_LEN, NONCE_LEN) != 1)
+			r = -EIO;
+		else
+			r = gcm_encrypt(host_key, wrapped + MAGIC_LEN,
+					(const guchar *) username, strlen(username),
+					data_key, KEY_LEN, wrapped + MAGIC_LEN + NONCE_LEN);
+		/* Not renamed into place either, prints sealed with a key
+		 * that got replaced could never be opened again */
+		if (r == 0)
+			r = file_journal_create_file(path, (char *) wrapped, sizeof(wrapped));
+		if (r == -EEXIST) {
+			memset(data_key, 0, KEY_LEN);
+			g_free(data_key);
+			g_free(path);
+			return load_user_key(user_dir, username, FALSE, key);
+		}
+	}
+	if (r == -EBADMSG)
+		g_warning("%s could not be unwrapped with the host key", path);
+	g_free(path);
+
+	if (r < 0) {
+		memset(data_key, 0, KEY_LEN);
+		g_free(data_key);
+		return r;
+	}
+
+	if (user_keys == NULL)
+		user_keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	g_hash_table_insert(user_keys, g_strdup(username), data_key);
+	*key = data_key;
+
+	return 0;
+}
+
+static GByteArray *print_aad(const char *username, guint16 driver_id,
+	guint32 devtype, int finger)
+{
+	GByteArray *aad;
+	guint8 buf[7];
+
+	aad = g_byte_array_sized_new(strlen(username) + 1 + sizeof(buf));
+	g_byte_array_append(aad, (const guint8 *) username, strlen(username) + 1);
+	buf[0] = driver_id & 0xff;
+	buf[1] = driver_id >> 8;
+	buf[2] = devtype & 0xff;
+	buf[3] = (devtype >> 8) & 0xff;
+	buf[4] = (devtype >> 16) & 0xff;
+	buf[5] = devtype >> 24;
+	buf[6] = finger;
+	g_byte_array_append(aad, buf, sizeof(buf));
+
+	return aad;
+}
+
+int print_crypt_seal(const char *user_dir, const char *username,
+	guint16 driver_id, guint32 devtype, int finger,
+	const guchar *data, gsize len, guchar **sealed, gsize *sealed_len)
+{
+	const guchar *key;
+	GByteArray *aad;
+	guchar *out;
+	int r;
+
+	g_static_mutex_lock(&mutex);
+	r = load_user_key(user_dir, username, TRUE, &key);
+	g_static_mutex_unlock(&mutex);
+	if (r < 0)
+		return r;
+
+	out = g_malloc(len + SEAL_OVERHEAD);
+	memcpy(out, SEALED_MAGIC, MAGIC_LEN);
+	if (RAND_bytes(out + MAGIC_LEN, NONCE_LEN) != 1) {
+		g_free(out);
+		return -EIO;
+	}
+
+	aad = print_aad(username, driver_id, devtype, finger);
+	r = gcm_encrypt(key, out + MAGIC_LEN, aad->data, aad->len,
+			data, len, out + MAGIC_LEN + NONCE_LEN);
+	g_byte_array_free(aad, TRUE);
+	if (r < 0) {
+		g_free(out);
+		return r;
+	}
+
+	*sealed = out;
+	*sealed_len = len + SEAL_OVERHEAD;
+	return 0;
+}
+
+int print_crypt_unseal(const char *user_dir, const char *username,
+	guint16 driver_id, guint32 devtype, int finger,
+	const guchar *data, gsize len, guchar **plain, gsize *plain_len)
+{
+	const guchar *key;
+	GByteArray *aad;
+	guchar *out;
+	gsize out_len;
+	int r;
+
+	if (!print_crypt_is_sealed(data, len))
+		return -EINVAL;
+
+	g_static_mutex_lock(&mutex);
+	r = load_user_key(user_dir, username, FALSE, &key);
+	g_static_mutex_unlock(&mutex);
+	if (r < 0)
+		return r;
+
+	out_len = len - SEAL_OVERHEAD;
+	/* At least a byte, for empty prints */
+	out = g_malloc(out_len + 1);
+	aad = print_aad(username, driver_id, devtype, finger);
+	r = gcm_decrypt(key, data + MAGIC_LEN, aad->data, aad->len,
+			data + MAGIC_LEN + NONCE_LEN, out_len, out);
+	g_byte_array_free(aad, TRUE);
+	if (r < 0) {
+		g_free(out);
+		return r;
+	}
+
+	*plain = out;
+	*plain_len = out_len;
+	return 0;
+}
+
+static gboolean clear_key(gpointer key, gpointer value, gpointer user_data)
+{
+	memset(value, 0, KEY_LEN);
+	return TRUE;
+}
+
+/* Drops the keys from memory */
+void print_crypt_forget(void)
+{
+	g_static_mutex_lock(&mutex);
+	if (user_keys != NULL) {
+		g_hash_table_foreach_remove(user_keys, clear_key, NULL);
+		g_hash_table_destroy(user_keys);
+		user_keys = NULL;
+	}
+	memset(host_key, 0, KEY_LEN);
+	host_key_loaded = FALSE;
+	g_static_mutex_unlock(&mutex);
+}
+
+#else
+
+int print_crypt_seal(const char *user_dir, const char *username,
+	guint16 driver_id, guint32 devtype, int finger,
+	const guchar *data, gsize len, guchar **sealed, gsize *sealed_len)
+{
+	return -ENOTSUP;
+}
+
+int print_crypt_unseal(const char *user_dir, const char *username,
+	guint16 driver_id, guint32 devtype, int finger,
+	const guchar *data, gsize len, guchar **plain, gsize *plain_len)
+{
+	return -ENOTSUP;
+}
+
+void print_crypt_forget(void)
+{
+}
+
+#endif
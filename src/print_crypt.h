@@ -0,0 +1,42 @@
+/*
+ * Print encryption for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef PRINT_CRYPT_H
+
+#define PRINT_CRYPT_H
+
+/* The user's wrapped data key, in their directory */
+#define PRINT_CRYPT_USER_KEY ".key"
+
+void print_crypt_set_key_file(const char *path);
+gboolean print_crypt_available(void);
+
+gboolean print_crypt_is_sealed(const guchar *data, gsize len);
+int print_crypt_seal(const char *user_dir, const char *username,
+	guint16 driver_id, guint32 devtype, int finger,
+	const guchar *data, gsize len, guchar **sealed, gsize *sealed_len);
+int print_crypt_unseal(const char *user_dir, const char *username,
+	guint16 driver_id, guint32 devtype, int finger,
+	const guchar *data, gsize len, guchar **plain, gsize *plain_len);
+
+void print_crypt_forget(void);
+
+#endif
+
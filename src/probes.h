@@ -0,0 +1,59 @@
+/*
+ * Static tracepoints for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PROBES_H
+
+#define PROBES_H
+
+/* With --enable-systemtap, these are SystemTap/USDT probes in the
+ * "fprintd" provider, usable from stap, perf or bpftrace, for example
+ * FPRINTD_PROBE3(verify__result, ...) is usdt:<fprintd>:fprintd:verify__result
+ * for bpftrace. An unused probe costs a nop. Otherwise they go away
+ * entirely, arguments included.
+ *
+ * The first argument is always the device id, as in
+ * /net/reactivated/Fprint/Device/<id>, except for the main loop's
+ * dispatch probes. */
+
+#ifdef HAVE_SYSTEMTAP
+#include <sys/sdt.h>
+
+#define FPRINTD_PROBE0(name) \
+	DTRACE_PROBE(fprintd, name)
+#define FPRINTD_PROBE1(name, a1) \
+	DTRACE_PROBE1(fprintd, name, a1)
+#define FPRINTD_PROBE2(name, a1, a2) \
+	DTRACE_PROBE2(fprintd, name, a1, a2)
+#define FPRINTD_PROBE3(name, a1, a2, a3) \
+	DTRACE_PROBE3(fprintd, name, a1, a2, a3)
+#else
+#define FPRINTD_PROBE0(name) do { } while (0)
+#define FPRINTD_PROBE1(name, a1) do { } while (0)
+#define FPRINTD_PROBE2(name, a1, a2) do { } while (0)
+#define FPRINTD_PROBE3(name, a1, a2, a3) do { } while (0)
+#endif
+
+/* Values of the "op" argument of the store probes */
+#define PROBE_STORE_LOAD "load"
+#define PROBE_STORE_SAVE "save"
+#define PROBE_STORE_DELETE "delete"
+#define PROBE_STORE_DISCOVER "discover"
+
+#endif
+
@@ -0,0 +1,148 @@
+/*
+ * Recording of libfprint device sessions for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Writes the results libfprint gave each device, and how long they
+ * took, to a file per device, so that a reader's behaviour seen in
+ * the field can be fed back to fprintd through the virtual readers
+ * in tests/. Each line holds the callback ("open", "verify",
+ * "identify" or "enroll"), its result, the microseconds since the
+ * operation was started or since the previous result, whichever came
+ * last, and optionally the file the scanned image was saved to.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <glib.h>
+#include <libfprint/fprint.h>
+
+#include "stats.h"
+#include "log.h"
+#include "recorder.h"
+
+struct recorder {
+	guint32 id;
+	FILE *file;
+	/* When the previous result was recorded */
+	guint64 last;
+	guint images;
+};
+
+static char *record_dir = NULL;
+static gboolean record_images = FALSE;
+
+void recorder_init(GKeyFile *conf)
+{
+	record_dir = g_key_file_get_string(conf, "debug", "record-dir", NULL);
+	if (record_dir != NULL && *record_dir == '\0') {
+		g_free(record_dir);
+		record_dir = NULL;
+	}
+	record_images = g_key_file_get_boolean(conf, "debug", "record-images", NULL);
+
+	if (record_dir != NULL)
+		fprint_message(FPRINT_LOG_MAIN, "recording device sessions to %s", record_dir);
+}
+
+struct recorder *recorder_new(guint32 id)
+{
+	struct recorder *rec;
+
+	if (record_dir == NULL)
+		return NULL;
+
+	rec = g_new0(struct recorder, 1);
+	rec->id = id;
+	return rec;
+}
+
+void recorder_free(struct recorder *rec)
+{
+	if (rec == NULL)
+		return;
+	if (rec->file != NULL)
+		fclose(rec->file);
+	g_free(rec);
+}
+
+/* Opened on first use, for devices that never get claimed */
+static gboolean recorder_open(struct recorder *rec)
+{
+	char *path;
+	char *name;
+
+	if (rec->file != NULL)
+		return TRUE;
+
+	if (g_mkdir_with_parents(record_dir, 0700) < 0) {
+		g_warning("could not create %s: %s", record_dir, g_strerror(errno));
+		return FALSE;
+	}
+
+	name = g_strdup_printf("device-%u.rec", rec->id);
+	path = g_build_filename(record_dir, name, NULL);
+	g_free(name);
+	rec->file = fopen(path, "a");
+	if (rec->file == NULL) {
+		g_warning("could not open %s: %s", path, g_strerror(errno));
+		g_free(path);
+		return FALSE;
+	}
+	g_free(path);
+
+	fprintf(rec->file, "# fprintd recording of device %u\n", rec->id);
+	return TRUE;
+}
+
+void recorder_event(struct recorder *rec, const char *kind, int result,
+	guint64 since, struct fp_img *img)
+{
+	guint64 now;
+	char *image = NULL;
+
+	if (rec == NULL || !recorder_open(rec))
+		return;
+
+	now = fprint_stats_now();
+	if (rec->last > since)
+		since = rec->last;
+	rec->last = now;
+
+	if (img != NULL && record_images) {
+		char *path;
+
+		image = g_strdup_printf("device-%u-%05u.pgm", rec->id, rec->images++);
+		path = g_build_filename(record_dir, image, NULL);
+		if (fp_img_save_to_file(img, path) < 0) {
+			g_free(image);
+			image = NULL;
+		}
+		g_free(path);
+	}
+
+	fprintf(rec->file, "%s %d %" G_GUINT64_FORMAT "%s%s\n", kind, result,
+		now > since ? now - since : 0,
+		image ? " " : "", image ? image : "");
+	fflush(rec->file);
+	g_free(image);
+}
+
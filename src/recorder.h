@@ -0,0 +1,39 @@
+/*
+ * Recording of libfprint device sessions for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef RECORDER_H
+
+#define RECORDER_H
+
+struct recorder;
+
+void recorder_init(GKeyFile *conf);
+
+/* Returns NULL, which the other functions accept, if not recording */
+struct recorder *recorder_new(guint32 id);
+void recorder_free(struct recorder *rec);
+
+/* Records a libfprint callback, since being when the operation it
+ * belongs to was started, see fprint_stats_now() */
+void recorder_event(struct recorder *rec, const char *kind, int result,
+	guint64 since, struct fp_img *img);
+
+#endif
+
@@ -0,0 +1,363 @@
+/*
+ * Operation counters and latency histograms for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Each device keeps its own statistics, and every update is also
+ * applied to the totals the manager exports. Everything runs from
+ * the main loop, so updating is a couple of plain increments, inside
+ * the page's seqlock for the benefit of outside readers. */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <dbus/dbus-glib.h>
+#include <libfprint/fprint.h>
+
+#include "stats.h"
+
+/* Used if the page can't be published */
+static struct fprint_stats_page private_page;
+static struct fprint_stats_page *page = &private_page;
+
+static const char *counter_names[STATS_NUM_COUNTERS] = {
+	"attempts",
+	"matches",
+	"no-matches",
+	"retry-scan",
+	"swipe-too-short",
+	"finger-not-centered",
+	"remove-and-retry",
+	"disconnects",
+	"errors",
+	"enroll-stages",
+	"enroll-completed",
+	"enroll-failed",
+	"corrupt-prints",
+};
+
+static const char *phase_names[STATS_NUM_PHASES] = {
+	"claim",
+	"open",
+	"verify",
+	"identify",
+	"enroll-stage",
+	"store-load",
+	"store-save",
+	"store-delete",
+	"store-discover",
+};
+
+/* in microseconds, the last bucket has no upper bound */
+static const guint64 bucket_bounds[STATS_NUM_BUCKETS - 1] = {
+	1000, 2500, 5000, 10000, 25000, 50000, 100000,
+	250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+static void page_setup(struct fprint_stats_page *p)
+{
+	guint i;
+
+	p->magic = STATS_PAGE_MAGIC;
+	p->version = STATS_PAGE_VERSION;
+	p->size = sizeof(struct fprint_stats_page);
+	p->num_counters = STATS_NUM_COUNTERS;
+	p->num_phases = STATS_NUM_PHASES;
+	p->num_buckets = STATS_NUM_BUCKETS;
+	p->max_devices = STATS_PAGE_MAX_DEVICES;
+
+	for (i = 0; i < STATS_NUM_COUNTERS; i++)
+		g_strlcpy(p->counter_names[i], counter_names[i], STATS_PAGE_NAME_LEN);
+	for (i = 0; i < STATS_NUM_PHASES; i++)
+		g_strlcpy(p->phase_names[i], phase_names[i], STATS_PAGE_NAME_LEN);
+	memcpy(p->bucket_bounds, bucket_bounds, sizeof(bucket_bounds));
+
+	for (i = 0; i < STATS_PAGE_MAX_DEVICES; i++)
+		p->device_ids[i] = G_MAXUINT32;
+}
+
+/* Maps a fresh page at STATS_PAGE_PATH, renamed into place so that
+ * readers of a previous instance keep their consistent view */
+void fprint_stats_init(void)
+{
+	struct fprint_stats_page *p;
+	char *dir, *tmp;
+	int fd;
+
+	page_setup(&private_page);
+
+	dir = g_path_get_dirname(STATS_PAGE_PATH);
+	g_mkdir_with_parents(dir, 0755);
+	g_free(dir);
+
+	tmp = g_strdup_printf("%s.XXXXXX", STATS_PAGE_PATH);
+	fd = g_mkstemp(tmp);
+	if (fd < 0) {
+		g_message("Could not create statistics page %s: %s", tmp, g_strerror(errno));
+		g_free(tmp);
+		return;
+	}
+
+	if (fchmod(fd, 0644) < 0 ||
+	    ftruncate(fd, sizeof(struct fprint_stats_page)) < 0)
+		goto fail;
+
+	p = mmap(NULL, sizeof(struct fprint_stats_page), PROT_READ | PROT_WRITE,
+		 MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		goto fail;
+
+	page_setup(p);
+	if (g_rename(tmp, STATS_PAGE_PATH) < 0) {
+		munmap(p, sizeof(struct fprint_stats_page));
+		goto fail;
+	}
+	page = p;
+
+	close(fd);
+	g_free(tmp);
+	return;
+
+fail:
+	g_message("Could not publish statistics page %s: %s", STATS_PAGE_PATH, g_strerror(errno));
+	g_unlink(tmp);
+	close(fd);
+	g_free(tmp);
+}
+
+struct fprint_stats *fprint_stats_get_total(void)
+{
+	return &page->total;
+}
+
+/* Devices get a slot in the page while there are some left,
+ * the others are only counted in the totals */
+struct fprint_stats *fprint_stats_new_device(guint32 id)
+{
+	guint i;
+
+	for (i = 0; i < STATS_PAGE_MAX_DEVICES; i++) {
+		if (page->device_ids[i] == G_MAXUINT32) {
+			page->seq++;
+			__sync_synchronize();
+			page->device_ids[i] = id;
+			__sync_synchronize();
+			page->seq++;
+			return &page->devices[i];
+		}
+	}
+
+	return g_new0(struct fprint_stats, 1);
+}
+
+void fprint_stats_free_device(struct fprint_stats *stats)
+{
+	guint i;
+
+	for (i = 0; i < STATS_PAGE_MAX_DEVICES; i++) {
+		if (stats == &page->devices[i]) {
+			page->seq++;
+			__sync_synchronize();
+			page->device_ids[i] = G_MAXUINT32;
+			memset(stats, 0, sizeof(struct fprint_stats));
+			__sync_synchronize();
+			page->seq++;
+			return;
+		}
+	}
+
+	g_free(stats);
+}
+
+guint64 fprint_stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (guint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+void fprint_stats_count(struct fprint_stats *stats,
+	enum fprint_stats_counter counter)
+{
+	page->seq++;
+	__sync_synchronize();
+	stats->counters[counter]++;
+	page->total.counters[counter]++;
+	__sync_synchronize();
+	page->seq++;
+}
+
+void fprint_stats_verify_result(struct fprint_stats *stats, int result)
+{
+	switch (result) {
+	case FP_VERIFY_NO_MATCH:
+		fprint_stats_count(stats, STATS_ATTEMPTS);
+		fprint_stats_count(stats, STATS_NO_MATCHES);
+		break;
+	case FP_VERIFY_MATCH:
+		fprint_stats_count(stats, STATS_ATTEMPTS);
+		fprint_stats_count(stats, STATS_MATCHES);
+		break;
+	case FP_VERIFY_RETRY:
+		fprint_stats_count(stats, STATS_RETRY_SCAN);
+		break;
+	case FP_VERIFY_RETRY_TOO_SHORT:
+		fprint_stats_count(stats, STATS_SWIPE_TOO_SHORT);
+		break;
+	case FP_VERIFY_RETRY_CENTER_FINGER:
+		fprint_stats_count(stats, STATS_FINGER_NOT_CENTERED);
+		break;
+	case FP_VERIFY_RETRY_REMOVE_FINGER:
+		fprint_stats_count(stats, STATS_REMOVE_AND_RETRY);
+		break;
+	case -EPROTO:
+		fprint_stats_count(stats, STATS_DISCONNECTS);
+		break;
+	default:
+		fprint_stats_count(stats, STATS_ERRORS);
+	}
+}
+
+void fprint_stats_enroll_result(struct fprint_stats *stats, int result)
+{
+	switch (result) {
+	case FP_ENROLL_COMPLETE:
+		fprint_stats_count(stats, STATS_ENROLL_COMPLETED);
+		break;
+	case FP_ENROLL_FAIL:
+		fprint_stats_count(stats, STATS_ENROLL_FAILED);
+		break;
+	case FP_ENROLL_PASS:
+		fprint_stats_count(stats, STATS_ENROLL_STAGES);
+		break;
+	case FP_ENROLL_RETRY:
+		fprint_stats_count(stats, STATS_RETRY_SCAN);
+		break;
+	case FP_ENROLL_RETRY_TOO_SHORT:
+		fprint_stats_count(stats, STATS_SWIPE_TOO_SHORT);
+		break;
+	case FP_ENROLL_RETRY_CENTER_FINGER:
+		fprint_stats_count(stats, STATS_FINGER_NOT_CENTERED);
+		break;
+	case FP_ENROLL_RETRY_REMOVE_FINGER:
+		fprint_stats_count(stats, STATS_REMOVE_AND_RETRY);
+		break;
+	case -EPROTO:
+		fprint_stats_count(stats, STATS_DISCONNECTS);
+		break;
+	default:
+		fprint_stats_count(stats, STATS_ERRORS);
+	}
+}
+
+static void histogram_add(struct fprint_histogram *hist, guint bucket, guint64 usecs)
+{
+	hist->count++;
+	hist->sum += usecs;
+	hist->buckets[bucket]++;
+}
+
+/* Records the time elapsed since start, as returned by
+ * fprint_stats_now(), in the phase's histogram */
+void fprint_stats_record(struct fprint_stats *stats,
+	enum fprint_stats_phase phase, guint64 start)
+{
+	guint64 usecs = fprint_stats_now() - start;
+	guint bucket;
+
+	for (bucket = 0; bucket < G_N_ELEMENTS(bucket_bounds); bucket++) {
+		if (usecs <= bucket_bounds[bucket])
+			break;
+	}
+
+	page->seq++;
+	__sync_synchronize();
+	histogram_add(&stats->phases[phase], bucket, usecs);
+	histogram_add(&page->total.phases[phase], bucket, usecs);
+	__sync_synchronize();
+	page->seq++;
+}
+
+static void value_free(gpointer data)
+{
+	GValue *value = data;
+
+	g_value_unset(value);
+	g_free(value);
+}
+
+GHashTable *fprint_stats_get_counters(const struct fprint_stats *stats)
+{
+	GHashTable *counters;
+	guint i;
+
+	counters = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, value_free);
+	for (i = 0; i < STATS_NUM_COUNTERS; i++) {
+		GValue *value = g_new0(GValue, 1);
+
+		g_value_init(value, G_TYPE_UINT64);
+		g_value_set_uint64(value, stats->counters[i]);
+		g_hash_table_insert(counters, (gpointer) counter_names[i], value);
+	}
+
+	return counters;
+}
+
+/* Each histogram is sent as an array made of the number of samples,
+ * their sum in microseconds, and the count for each bucket */
+GHashTable *fprint_stats_get_histograms(const struct fprint_stats *stats)
+{
+	GHashTable *histograms;
+	GType type;
+	guint i;
+
+	type = dbus_g_type_get_collection("GArray", G_TYPE_UINT64);
+	histograms = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, value_free);
+	for (i = 0; i < STATS_NUM_PHASES; i++) {
+		const struct fprint_histogram *hist = &stats->phases[i];
+		GValue *value = g_new0(GValue, 1);
+		GArray *array;
+
+		array = g_array_sized_new(FALSE, FALSE, sizeof(guint64), STATS_NUM_BUCKETS + 2);
+		g_array_append_val(array, hist->count);
+		g_array_append_val(array, hist->sum);
+		g_array_append_vals(array, hist->buckets, STATS_NUM_BUCKETS);
+
+		g_value_init(value, type);
+		g_value_take_boxed(value, array);
+		g_hash_table_insert(histograms, (gpointer) phase_names[i], value);
+	}
+
+	return histograms;
+}
+
+GArray *fprint_stats_get_buckets(void)
+{
+	GArray *bounds;
+
+	bounds = g_array_sized_new(FALSE, FALSE, sizeof(guint64), G_N_ELEMENTS(bucket_bounds));
+	g_array_append_vals(bounds, bucket_bounds, G_N_ELEMENTS(bucket_bounds));
+
+	return bounds;
+}
+
@@ -0,0 +1,126 @@
+/*
+ * Operation counters and latency histograms for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef STATS_H
+
+#define STATS_H
+
+enum fprint_stats_counter {
+	STATS_ATTEMPTS = 0,
+	STATS_MATCHES,
+	STATS_NO_MATCHES,
+	STATS_RETRY_SCAN,
+	STATS_SWIPE_TOO_SHORT,
+	STATS_FINGER_NOT_CENTERED,
+	STATS_REMOVE_AND_RETRY,
+	STATS_DISCONNECTS,
+	STATS_ERRORS,
+	STATS_ENROLL_STAGES,
+	STATS_ENROLL_COMPLETED,
+	STATS_ENROLL_FAILED,
+	STATS_CORRUPT_PRINTS,
+	STATS_NUM_COUNTERS
+};
+
+enum fprint_stats_phase {
+	STATS_PHASE_CLAIM = 0,
+	STATS_PHASE_OPEN,
+	STATS_PHASE_VERIFY,
+	STATS_PHASE_IDENTIFY,
+	STATS_PHASE_ENROLL_STAGE,
+	STATS_PHASE_STORE_LOAD,
+	STATS_PHASE_STORE_SAVE,
+	STATS_PHASE_STORE_DELETE,
+	STATS_PHASE_STORE_DISCOVER,
+	STATS_NUM_PHASES
+};
+
+/* Upper bounds of the histogram buckets are fixed, from 1ms to 10s,
+ * the last bucket holding anything slower */
+#define STATS_NUM_BUCKETS 14
+
+struct fprint_histogram {
+	guint64 count;
+	/* in microseconds */
+	guint64 sum;
+	guint64 buckets[STATS_NUM_BUCKETS];
+};
+
+struct fprint_stats {
+	guint64 counters[STATS_NUM_COUNTERS];
+	struct fprint_histogram phases[STATS_NUM_PHASES];
+};
+
+/* The statistics are published in a file that monitoring tools can
+ * map read-only. The daemon is the only writer, and makes seq odd
+ * while it updates the page, so a reader has a consistent snapshot
+ * if seq was even and unchanged before and after copying it. */
+#ifndef STATS_PAGE_PATH
+#define STATS_PAGE_PATH "/run/fprintd/stats"
+#endif
+
+#define STATS_PAGE_MAGIC 0x74737066 /* "fpst" */
+#define STATS_PAGE_VERSION 2
+#define STATS_PAGE_MAX_DEVICES 8
+#define STATS_PAGE_NAME_LEN 32
+
+struct fprint_stats_page {
+	guint32 magic;
+	guint32 version;
+	/* Size of the page, and of its arrays */
+	guint32 size;
+	guint32 num_counters;
+	guint32 num_phases;
+	guint32 num_buckets;
+	guint32 max_devices;
+	volatile guint32 seq;
+
+	char counter_names[STATS_NUM_COUNTERS][STATS_PAGE_NAME_LEN];
+	char phase_names[STATS_NUM_PHASES][STATS_PAGE_NAME_LEN];
+	guint64 bucket_bounds[STATS_NUM_BUCKETS - 1];
+
+	/* Sum of the statistics of all the devices */
+	struct fprint_stats total;
+	/* The device ids, as in /net/reactivated/Fprint/Device/<id>,
+	 * G_MAXUINT32 for unused slots */
+	guint32 device_ids[STATS_PAGE_MAX_DEVICES];
+	struct fprint_stats devices[STATS_PAGE_MAX_DEVICES];
+};
+
+void fprint_stats_init(void);
+
+struct fprint_stats *fprint_stats_get_total(void);
+struct fprint_stats *fprint_stats_new_device(guint32 id);
+void fprint_stats_free_device(struct fprint_stats *stats);
+
+guint64 fprint_stats_now(void);
+
+void fprint_stats_count(struct fprint_stats *stats,
+	enum fprint_stats_counter counter);
+void fprint_stats_verify_result(struct fprint_stats *stats, int result);
+void fprint_stats_enroll_result(struct fprint_stats *stats, int result);
+void fprint_stats_record(struct fprint_stats *stats,
+	enum fprint_stats_phase phase, guint64 start);
+
+GHashTable *fprint_stats_get_counters(const struct fprint_stats *stats);
+GHashTable *fprint_stats_get_histograms(const struct fprint_stats *stats);
+GArray *fprint_stats_get_buckets(void);
+
+#endif
+
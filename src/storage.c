@@ -0,0 +1,81 @@
+/*
+ * Storage setup for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Fills in a struct storage, with the built-in file storage or a
+ * storage module, for fprintd, fprintd-store, and the modules
+ * wrapping another storage, which get these from the program that
+ * loaded them, along with the file storage itself.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <gmodule.h>
+#include <libfprint/fprint.h>
+
+#include "storage.h"
+#include "file_storage.h"
+
+void storage_set_file(struct storage *storage)
+{
+	storage->init = &file_storage_init;
+	storage->deinit = &file_storage_deinit;
+	storage->print_data_save = &file_storage_print_data_save;
+	storage->print_data_load = &file_storage_print_data_load;
+	storage->print_data_delete = &file_storage_print_data_delete;
+	storage->discover_prints = &file_storage_discover_prints;
+	storage->discover_users = NULL;
+}
+
+/* Loads the module, from PLUGINDIR, or a full path to try modules
+ * that aren't installed, and configures it with conf */
+gboolean storage_load_module(const char *name, GKeyFile *conf, struct storage *storage)
+{
+	GModule *module;
+	char *filename;
+	storage_configure configure;
+
+	if (g_path_is_absolute(name))
+		filename = g_strdup(name);
+	else
+		filename = g_module_build_path(PLUGINDIR, name);
+	module = g_module_open(filename, 0);
+	g_free(filename);
+	if (module == NULL)
+		return FALSE;
+
+	if (!g_module_symbol(module, "init", (gpointer *) &storage->init) ||
+	    !g_module_symbol(module, "deinit", (gpointer *) &storage->deinit) ||
+	    !g_module_symbol(module, "print_data_save", (gpointer *) &storage->print_data_save) ||
+	    !g_module_symbol(module, "print_data_load", (gpointer *) &storage->print_data_load) ||
+	    !g_module_symbol(module, "print_data_delete", (gpointer *) &storage->print_data_delete) ||
+	    !g_module_symbol(module, "discover_prints", (gpointer *) &storage->discover_prints)) {
+		g_module_close(module);
+		return FALSE;
+	}
+
+	if (!g_module_symbol(module, "discover_users", (gpointer *) &storage->discover_users))
+		storage->discover_users = NULL;
+	if (g_module_symbol(module, "configure", (gpointer *) &configure))
+		configure(conf);
+	g_module_make_resident(module);
+
+	return TRUE;
+}
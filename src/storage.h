@@ -31,6 +31,10 @@ typedef int (*storage_print_data_delete)(struct fp_dscv_dev *dev,
 typedef GSList *(*storage_discover_prints)(struct fp_dscv_dev *dev, const char *username);
 typedef int (*storage_init)(void);
 typedef int (*storage_deinit)(void);
+/* Optional for modules, called with fprintd.conf before init */
+typedef void (*storage_configure)(GKeyFile *conf);
+/* Optional for modules, the users with prints for the device */
+typedef GSList *(*storage_discover_users)(uint16_t driver_id, uint32_t devtype);
 
 struct storage {
 	storage_init init;
@@ -39,10 +43,15 @@ struct storage {
 	storage_print_data_load print_data_load;
 	storage_print_data_delete print_data_delete;
 	storage_discover_prints discover_prints;
+	/* NULL if the storage can't list them */
+	storage_discover_users discover_users;
 };
 
 typedef struct storage fp_storage;
 
+void storage_set_file(struct storage *storage);
+gboolean storage_load_module(const char *name, GKeyFile *conf, struct storage *storage);
+
 /* The currently setup store */
 fp_storage store;
 
@@ -0,0 +1,397 @@
+/*
+ * Index of the fprintd file storage
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Which fingers each user has enrolled on each device, so that the
+ * file storage can list them without scanning directories. A thread
+ * builds it at startup, reading every print in bulk, see bulk_read.c,
+ * and leaving out those libfprint can't parse, while fprintd carries
+ * on. Until it's done, prints get listed from the directories.
+ *
+ * Saves and deletes keep it up to date. Those made while it was being
+ * built could be missed by the scan, so those users and devices are
+ * listed from their directories once, and indexed then. Prints added
+ * behind fprintd's back, by fprintd-store import for example, only get
+ * seen after a restart.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+#include <libfprint/fprint.h>
+
+#include "file_storage.h"
+#include "bulk_read.h"
+#include "store_index.h"
+
+/* Files read at once */
+#define INDEX_READ_DEPTH 64
+
+static GMutex *mutex = NULL;
+/* Bitmask of fingers, by "username/driver/devtype" */
+static GHashTable *fingers = NULL;
+/* Keys to list from the directories, and keys changed while scanning */
+static GHashTable *unknown = NULL;
+static GHashTable *touched = NULL;
+static gboolean complete = FALSE;
+
+struct scan_entry {
+	/* Owned by the users being scanned */
+	const char *username;
+	const char *user_dir;
+	guint16 driver_id;
+	guint32 devtype;
+	int finger;
+	/* Of the user and device, in the scan's masks */
+	guint *mask;
+};
+
+struct scan {
+	GPtrArray *paths;
+	/* What each path is the print of */
+	GArray *entries;
+	/* Bitmasks of valid fingers, by key */
+	GHashTable *masks;
+	guint invalid;
+	guint unreadable;
+};
+
+static char *make_key(const char *username, guint16 driver_id, guint32 devtype)
+{
+	return g_strdup_printf("%s/%04x/%08x", username, driver_id, devtype);
+}
+
+static gboolean parse_hex(const char *name, gsize len, guint32 *value)
+{
+	char *end;
+
+	if (strlen(name) != len)
+		return FALSE;
+	*value = g_ascii_strtoull(name, &end, 16);
+	return *end == '\0';
+}
+
+static void scan_user(struct scan *scan, const char *username, const char *dir)
+{
+	GDir *user_dir, *driver_dir, *devtype_dir;
+	const char *name, *name2, *name3;
+
+	user_dir = g_dir_open(dir, 0, NULL);
+	while (user_dir != NULL && (name = g_dir_read_name(user_dir)) != NULL) {
+		char *driver_path;
+		guint32 driver_id;
+
+		if (!parse_hex(name, 4, &driver_id))
+			continue;
+		driver_path = g_build_filename(dir, name, NULL);
+		driver_dir = g_dir_open(driver_path, 0, NULL);
+
+		while (driver_dir != NULL && (name2 = g_dir_read_name(driver_dir)) != NULL) {
+			struct scan_entry entry;
+			char *devtype_path;
+			guint32 devtype, finger;
+
+			if (!parse_hex(name2, 8, &devtype))
+				continue;
+			devtype_path = g_build_filename(driver_path, name2, NULL);
+			devtype_dir = g_dir_open(devtype_path, 0, NULL);
+			entry.username = username;
+			entry.user_dir = dir;
+			entry.driver_id = driver_id;
+			entry.devtype = devtype;
+			entry.mask = g_new0(guint, 1);
+			g_hash_table_insert(scan->masks, make_key(username, driver_id, devtype), entry.mask);
+
+			while (devtype_dir != NULL && (name3 = g_dir_read_name(devtype_dir)) != NULL) {
+				if (!parse_hex(name3, 1, &finger) ||
+				    finger < LEFT_THUMB || finger > RIGHT_LITTLE)
+					continue;
+				entry.finger = finger;
+				g_ptr_array_add(scan->paths, g_build_filename(devtype_path, name3, NULL));
+				g_array_append_val(scan->entries, entry);
+			}
+			if (devtype_dir != NULL)
+				g_dir_close(devtype_dir);
+			g_free(devtype_path);
+		}
+		if (driver_dir != NULL)
+			g_dir_close(driver_dir);
+		g_free(driver_path);
+	}
+	if (user_dir != NULL)
+		g_dir_close(user_dir);
+}
+
+static void list_dirs(const char *path, GSList **names)
+{
+	GDir *dir;
+	const char *name;
+
+	dir = g_dir_open(path, 0, NULL);
+	if (dir == NULL)
+		return;
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		if (name[0] != '.')
+			*names = g_slist_prepend(*names, g_build_filename(path, name, NULL));
+	}
+	g_dir_close(dir);
+}
+
+/* The users' directories, in either layout, fprintd's choice if both */
+static GHashTable *find_users(void)
+{
+	GHashTable *users;
+	GSList *flat = NULL, *level1 = NULL, *level2 = NULL, *hashed = NULL, *l;
+	char *root;
+
+	list_dirs(file_storage_get_path(), &flat);
+	root = g_build_filename(file_storage_get_path(), FILE_STORAGE_HASHED_DIR, NULL);
+	list_dirs(root, &level1);
+	for (l = level1; l != NULL; l = l->next)
+		list_dirs(l->data, &level2);
+	for (l = level2; l != NULL; l = l->next)
+		list_dirs(l->data, &hashed);
+	g_free(root);
+
+	users = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	/* The configured layout last, so that it wins */
+	if (file_storage_get_hashed_layout())
+		hashed = g_slist_concat(hashed, flat);
+	else
+		hashed = g_slist_concat(flat, hashed);
+	for (l = g_slist_reverse(hashed); l != NULL; l = l->next) {
+		if (g_file_test(l->data, G_FILE_TEST_IS_DIR))
+			g_hash_table_replace(users, g_path_get_basename(l->data), l->data);
+		else
+			g_free(l->data);
+	}
+
+	g_slist_free(hashed);
+	g_slist_foreach(level1, (GFunc) g_free, NULL);
+	g_slist_free(level1);
+	g_slist_foreach(level2, (GFunc) g_free, NULL);
+	g_slist_free(level2);
+
+	return users;
+}
+
+static void read_cb(guint index, const guchar *data, gsize len, int error,
+	gpointer user_data)
+{
+	struct scan *scan = user_data;
+	struct scan_entry *entry = &g_array_index(scan->entries, struct scan_entry, index);
+	struct fp_print_data *print;
+	char *decoded;
+	gsize decoded_len;
+
+	if (error < 0) {
+		scan->unreadable++;
+		return;
+	}
+
+	/* Those would only fail at verification time */
+	if (file_storage_decode(entry->username, entry->user_dir, entry->driver_id,
+				entry->devtype, entry->finger, (const char *) data, len,
+				&decoded, &decoded_len) < 0) {
+		g_message("not indexing unreadable print %s",
+			  (char *) g_ptr_array_index(scan->paths, index));
+		scan->invalid++;
+		return;
+	}
+	print = fp_print_data_from_data((guchar *) decoded, decoded_len);
+	memset(decoded, 0, decoded_len);
+	g_free(decoded);
+	if (print == NULL ||
+	    fp_print_data_get_driver_id(print) != entry->driver_id ||
+	    fp_print_data_get_devtype(print) != entry->devtype) {
+		g_message("not indexing invalid print %s",
+			  (char *) g_ptr_array_index(scan->paths, index));
+		scan->invalid++;
+		if (print != NULL)
+			fp_print_data_free(print);
+		return;
+	}
+	fp_print_data_free(print);
+
+	*entry->mask |= 1 << entry->finger;
+}
+
+static gpointer scan_thread(gpointer data)
+{
+	struct scan scan;
+	GHashTable *users;
+	GHashTableIter iter;
+	gpointer key, value;
+	GTimer *timer;
+	const char *method;
+	double elapsed;
+
+	timer = g_timer_new();
+	scan.paths = g_ptr_array_new();
+	scan.entries = g_array_new(FALSE, FALSE, sizeof(struct scan_entry));
+	scan.masks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	scan.invalid = scan.unreadable = 0;
+
+	users = find_users();
+	g_hash_table_iter_init(&iter, users);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		scan_user(&scan, key, value);
+	method = bulk_read(scan.paths, INDEX_READ_DEPTH, read_cb, &scan);
+	elapsed = g_timer_elapsed(timer, NULL);
+
+	g_mutex_lock(mutex);
+	g_hash_table_iter_init(&iter, scan.masks);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (g_hash_table_lookup(touched, key) != NULL)
+			continue;
+		if (*(guint *) value != 0)
+			g_hash_table_insert(fingers, g_strdup(key), GUINT_TO_POINTER(*(guint *) value));
+	}
+	/* Changed during the scan, which may have missed it */
+	g_hash_table_iter_init(&iter, touched);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		g_hash_table_insert(unknown, g_strdup(key), GINT_TO_POINTER(1));
+	g_hash_table_destroy(touched);
+	touched = NULL;
+	complete = TRUE;
+	g_mutex_unlock(mutex);
+
+	g_message("indexed %u prints of %u users in %.0f ms, %.0f files/s with %s, "
+		  "%u invalid, %u unreadable",
+		  scan.paths->len, g_hash_table_size(users), elapsed * 1000,
+		  elapsed > 0 ? scan.paths->len / elapsed : 0, method,
+		  scan.invalid, scan.unreadable);
+
+	g_hash_table_destroy(users);
+	g_hash_table_destroy(scan.masks);
+	g_ptr_array_foreach(scan.paths, (GFunc) g_free, NULL);
+	g_ptr_array_free(scan.paths, TRUE);
+	g_array_free(scan.entries, TRUE);
+	g_timer_destroy(timer);
+
+	return NULL;
+}
+
+/* Builds the index in the background, fprintd carrying on meanwhile */
+void store_index_start(void)
+{
+	GError *error = NULL;
+
+	mutex = g_mutex_new();
+	fingers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	unknown = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	touched = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	if (g_thread_create(scan_thread, NULL, FALSE, &error) == NULL) {
+		g_warning("could not start indexing the storage: %s", error->message);
+		g_error_free(error);
+	}
+}
+
+/* Returns FALSE if the prints need listing from the directories */
+gboolean store_index_lookup(const char *username, guint16 driver_id,
+	guint32 devtype, GSList **prints)
+{
+	char *key;
+	guint mask = 0;
+	gboolean found;
+	int finger;
+
+	if (mutex == NULL)
+		return FALSE;
+
+	key = make_key(username, driver_id, devtype);
+	g_mutex_lock(mutex);
+	found = complete && g_hash_table_lookup(unknown, key) == NULL;
+	if (found)
+		mask = GPOINTER_TO_UINT(g_hash_table_lookup(fingers, key));
+	g_mutex_unlock(mutex);
+	g_free(key);
+
+	if (!found)
+		return FALSE;
+
+	*prints = NULL;
+	for (finger = RIGHT_LITTLE; finger >= LEFT_THUMB; finger--) {
+		if (mask & (1 << finger))
+			*prints = g_slist_prepend(*prints, GINT_TO_POINTER(finger));
+	}
+	return TRUE;
+}
+
+/* The prints listed from the directories */
+void store_index_set(const char *username, guint16 driver_id,
+	guint32 devtype, GSList *prints)
+{
+	char *key;
+	guint mask = 0;
+	GSList *l;
+
+	if (mutex == NULL)
+		return;
+
+	for (l = prints; l != NULL; l = l->next)
+		mask |= 1 << GPOINTER_TO_INT(l->data);
+
+	key = make_key(username, driver_id, devtype);
+	g_mutex_lock(mutex);
+	if (complete) {
+		g_hash_table_remove(unknown, key);
+		if (mask != 0)
+			g_hash_table_insert(fingers, g_strdup(key), GUINT_TO_POINTER(mask));
+		else
+			g_hash_table_remove(fingers, key);
+	}
+	g_mutex_unlock(mutex);
+	g_free(key);
+}
+
+void store_index_update(const char *username, guint16 driver_id,
+	guint32 devtype, int finger, gboolean present)
+{
+	char *key;
+	guint mask;
+
+	if (mutex == NULL)
+		return;
+
+	key = make_key(username, driver_id, devtype);
+	g_mutex_lock(mutex);
+	if (!complete) {
+		g_hash_table_insert(touched, key, GINT_TO_POINTER(1));
+		key = NULL;
+	} else if (g_hash_table_lookup(unknown, key) == NULL) {
+		mask = GPOINTER_TO_UINT(g_hash_table_lookup(fingers, key));
+		if (present)
+			mask |= 1 << finger;
+		else
+			mask &= ~(1 << finger);
+		if (mask != 0) {
+			g_hash_table_insert(fingers, key, GUINT_TO_POINTER(mask));
+			key = NULL;
+		} else {
+			g_hash_table_remove(fingers, key);
+		}
+	}
+	g_mutex_unlock(mutex);
+	g_free(key);
+}
+
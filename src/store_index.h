@@ -0,0 +1,35 @@
+/*
+ * Index of the fprintd file storage
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef STORE_INDEX_H
+
+#define STORE_INDEX_H
+
+void store_index_start(void);
+
+gboolean store_index_lookup(const char *username, guint16 driver_id,
+	guint32 devtype, GSList **prints);
+void store_index_set(const char *username, guint16 driver_id,
+	guint32 devtype, GSList *prints);
+void store_index_update(const char *username, guint16 driver_id,
+	guint32 devtype, int finger, gboolean present);
+
+#endif
+
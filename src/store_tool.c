@@ -0,0 +1,1681 @@
+/*
+ * Print store maintenance for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* fprintd-store works on the prints kept by the file storage, while
+ * fprintd is running or not, with commands:
+ *
+ * migrate: moves users to the layout set in fprintd.conf, or the one
+ * given with --to, a batch at a time, pausing between batches. Each
+ * user's directory is renamed at once, and fprintd looks for users in
+ * both layouts, so nothing needs to be stopped. A print fprintd saved
+ * to the old location while its user was being moved is moved over
+ * afterwards. fprintd's journal records prints by their location, so
+ * migrate refuses to start while it holds prints not compacted yet,
+ * and waits for those saved meanwhile to be, between passes.
+ *
+ * export [FILE]: writes the prints, or those of the --user and
+ * --device given, to a single checksummed archive, FILE or the
+ * standard output, from the file storage. The journal isn't read, so
+ * export waits for fprintd to compact it first, and fails if it
+ * doesn't in time. Encrypted prints are decrypted, so that
+ * the archive can be imported on another machine, and needs keeping
+ * as safe as the host key.
+ *
+ * import [FILE]: reads such an archive, FILE or the standard input,
+ * validating the prints with libfprint in --jobs threads, and saving
+ * them through whichever storage fprintd.conf sets up. The prints are
+ * held in memory until the archive's count and digest check out, so a
+ * damaged or truncated archive doesn't import anything. --verify only
+ * checks the archive.
+ *
+ * check: walks the file storage in --jobs threads, validating every
+ * print with libfprint, and reporting prints per device and per user,
+ * invalid prints, files left over from interrupted writes, empty
+ * directories, and users left in both layouts. --fix removes the
+ * left-over files and empty directories, and --rewrite saves the
+ * prints again as the current libfprint does, encrypting them or not
+ * as fprintd.conf says, both with fprintd stopped. With fprintd
+ * running, --rate limits the prints read per second, one thread at a
+ * time by default, at the lowest priority.
+ *
+ * scrub: reads every print file, or those of the --user and --device
+ * given, in bulk, with io_uring if available, and verifies their
+ * checksums without decrypting or parsing them, reporting corrupt
+ * prints and those saved without a checksum.
+ *
+ * users: lists the users with prints for each --device, given as
+ * DRIVER:DEVTYPE, from the device index of a storage module that has
+ * one, such as kv, or by walking the file storage.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libfprint/fprint.h>
+
+#include "storage.h"
+#include "file_storage.h"
+#include "file_journal.h"
+#include "print_crypt.h"
+#include "bulk_read.h"
+#include "crc32c.h"
+
+/* Passes over the old layout, for prints saved there meanwhile */
+#define MIGRATE_PASSES 3
+/* Seconds to wait for fprintd to compact its journal, between
+ * migrate's passes or before exporting */
+#define JOURNAL_WAIT 60
+
+static char *conf_path = NULL;
+static char *to_layout = NULL;
+static int batch_size = 100;
+static int pause_ms = 100;
+static char **selected_users = NULL;
+static char **selected_devices = NULL;
+static int jobs = 0;
+static gboolean verify_only = FALSE;
+static gboolean check_fix = FALSE;
+static gboolean check_rewrite = FALSE;
+static gboolean check_list_users = FALSE;
+static int check_rate = 0;
+
+/* FALSE if fprintd.conf sets up a storage module */
+static gboolean file_store = TRUE;
+
+static const GOptionEntry entries[] = {
+	{ "config", 'c', 0, G_OPTION_ARG_FILENAME, &conf_path, "Use another configuration file", "FILE" },
+	{ "to", 't', 0, G_OPTION_ARG_STRING, &to_layout, "migrate: layout to move users to, flat or hashed (default from the configuration)", "LAYOUT" },
+	{ "batch", 'b', 0, G_OPTION_ARG_INT, &batch_size, "migrate: users to move between pauses (default 100)", "N" },
+	{ "pause", 'p', 0, G_OPTION_ARG_INT, &pause_ms, "migrate: milliseconds to pause between batches (default 100)", "MS" },
+	{ "user", 'u', 0, G_OPTION_ARG_STRING_ARRAY, &selected_users, "export, import, check, scrub, users: only this user's prints, can be repeated", "USER" },
+	{ "device", 'd', 0, G_OPTION_ARG_STRING_ARRAY, &selected_devices, "export, import, check, scrub, users: only prints for this driver ID, in hex, optionally followed by :DEVTYPE, can be repeated", "DRIVER[:DEVTYPE]" },
+	{ "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "import, check: threads validating prints (default the number of processors)", "N" },
+	{ "verify", 'v', 0, G_OPTION_ARG_NONE, &verify_only, "import: check the archive without saving anything", NULL },
+	{ "fix", 'f', 0, G_OPTION_ARG_NONE, &check_fix, "check: remove left-over files and empty directories, with fprintd stopped", NULL },
+	{ "rewrite", 'w', 0, G_OPTION_ARG_NONE, &check_rewrite, "check: save prints again in the current format, with fprintd stopped", NULL },
+	{ "rate", 'r', 0, G_OPTION_ARG_INT, &check_rate, "check: prints to read per second at most, while fprintd runs", "N" },
+	{ "list-users", 'l', 0, G_OPTION_ARG_NONE, &check_list_users, "check: report the prints of each user", NULL },
+	{ NULL }
+};
+
+static gboolean load_conf(void)
+{
+	GKeyFile *file;
+	GError *error = NULL;
+	char *filename, *value;
+	gboolean ret = TRUE;
+
+	if (conf_path != NULL)
+		filename = g_strdup(conf_path);
+	else
+		filename = g_build_filename(SYSCONFDIR, "fprintd.conf", NULL);
+	file = g_key_file_new();
+	if (!g_key_file_load_from_file(file, filename, G_KEY_FILE_NONE, &error)) {
+		g_printerr("Could not open %s: %s\n", filename, error->message);
+		g_error_free(error);
+	}
+	g_free(filename);
+
+	storage_set_file(&store);
+
+	value = g_key_file_get_string(file, "storage", "type", NULL);
+	if (value != NULL && !g_str_equal(value, "file")) {
+		file_store = FALSE;
+		if (!storage_load_module(value, file, &store)) {
+			g_printerr("Could not load the %s storage\n", value);
+			ret = FALSE;
+		}
+	}
+	g_free(value);
+
+	if (!file_storage_configure(file)) {
+		value = g_key_file_get_string(file, "storage", "layout", NULL);
+		g_printerr("Unknown storage layout %s\n", value);
+		g_free(value);
+		ret = FALSE;
+	}
+	/* The journal and the index are fprintd's, the tool works on the
+	 * prints' files, also under a module wrapping the file storage */
+	file_storage_set_journal(FALSE, 0);
+	file_storage_set_index(FALSE);
+
+	g_key_file_free(file);
+	return ret;
+}
+
+/* Names of the subdirectories, "." ones left out */
+static GSList *list_dirs(const char *path)
+{
+	GDir *dir;
+	const char *name;
+	GSList *names = NULL;
+
+	dir = g_dir_open(path, 0, NULL);
+	if (dir == NULL)
+		return NULL;
+
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		char *full;
+
+		if (name[0] == '.')
+			continue;
+		full = g_build_filename(path, name, NULL);
+		if (g_file_test(full, G_FILE_TEST_IS_DIR))
+			names = g_slist_prepend(names, g_strdup(name));
+		g_free(full);
+	}
+	g_dir_close(dir);
+
+	return names;
+}
+
+static void free_list(GSList *list)
+{
+	g_slist_foreach(list, (GFunc) g_free, NULL);
+	g_slist_free(list);
+}
+
+/* Users stored in the given layout */
+static GSList *list_users(gboolean hashed)
+{
+	GSList *users = NULL, *level1, *level2, *l, *m;
+	char *root;
+
+	if (!hashed)
+		return list_dirs(file_storage_get_path());
+
+	root = g_build_filename(file_storage_get_path(), FILE_STORAGE_HASHED_DIR, NULL);
+	level1 = list_dirs(root);
+	for (l = level1; l != NULL; l = l->next) {
+		char *dir1 = g_build_filename(root, l->data, NULL);
+
+		level2 = list_dirs(dir1);
+		for (m = level2; m != NULL; m = m->next) {
+			char *dir2 = g_build_filename(dir1, m->data, NULL);
+
+			users = g_slist_concat(list_dirs(dir2), users);
+			g_free(dir2);
+		}
+		free_list(level2);
+		g_free(dir1);
+	}
+	free_list(level1);
+	g_free(root);
+
+	return users;
+}
+
+/* Removes the directory if empty, and its parents up to the store */
+static void remove_empty_dirs(const char *path)
+{
+	char *dir = g_strdup(path);
+
+	while (strlen(dir) > strlen(file_storage_get_path()) && g_rmdir(dir) == 0) {
+		char *parent = g_path_get_dirname(dir);
+
+		file_journal_sync_dir(parent);
+		g_free(dir);
+		dir = parent;
+	}
+	g_free(dir);
+}
+
+/* Moves what's in src over dst, recursively, the prints in src being
+ * the newest ones */
+static int merge_dir(const char *src, const char *dst)
+{
+	GDir *dir;
+	const char *name;
+	int r = 0;
+
+	dir = g_dir_open(src, 0, NULL);
+	if (dir == NULL)
+		return -errno;
+
+	while (r == 0 && (name = g_dir_read_name(dir)) != NULL) {
+		char *from = g_build_filename(src, name, NULL);
+		char *to = g_build_filename(dst, name, NULL);
+
+		if (g_file_test(from, G_FILE_TEST_IS_DIR)) {
+			r = file_journal_ensure_dir(to);
+			if (r == 0)
+				r = merge_dir(from, to);
+		} else if (rename(from, to) < 0) {
+			r = -errno;
+		}
+		g_free(from);
+		g_free(to);
+	}
+	g_dir_close(dir);
+
+	if (r == 0)
+		r = file_journal_sync_dir(dst);
+	if (r == 0 && g_rmdir(src) < 0)
+		r = -errno;
+
+	return r;
+}
+
+/* Whether the prints of both directories were sealed with the same
+ * data key, or at most one of them has one */
+static gboolean same_user_key(const char *src, const char *dst)
+{
+	char *src_key, *dst_key, *a = NULL, *b = NULL;
+	gsize a_len = 0, b_len = 0;
+	gboolean same;
+
+	src_key = g_build_filename(src, PRINT_CRYPT_USER_KEY, NULL);
+	dst_key = g_build_filename(dst, PRINT_CRYPT_USER_KEY, NULL);
+	if (!g_file_test(src_key, G_FILE_TEST_EXISTS) ||
+	    !g_file_test(dst_key, G_FILE_TEST_EXISTS))
+		same = TRUE;
+	else
+		same = g_file_get_contents(src_key, &a, &a_len, NULL) &&
+		       g_file_get_contents(dst_key, &b, &b_len, NULL) &&
+		       a_len == b_len && memcmp(a, b, a_len) == 0;
+	g_free(a);
+	g_free(b);
+	g_free(src_key);
+	g_free(dst_key);
+
+	return same;
+}
+
+static int move_user(const char *username, gboolean hashed, gboolean *merged)
+{
+	char *src, *dst, *src_parent, *dst_parent;
+	int r = 0;
+
+	src = file_storage_get_user_dir(username, !hashed);
+	dst = file_storage_get_user_dir(username, hashed);
+	src_parent = g_path_get_dirname(src);
+	dst_parent = g_path_get_dirname(dst);
+
+	*merged = g_file_test(dst, G_FILE_TEST_IS_DIR);
+	if (*merged && !same_user_key(src, dst)) {
+		/* Moving the key over would leave the prints in dst
+		 * that no key opens anymore */
+		g_printerr("%s and %s have different print encryption keys\n", src, dst);
+		r = -EEXIST;
+	} else if (*merged) {
+		r = merge_dir(src, dst);
+	} else {
+		r = file_journal_ensure_dir(dst_parent);
+		if (r == 0 && rename(src, dst) < 0)
+			r = -errno;
+		if (r == 0)
+			r = file_journal_sync_dir(dst_parent);
+	}
+
+	if (r == 0) {
+		file_journal_sync_dir(src_parent);
+		remove_empty_dirs(src_parent);
+	}
+
+	g_free(src);
+	g_free(dst);
+	g_free(src_parent);
+	g_free(dst_parent);
+
+	return r;
+}
+
+static gboolean wait_for_journal(void)
+{
+	int waited;
+
+	for (waited = 0; file_journal_pending(file_storage_get_path()); waited++) {
+		if (waited == JOURNAL_WAIT)
+			return FALSE;
+		g_usleep(G_USEC_PER_SEC);
+	}
+
+	return TRUE;
+}
+
+static int migrate(int argc, char **argv)
+{
+	gboolean hashed = file_storage_get_hashed_layout();
+	guint moved = 0, merged = 0, failed = 0;
+	gboolean incomplete = FALSE;
+	int pass;
+
+	if (!file_store) {
+		g_printerr("Only the file storage has layouts\n");
+		return 1;
+	}
+
+	if (to_layout != NULL) {
+		if (!file_storage_set_layout(to_layout)) {
+			g_printerr("Unknown layout %s\n", to_layout);
+			return 1;
+		}
+		hashed = file_storage_get_hashed_layout();
+	}
+	if (batch_size < 1)
+		batch_size = 1;
+
+	/* Compacted after the move, its prints would go back to the old
+	 * layout */
+	if (file_journal_pending(file_storage_get_path())) {
+		g_printerr("The storage journal holds prints not compacted yet, "
+			   "start fprintd for it to compact them, and try again\n");
+		return 1;
+	}
+
+	for (pass = 0; pass < MIGRATE_PASSES; pass++) {
+		GSList *users, *l;
+		int in_batch = 0;
+
+		/* Saved to the old layout during the previous pass */
+		if (pass > 0 && !wait_for_journal()) {
+			g_printerr("fprintd didn't compact its journal within %d s\n",
+				   JOURNAL_WAIT);
+			incomplete = TRUE;
+			break;
+		}
+		users = list_users(!hashed);
+		if (users == NULL)
+			break;
+		/* Those were saved to during the previous pass */
+		if (pass > 0)
+			g_usleep(pause_ms * 1000);
+
+		for (l = users; l != NULL; l = l->next) {
+			gboolean was_merged;
+			int r;
+
+			r = move_user(l->data, hashed, &was_merged);
+			if (r < 0) {
+				g_printerr("Could not move %s: %s\n", (char *) l->data, g_strerror(-r));
+				failed++;
+			} else if (was_merged) {
+				merged++;
+			} else {
+				moved++;
+			}
+
+			if (++in_batch == batch_size && l->next != NULL) {
+				in_batch = 0;
+				g_printerr("%u users moved\n", moved);
+				g_usleep(pause_ms * 1000);
+			}
+		}
+		free_list(users);
+	}
+
+	if (!incomplete && file_journal_pending(file_storage_get_path())) {
+		g_printerr("Prints saved meanwhile are still in the journal, run migrate again\n");
+		incomplete = TRUE;
+	}
+
+	g_printerr("%u users moved to the %s layout, %u merged with prints already there, %u failed\n",
+		moved, hashed ? "hashed" : "flat", merged, failed);
+
+	return failed > 0 || incomplete ? 1 : 0;
+}
+
+/* Users stored in either layout, each with the directory fprintd
+ * would use for it */
+static GHashTable *list_all_users(void)
+{
+	GHashTable *table;
+	GSList *all, *l;
+
+	table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	all = g_slist_concat(list_users(FALSE), list_users(TRUE));
+	for (l = all; l != NULL; l = l->next) {
+		char *dir;
+
+		if (g_hash_table_lookup(table, l->data) != NULL) {
+			g_free(l->data);
+			continue;
+		}
+		dir = file_storage_get_user_dir(l->data, file_storage_get_hashed_layout());
+		if (!g_file_test(dir, G_FILE_TEST_IS_DIR)) {
+			g_free(dir);
+			dir = file_storage_get_user_dir(l->data, !file_storage_get_hashed_layout());
+		}
+		g_hash_table_insert(table, l->data, dir);
+	}
+	g_slist_free(all);
+
+	return table;
+}
+
+static gboolean user_selected(const char *username)
+{
+	int i;
+
+	if (selected_users == NULL)
+		return TRUE;
+	for (i = 0; selected_users[i] != NULL; i++) {
+		if (g_str_equal(selected_users[i], username))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* --device is a driver ID, optionally followed by :devtype, in hex */
+static gboolean device_selected(guint16 driver_id, guint32 devtype)
+{
+	int i;
+
+	if (selected_devices == NULL)
+		return TRUE;
+	for (i = 0; selected_devices[i] != NULL; i++) {
+		char *end;
+
+		if (g_ascii_strtoull(selected_devices[i], &end, 16) != driver_id)
+			continue;
+		if (*end == '\0' ||
+		    (*end == ':' && g_ascii_strtoull(end + 1, NULL, 16) == devtype))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static guint32 fnv1a(const guchar *p, gsize len)
+{
+	guint32 h = 2166136261u;
+
+	while (len-- > 0) {
+		h ^= *p++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* An archive is the magic, then one entry per print:
+ *   username length (2 bytes), username, driver ID (2), devtype (4),
+ *   finger (1), data length (4), data, FNV-1a of the entry so far (4)
+ * then a zero username length, the number of prints (4), and the
+ * SHA-256 of everything before it (32), integers being little-endian */
+#define ARCHIVE_MAGIC "FPSTORE1"
+#define ARCHIVE_DIGEST_LEN 32
+/* Prints read but not written yet, when importing */
+#define ARCHIVE_IN_FLIGHT 256
+
+struct archive {
+	FILE *file;
+	GChecksum *sum;
+	gboolean failed;
+};
+
+struct archive_entry {
+	char *username;
+	guint16 driver_id;
+	guint32 devtype;
+	guint8 finger;
+	guchar *data;
+	guint32 len;
+	/* Set by read_entry() when the username or finger can't be
+	 * stored, such as a username leading out of the store */
+	gboolean unsafe;
+	/* Set when validated */
+	struct fp_print_data *print;
+};
+
+static void archive_write(struct archive *a, const void *p, gsize len)
+{
+	if (a->failed)
+		return;
+	if (fwrite(p, 1, len, a->file) != len)
+		a->failed = TRUE;
+	g_checksum_update(a->sum, p, len);
+}
+
+static gboolean archive_read(struct archive *a, void *p, gsize len)
+{
+	if (fread(p, 1, len, a->file) != len)
+		return FALSE;
+	g_checksum_update(a->sum, p, len);
+	return TRUE;
+}
+
+static void append_le(GByteArray *array, guint32 v, guint bytes)
+{
+	guint i;
+
+	for (i = 0; i < bytes; i++) {
+		guchar b = (v >> (8 * i)) & 0xff;
+
+		g_byte_array_append(array, &b, 1);
+	}
+}
+
+static guint32 get_le(const guchar *p, guint bytes)
+{
+	guint32 v = 0;
+	guint i;
+
+	for (i = 0; i < bytes; i++)
+		v |= (guint32) p[i] << (8 * i);
+	return v;
+}
+
+static void write_entry(struct archive *a, const char *username, guint16 driver_id,
+	guint32 devtype, guint8 finger, const char *data, gsize len)
+{
+	GByteArray *entry;
+
+	entry = g_byte_array_sized_new(17 + strlen(username) + len);
+	append_le(entry, strlen(username), 2);
+	g_byte_array_append(entry, (guchar *) username, strlen(username));
+	append_le(entry, driver_id, 2);
+	append_le(entry, devtype, 4);
+	append_le(entry, finger, 1);
+	append_le(entry, len, 4);
+	g_byte_array_append(entry, (guchar *) data, len);
+	append_le(entry, fnv1a(entry->data, entry->len), 4);
+
+	archive_write(a, entry->data, entry->len);
+	g_byte_array_free(entry, TRUE);
+}
+
+/* Hex names of the given length only */
+static gboolean parse_hex(const char *name, gsize len, guint32 *value)
+{
+	char *end;
+
+	if (strlen(name) != len)
+		return FALSE;
+	*value = g_ascii_strtoull(name, &end, 16);
+	return *end == '\0';
+}
+
+static guint export_user(struct archive *a, const char *username, const char *dir)
+{
+	GSList *drivers, *devtypes, *l, *m;
+	guint count = 0;
+
+	drivers = list_dirs(dir);
+	for (l = drivers; l != NULL; l = l->next) {
+		char *driver_dir = g_build_filename(dir, l->data, NULL);
+		guint32 driver_id;
+
+		if (!parse_hex(l->data, 4, &driver_id)) {
+			g_free(driver_dir);
+			continue;
+		}
+
+		devtypes = list_dirs(driver_dir);
+		for (m = devtypes; m != NULL; m = m->next) {
+			char *devtype_dir = g_build_filename(driver_dir, m->data, NULL);
+			guint32 devtype, finger;
+			const char *name;
+			GDir *fingers;
+
+			if (!parse_hex(m->data, 8, &devtype) ||
+			    !device_selected(driver_id, devtype) ||
+			    (fingers = g_dir_open(devtype_dir, 0, NULL)) == NULL) {
+				g_free(devtype_dir);
+				continue;
+			}
+
+			while ((name = g_dir_read_name(fingers)) != NULL) {
+				char *path, *contents;
+				gsize length;
+
+				if (!parse_hex(name, 1, &finger) ||
+				    finger < LEFT_THUMB || finger > RIGHT_LITTLE)
+					continue;
+
+				path = g_build_filename(devtype_dir, name, NULL);
+				if (g_file_get_contents(path, &contents, &length, NULL)) {
+					char *decoded;
+					gsize decoded_len;
+					int r;
+
+					r = file_storage_decode(username, dir, driver_id, devtype, finger,
+								contents, length, &decoded, &decoded_len);
+					if (r == 0) {
+						write_entry(a, username, driver_id, devtype, finger,
+							    decoded, decoded_len);
+						memset(decoded, 0, decoded_len);
+						g_free(decoded);
+						count++;
+					} else {
+						g_printerr("%s: could not be decrypted: %s\n", path, g_strerror(-r));
+					}
+					g_free(contents);
+				}
+				g_free(path);
+			}
+			g_dir_close(fingers);
+			g_free(devtype_dir);
+		}
+		free_list(devtypes);
+		g_free(driver_dir);
+	}
+	free_list(drivers);
+
+	return count;
+}
+
+static int export(int argc, char **argv)
+{
+	struct archive a;
+	GHashTable *users;
+	GHashTableIter iter;
+	gpointer key, value;
+	guint count = 0, nusers = 0;
+	guint8 digest[ARCHIVE_DIGEST_LEN];
+	gsize digest_len = sizeof(digest);
+	GByteArray *end;
+	char *tmp = NULL;
+
+	if (!file_store) {
+		g_printerr("Only the file storage can be exported\n");
+		return 1;
+	}
+
+	/* Prints only in fprintd's journal would be left out */
+	if (!wait_for_journal()) {
+		g_printerr("fprintd's journal still holds prints not compacted, try again later\n");
+		return 1;
+	}
+
+	/* Written aside, and renamed once complete */
+	if (argc > 0 && strcmp(argv[0], "-") != 0) {
+		tmp = g_strconcat(argv[0], ".tmp", NULL);
+		a.file = fopen(tmp, "wb");
+		if (a.file == NULL) {
+			g_printerr("Could not create %s: %s\n", tmp, g_strerror(errno));
+			g_free(tmp);
+			return 1;
+		}
+	} else {
+		a.file = stdout;
+	}
+	a.sum = g_checksum_new(G_CHECKSUM_SHA256);
+	a.failed = FALSE;
+
+	archive_write(&a, ARCHIVE_MAGIC, strlen(ARCHIVE_MAGIC));
+	users = list_all_users();
+	g_hash_table_iter_init(&iter, users);
+	while (g_hash_table_iter_next(&iter, &key, &value) && !a.failed) {
+		guint n;
+
+		if (!user_selected(key))
+			continue;
+		n = export_user(&a, key, value);
+		count += n;
+		if (n > 0)
+			nusers++;
+	}
+	g_hash_table_destroy(users);
+
+	end = g_byte_array_new();
+	append_le(end, 0, 2);
+	append_le(end, count, 4);
+	archive_write(&a, end->data, end->len);
+	g_byte_array_free(end, TRUE);
+	g_checksum_get_digest(a.sum, digest, &digest_len);
+	if (!a.failed && fwrite(digest, 1, digest_len, a.file) != digest_len)
+		a.failed = TRUE;
+	g_checksum_free(a.sum);
+
+	if (fflush(a.file) != 0 || (tmp != NULL && fsync(fileno(a.file)) < 0))
+		a.failed = TRUE;
+	if (tmp != NULL) {
+		if (fclose(a.file) != 0)
+			a.failed = TRUE;
+		if (!a.failed && rename(tmp, argv[0]) < 0)
+			a.failed = TRUE;
+		if (a.failed)
+			g_unlink(tmp);
+		g_free(tmp);
+	}
+
+	if (a.failed) {
+		g_printerr("Could not write the archive: %s\n", g_strerror(errno));
+		return 1;
+	}
+	g_printerr("%u prints of %u users exported\n", count, nusers);
+
+	return 0;
+}
+
+/* Passed down the pipeline after the last entry */
+static struct archive_entry end_of_archive;
+
+struct pipeline {
+	GAsyncQueue *to_validate;
+	GAsyncQueue *to_write;
+	GMutex *mutex;
+	GCond *cond;
+	guint in_flight;
+	guint validators;
+
+	/* Valid prints, saved once the whole archive checked out */
+	GSList *staged;
+
+	guint imported;
+	guint invalid;
+	guint failed;
+};
+
+static void entry_free(struct archive_entry *entry)
+{
+	if (entry->print != NULL)
+		fp_print_data_free(entry->print);
+	g_free(entry->username);
+	g_free(entry->data);
+	g_free(entry);
+}
+
+/* Checks the prints can be used, in parallel, libfprint's parsing
+ * being the costly part */
+static gpointer validate_thread(gpointer data)
+{
+	struct pipeline *p = data;
+	struct archive_entry *entry;
+
+	while ((entry = g_async_queue_pop(p->to_validate)) != &end_of_archive) {
+		entry->print = fp_print_data_from_data(entry->data, entry->len);
+		if (entry->print != NULL &&
+		    (fp_print_data_get_driver_id(entry->print) != entry->driver_id ||
+		     fp_print_data_get_devtype(entry->print) != entry->devtype)) {
+			fp_print_data_free(entry->print);
+			entry->print = NULL;
+		}
+		g_async_queue_push(p->to_write, entry);
+	}
+	g_async_queue_push(p->to_write, &end_of_archive);
+
+	return NULL;
+}
+
+static gpointer stage_thread(gpointer data)
+{
+	struct pipeline *p = data;
+	struct archive_entry *entry;
+	guint ended = 0;
+
+	while (ended < p->validators) {
+		entry = g_async_queue_pop(p->to_write);
+		if (entry == &end_of_archive) {
+			ended++;
+			continue;
+		}
+
+		if (entry->print == NULL) {
+			g_printerr("Invalid print for finger %u of %s\n", entry->finger, entry->username);
+			p->invalid++;
+			entry_free(entry);
+		} else if (!verify_only) {
+			g_free(entry->data);
+			entry->data = NULL;
+			p->staged = g_slist_prepend(p->staged, entry);
+		} else {
+			p->imported++;
+			entry_free(entry);
+		}
+
+		g_mutex_lock(p->mutex);
+		p->in_flight--;
+		g_cond_signal(p->cond);
+		g_mutex_unlock(p->mutex);
+	}
+
+	return NULL;
+}
+
+/* Reads the next entry, NULL at the end of the archive, or if it's
+ * damaged, in which case *damaged gets set */
+static struct archive_entry *read_entry(struct archive *a, guint32 *count, gboolean *damaged)
+{
+	struct archive_entry *entry;
+	GByteArray *raw;
+	guchar header[11], len[2], sum[4];
+	guint16 name_len;
+
+	*damaged = TRUE;
+	if (!archive_read(a, len, 2))
+		return NULL;
+	name_len = get_le(len, 2);
+	if (name_len == 0) {
+		guchar n[4];
+
+		if (!archive_read(a, n, 4))
+			return NULL;
+		*count = get_le(n, 4);
+		*damaged = FALSE;
+		return NULL;
+	}
+
+	entry = g_new0(struct archive_entry, 1);
+	entry->username = g_malloc0(name_len + 1);
+	if (!archive_read(a, entry->username, name_len) ||
+	    !archive_read(a, header, sizeof(header))) {
+		entry_free(entry);
+		return NULL;
+	}
+	entry->driver_id = get_le(header, 2);
+	entry->devtype = get_le(header + 2, 4);
+	entry->finger = header[6];
+	entry->len = get_le(header + 7, 4);
+	entry->data = g_try_malloc(entry->len);
+	if (entry->data == NULL || !archive_read(a, entry->data, entry->len) ||
+	    !archive_read(a, sum, 4)) {
+		entry_free(entry);
+		return NULL;
+	}
+
+	raw = g_byte_array_sized_new(2 + name_len + sizeof(header) + entry->len);
+	g_byte_array_append(raw, len, 2);
+	g_byte_array_append(raw, (guchar *) entry->username, name_len);
+	g_byte_array_append(raw, header, sizeof(header));
+	g_byte_array_append(raw, entry->data, entry->len);
+	if (fnv1a(raw->data, raw->len) != get_le(sum, 4) ||
+	    strlen(entry->username) != name_len) {
+		g_byte_array_free(raw, TRUE);
+		entry_free(entry);
+		return NULL;
+	}
+	g_byte_array_free(raw, TRUE);
+
+	/* The archive may come from another machine, and the username
+	 * ends up in a path */
+	if (entry->username[0] == '\0' ||
+	    strcmp(entry->username, ".") == 0 ||
+	    strcmp(entry->username, "..") == 0 ||
+	    strchr(entry->username, '/') != NULL ||
+	    entry->finger < LEFT_THUMB || entry->finger > RIGHT_LITTLE)
+		entry->unsafe = TRUE;
+
+	*damaged = FALSE;
+	return entry;
+}
+
+static int import(int argc, char **argv)
+{
+	struct archive a;
+	struct pipeline p;
+	struct archive_entry *entry;
+	GThread **validators, *stager;
+	GSList *l;
+	char magic[sizeof(ARCHIVE_MAGIC) - 1];
+	guint8 digest[ARCHIVE_DIGEST_LEN], expected[ARCHIVE_DIGEST_LEN];
+	gsize digest_len = sizeof(digest);
+	guint32 count = 0, nread = 0, skipped = 0, unsafe = 0;
+	gboolean damaged = FALSE, complete;
+	guint i;
+	int r;
+
+	if (argc > 0 && strcmp(argv[0], "-") != 0) {
+		a.file = fopen(argv[0], "rb");
+		if (a.file == NULL) {
+			g_printerr("Could not open %s: %s\n", argv[0], g_strerror(errno));
+			return 1;
+		}
+	} else {
+		a.file = stdin;
+	}
+	a.sum = g_checksum_new(G_CHECKSUM_SHA256);
+
+	if (!archive_read(&a, magic, sizeof(magic)) ||
+	    memcmp(magic, ARCHIVE_MAGIC, sizeof(magic)) != 0) {
+		g_printerr("Not a print store archive\n");
+		if (a.file != stdin)
+			fclose(a.file);
+		g_checksum_free(a.sum);
+		return 1;
+	}
+
+	if (!verify_only) {
+		r = store.init();
+		if (r < 0) {
+			g_printerr("Could not initialise the storage: %s\n", g_strerror(-r));
+			return 1;
+		}
+	}
+
+	memset(&p, 0, sizeof(p));
+	p.to_validate = g_async_queue_new();
+	p.to_write = g_async_queue_new();
+	p.mutex = g_mutex_new();
+	p.cond = g_cond_new();
+	p.validators = jobs > 0 ? jobs : MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+
+	validators = g_new0(GThread *, p.validators);
+	for (i = 0; i < p.validators; i++)
+		validators[i] = g_thread_create(validate_thread, &p, TRUE, NULL);
+	stager = g_thread_create(stage_thread, &p, TRUE, NULL);
+
+	while ((entry = read_entry(&a, &count, &damaged)) != NULL) {
+		nread++;
+		if (entry->unsafe) {
+			g_printerr("Invalid username or finger %u of '%s'\n",
+				   entry->finger, entry->username);
+			unsafe++;
+			entry_free(entry);
+			continue;
+		}
+		if (!user_selected(entry->username) ||
+		    !device_selected(entry->driver_id, entry->devtype)) {
+			skipped++;
+			entry_free(entry);
+			continue;
+		}
+
+		g_mutex_lock(p.mutex);
+		while (p.in_flight >= ARCHIVE_IN_FLIGHT)
+			g_cond_wait(p.cond, p.mutex);
+		p.in_flight++;
+		g_mutex_unlock(p.mutex);
+		g_async_queue_push(p.to_validate, entry);
+	}
+
+	for (i = 0; i < p.validators; i++)
+		g_async_queue_push(p.to_validate, &end_of_archive);
+	for (i = 0; i < p.validators; i++)
+		g_thread_join(validators[i]);
+	g_thread_join(stager);
+	g_free(validators);
+	p.invalid += unsafe;
+
+	/* Everything before the digest is covered by it */
+	complete = !damaged && count == nread;
+	g_checksum_get_digest(a.sum, digest, &digest_len);
+	if (complete && (fread(expected, 1, sizeof(expected), a.file) != sizeof(expected) ||
+			 memcmp(digest, expected, sizeof(expected)) != 0))
+		complete = FALSE;
+	g_checksum_free(a.sum);
+	if (a.file != stdin)
+		fclose(a.file);
+
+	p.staged = g_slist_reverse(p.staged);
+	for (l = p.staged; l != NULL; l = l->next) {
+		entry = l->data;
+		if (complete) {
+			r = store.print_data_save(entry->print, entry->finger, entry->username);
+			if (r < 0) {
+				g_printerr("Could not save finger %u of %s: %s\n",
+					   entry->finger, entry->username, g_strerror(-r));
+				p.failed++;
+			} else {
+				p.imported++;
+			}
+		}
+		entry_free(entry);
+	}
+	g_slist_free(p.staged);
+
+	if (!verify_only)
+		store.deinit();
+
+	g_printerr("%u prints %s, %u invalid, %u failed, %u not selected\n",
+		p.imported, verify_only ? "valid" : "imported", p.invalid, p.failed, skipped);
+	if (!complete)
+		g_printerr("The archive is %s, after %u prints%s\n",
+			damaged ? "damaged or truncated" : "inconsistent", nread,
+			verify_only ? "" : ", nothing was imported");
+
+	return complete && p.invalid == 0 && p.failed == 0 ? 0 : 1;
+}
+
+struct device_count {
+	guint prints;
+	guint users;
+};
+
+struct check {
+	GMutex *mutex;
+	/* Prints by username, and by "driver:devtype" */
+	GHashTable *users;
+	GHashTable *devices;
+	/* When the next print may be read, with --rate */
+	guint64 next_read;
+
+	guint prints;
+	guint invalid;
+	guint unexpected;
+	guint empty_dirs;
+	guint tmp_files;
+	guint shadowed;
+	guint rewritten;
+	guint corrupt;
+	guint unauthenticated;
+	guint errors;
+};
+
+static guint64 now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (guint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+/* Spreads the reads of all threads out to --rate per second */
+static void throttle(struct check *c)
+{
+	guint64 now, slot;
+
+	if (check_rate <= 0)
+		return;
+
+	g_mutex_lock(c->mutex);
+	now = now_us();
+	slot = MAX(c->next_read, now);
+	c->next_read = slot + G_USEC_PER_SEC / check_rate;
+	g_mutex_unlock(c->mutex);
+
+	if (slot > now)
+		g_usleep(slot - now);
+}
+
+#define CHECK_COUNT(c, field)			\
+	G_STMT_START {				\
+		g_mutex_lock((c)->mutex);	\
+		(c)->field++;			\
+		g_mutex_unlock((c)->mutex);	\
+	} G_STMT_END
+
+static void check_print(struct check *c, const char *path, const char *username,
+	const char *dir, guint32 driver_id, guint32 devtype, guint32 finger,
+	GHashTable *devices)
+{
+	struct fp_print_data *print;
+	char *stored, *contents, *key;
+	gsize stored_len, length;
+	gboolean current;
+	int r;
+
+	throttle(c);
+	if (!g_file_get_contents(path, &stored, &stored_len, NULL)) {
+		g_printerr("%s: could not be read\n", path);
+		CHECK_COUNT(c, errors);
+		return;
+	}
+
+	current = file_storage_is_current(stored, stored_len);
+	r = file_storage_decode(username, dir, driver_id, devtype, finger,
+				stored, stored_len, &contents, &length);
+	g_free(stored);
+	if (r == -EUCLEAN) {
+		g_printerr("%s: corrupt, its checksum doesn't match\n", path);
+		CHECK_COUNT(c, corrupt);
+		return;
+	} else if (r == -EBADMSG) {
+		g_printerr("%s: failed to authenticate\n", path);
+		CHECK_COUNT(c, unauthenticated);
+		return;
+	} else if (r < 0) {
+		g_printerr("%s: could not be decrypted: %s\n", path, g_strerror(-r));
+		CHECK_COUNT(c, errors);
+		return;
+	}
+
+	print = fp_print_data_from_data((guchar *) contents, length);
+	if (print == NULL ||
+	    fp_print_data_get_driver_id(print) != driver_id ||
+	    fp_print_data_get_devtype(print) != devtype) {
+		g_printerr("%s: %s\n", path, print == NULL ? "invalid print" : "print for another device");
+		CHECK_COUNT(c, invalid);
+		if (print != NULL)
+			fp_print_data_free(print);
+		g_free(contents);
+		return;
+	}
+
+	/* Saved again the way the current libfprint does */
+	if (check_rewrite) {
+		guchar *buf;
+		gsize len;
+
+		len = fp_print_data_get_data(print, &buf);
+		if (len > 0 && (len != length || memcmp(buf, contents, len) != 0 ||
+				!current)) {
+			char *blob;
+			gsize blob_len;
+
+			r = file_storage_encode(username, dir, driver_id, devtype, finger,
+						(char *) buf, len, &blob, &blob_len);
+			if (r == 0) {
+				r = file_journal_write_durably(path, blob, blob_len);
+				g_free(blob);
+			}
+			if (r == 0) {
+				char *dirpath = g_path_get_dirname(path);
+
+				r = file_journal_sync_dir(dirpath);
+				g_free(dirpath);
+			}
+			if (r < 0) {
+				g_printerr("%s: could not be rewritten: %s\n", path, g_strerror(-r));
+				CHECK_COUNT(c, errors);
+			} else {
+				CHECK_COUNT(c, rewritten);
+			}
+		}
+		if (len > 0)
+			free(buf);
+	}
+	fp_print_data_free(print);
+	memset(contents, 0, length);
+	g_free(contents);
+
+	key = g_strdup_printf("%04x:%08x", driver_id, devtype);
+	g_hash_table_insert(devices, key, GUINT_TO_POINTER(
+		GPOINTER_TO_UINT(g_hash_table_lookup(devices, key)) + 1));
+	CHECK_COUNT(c, prints);
+}
+
+/* Removes what's left of interrupted writes */
+static void check_other(struct check *c, const char *path, const char *name)
+{
+	if (g_str_has_suffix(name, ".tmp")) {
+		g_printerr("%s: left over%s\n", path, check_fix ? ", removed" : "");
+		if (check_fix)
+			g_unlink(path);
+		CHECK_COUNT(c, tmp_files);
+	} else {
+		g_printerr("%s: unexpected\n", path);
+		CHECK_COUNT(c, unexpected);
+	}
+}
+
+/* Returns how many entries are left in the directory */
+static guint check_empty(struct check *c, const char *path, guint entries)
+{
+	if (entries > 0)
+		return entries;
+
+	g_printerr("%s: empty directory%s\n", path, check_fix ? ", removed" : "");
+	CHECK_COUNT(c, empty_dirs);
+	if (check_fix && g_rmdir(path) == 0)
+		return 0;
+	return 1;
+}
+
+/* Walks the driver/devtype/finger tree of a user */
+static void check_user(gpointer data, gpointer user_data)
+{
+	char **user = data;
+	struct check *c = user_data;
+	const char *username = user[0], *dir = user[1];
+	GHashTable *devices;
+	GHashTableIter iter;
+	gpointer key, value;
+	GDir *user_dir, *driver_dir, *devtype_dir;
+	const char *name, *name2, *name3;
+	guint user_entries = 0;
+	char *other;
+
+	/* Left behind by an interrupted migration, fprintd won't see it */
+	other = file_storage_get_user_dir(username, TRUE);
+	if (strcmp(other, dir) == 0) {
+		g_free(other);
+		other = file_storage_get_user_dir(username, FALSE);
+	}
+	if (g_file_test(other, G_FILE_TEST_IS_DIR)) {
+		g_printerr("%s: shadowed by %s, see fprintd-store migrate\n", other, dir);
+		CHECK_COUNT(c, shadowed);
+	}
+	g_free(other);
+
+	devices = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	user_dir = g_dir_open(dir, 0, NULL);
+	while (user_dir != NULL && (name = g_dir_read_name(user_dir)) != NULL) {
+		char *driver_path = g_build_filename(dir, name, NULL);
+		guint32 driver_id;
+		guint driver_entries = 0;
+
+		if (g_str_equal(name, PRINT_CRYPT_USER_KEY)) {
+			user_entries++;
+			g_free(driver_path);
+			continue;
+		}
+		if (!parse_hex(name, 4, &driver_id) ||
+		    (driver_dir = g_dir_open(driver_path, 0, NULL)) == NULL) {
+			check_other(c, driver_path, name);
+			user_entries++;
+			g_free(driver_path);
+			continue;
+		}
+
+		while ((name2 = g_dir_read_name(driver_dir)) != NULL) {
+			char *devtype_path = g_build_filename(driver_path, name2, NULL);
+			guint32 devtype, finger;
+			guint devtype_entries = 0;
+
+			if (!parse_hex(name2, 8, &devtype) ||
+			    (devtype_dir = g_dir_open(devtype_path, 0, NULL)) == NULL) {
+				check_other(c, devtype_path, name2);
+				driver_entries++;
+				g_free(devtype_path);
+				continue;
+			}
+
+			while ((name3 = g_dir_read_name(devtype_dir)) != NULL) {
+				char *path = g_build_filename(devtype_path, name3, NULL);
+
+				if (parse_hex(name3, 1, &finger) &&
+				    finger >= LEFT_THUMB && finger <= RIGHT_LITTLE) {
+					if (device_selected(driver_id, devtype))
+						check_print(c, path, username, dir, driver_id,
+							    devtype, finger, devices);
+					devtype_entries++;
+				} else {
+					check_other(c, path, name3);
+					if (!g_str_has_suffix(name3, ".tmp") || !check_fix)
+						devtype_entries++;
+				}
+				g_free(path);
+			}
+			g_dir_close(devtype_dir);
+
+			driver_entries += check_empty(c, devtype_path, devtype_entries);
+			g_free(devtype_path);
+		}
+		g_dir_close(driver_dir);
+
+		user_entries += check_empty(c, driver_path, driver_entries);
+		g_free(driver_path);
+	}
+	if (user_dir != NULL) {
+		g_dir_close(user_dir);
+		check_empty(c, dir, user_entries);
+	}
+
+	g_mutex_lock(c->mutex);
+	g_hash_table_iter_init(&iter, devices);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct device_count *count = g_hash_table_lookup(c->devices, key);
+
+		if (count == NULL) {
+			count = g_new0(struct device_count, 1);
+			g_hash_table_insert(c->devices, g_strdup(key), count);
+		}
+		count->prints += GPOINTER_TO_UINT(value);
+		count->users++;
+		g_hash_table_insert(c->users, g_strdup(username), GUINT_TO_POINTER(
+			GPOINTER_TO_UINT(g_hash_table_lookup(c->users, username)) + GPOINTER_TO_UINT(value)));
+	}
+	g_mutex_unlock(c->mutex);
+
+	g_hash_table_destroy(devices);
+	g_strfreev(user);
+}
+
+static int check(int argc, char **argv)
+{
+	struct check c;
+	GThreadPool *pool;
+	GHashTable *users;
+	GHashTableIter iter;
+	gpointer key, value;
+	GTimer *timer;
+	double elapsed;
+
+	if (!file_store) {
+		g_printerr("Only the file storage can be checked\n");
+		return 1;
+	}
+
+	if (check_rewrite && check_rate > 0) {
+		g_printerr("Rewriting prints needs fprintd stopped, so no --rate\n");
+		return 1;
+	}
+
+	/* fprintd's saves go through .tmp files, in directories it may
+	 * have just created */
+	if (check_fix && check_rate > 0) {
+		g_printerr("Removing left-over files needs fprintd stopped, so no --rate\n");
+		return 1;
+	}
+
+	/* Online, stay out of fprintd's way */
+	if (check_rate > 0) {
+		if (nice(19) < 0)
+			g_printerr("Could not lower the priority: %s\n", g_strerror(errno));
+		if (jobs <= 0)
+			jobs = 1;
+	}
+
+	memset(&c, 0, sizeof(c));
+	c.mutex = g_mutex_new();
+	c.users = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	c.devices = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+	timer = g_timer_new();
+	pool = g_thread_pool_new(check_user, &c,
+				 jobs > 0 ? jobs : MAX(sysconf(_SC_NPROCESSORS_ONLN), 1),
+				 TRUE, NULL);
+	users = list_all_users();
+	g_hash_table_iter_init(&iter, users);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		char **user;
+
+		if (!user_selected(key))
+			continue;
+		user = g_new0(char *, 3);
+		user[0] = g_strdup(key);
+		user[1] = g_strdup(value);
+		g_thread_pool_push(pool, user, NULL);
+	}
+	g_hash_table_destroy(users);
+	g_thread_pool_free(pool, FALSE, TRUE);
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	g_print("\n%-20s %10s %10s\n", "device", "prints", "users");
+	g_hash_table_iter_init(&iter, c.devices);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct device_count *count = value;
+
+		g_print("%-20s %10u %10u\n", (char *) key, count->prints, count->users);
+	}
+
+	if (check_list_users) {
+		g_print("\n%-32s %10s\n", "user", "prints");
+		g_hash_table_iter_init(&iter, c.users);
+		while (g_hash_table_iter_next(&iter, &key, &value))
+			g_print("%-32s %10u\n", (char *) key, GPOINTER_TO_UINT(value));
+	}
+
+	g_print("\n%u users with prints, %u prints checked in %.1f s, %.0f prints/s\n",
+		g_hash_table_size(c.users), c.prints, elapsed,
+		elapsed > 0 ? c.prints / elapsed : 0);
+	g_print("%u invalid, %u corrupt, %u failed to authenticate, %u unreadable, "
+		"%u unexpected files, %u left over files, %u empty directories, "
+		"%u users shadowed",
+		c.invalid, c.corrupt, c.unauthenticated, c.errors, c.unexpected,
+		c.tmp_files, c.empty_dirs, c.shadowed);
+	if (check_rewrite)
+		g_print(", %u rewritten", c.rewritten);
+	g_print("\n");
+
+	g_hash_table_destroy(c.users);
+	g_hash_table_destroy(c.devices);
+
+	return c.invalid == 0 && c.corrupt == 0 && c.unauthenticated == 0 &&
+		c.errors == 0 && c.shadowed == 0 ? 0 : 1;
+}
+
+/* Files read at once by scrub */
+#define SCRUB_READ_DEPTH 64
+
+struct scrub {
+	GPtrArray *paths;
+	guint64 bytes;
+	guint valid;
+	guint corrupt;
+	guint unchecked;
+	guint unreadable;
+};
+
+/* The selected print files of a user */
+static void scrub_collect(GPtrArray *paths, const char *dir)
+{
+	GSList *drivers, *devtypes, *l, *m;
+
+	drivers = list_dirs(dir);
+	for (l = drivers; l != NULL; l = l->next) {
+		char *driver_dir = g_build_filename(dir, l->data, NULL);
+		guint32 driver_id;
+
+		if (!parse_hex(l->data, 4, &driver_id)) {
+			g_free(driver_dir);
+			continue;
+		}
+
+		devtypes = list_dirs(driver_dir);
+		for (m = devtypes; m != NULL; m = m->next) {
+			char *devtype_dir = g_build_filename(driver_dir, m->data, NULL);
+			guint32 devtype, finger;
+			const char *name;
+			GDir *fingers;
+
+			if (!parse_hex(m->data, 8, &devtype) ||
+			    !device_selected(driver_id, devtype) ||
+			    (fingers = g_dir_open(devtype_dir, 0, NULL)) == NULL) {
+				g_free(devtype_dir);
+				continue;
+			}
+
+			while ((name = g_dir_read_name(fingers)) != NULL) {
+				if (parse_hex(name, 1, &finger) &&
+				    finger >= LEFT_THUMB && finger <= RIGHT_LITTLE)
+					g_ptr_array_add(paths, g_build_filename(devtype_dir, name, NULL));
+			}
+			g_dir_close(fingers);
+			g_free(devtype_dir);
+		}
+		free_list(devtypes);
+		g_free(driver_dir);
+	}
+	free_list(drivers);
+}
+
+static void scrub_cb(guint index, const guchar *data, gsize len, int error,
+	gpointer user_data)
+{
+	struct scrub *s = user_data;
+	const char *path = g_ptr_array_index(s->paths, index);
+
+	if (error < 0) {
+		g_printerr("%s: could not be read: %s\n", path, g_strerror(-error));
+		s->unreadable++;
+		return;
+	}
+
+	s->bytes += len;
+	switch (file_storage_verify((const char *) data, len)) {
+	case 0:
+		s->valid++;
+		break;
+	case 1:
+		s->unchecked++;
+		break;
+	default:
+		g_printerr("%s: corrupt, its checksum doesn't match\n", path);
+		s->corrupt++;
+		break;
+	}
+}
+
+static int scrub(int argc, char **argv)
+{
+	struct scrub s;
+	GHashTable *users;
+	GHashTableIter iter;
+	gpointer key, value;
+	GTimer *timer;
+	const char *method;
+	double elapsed;
+
+	if (!file_store) {
+		g_printerr("Only the file storage can be scrubbed\n");
+		return 1;
+	}
+
+	memset(&s, 0, sizeof(s));
+	s.paths = g_ptr_array_new();
+
+	timer = g_timer_new();
+	users = list_all_users();
+	g_hash_table_iter_init(&iter, users);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (user_selected(key))
+			scrub_collect(s.paths, value);
+	}
+	g_hash_table_destroy(users);
+
+	method = bulk_read(s.paths, SCRUB_READ_DEPTH, scrub_cb, &s);
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	g_print("%u prints, %.1f MiB, scrubbed in %.1f s, %.0f prints/s, "
+		"read with %s, checksummed with %s\n",
+		s.paths->len, s.bytes / 1048576.0, elapsed,
+		elapsed > 0 ? s.paths->len / elapsed : 0, method, crc32c_method());
+	g_print("%u valid, %u corrupt, %u without a checksum, %u unreadable\n",
+		s.valid, s.corrupt, s.unchecked, s.unreadable);
+
+	g_ptr_array_foreach(s.paths, (GFunc) g_free, NULL);
+	g_ptr_array_free(s.paths, TRUE);
+
+	return s.corrupt == 0 && s.unreadable == 0 ? 0 : 1;
+}
+
+/* Users with prints for the device, in the file storage */
+static GSList *file_users(guint16 driver_id, guint32 devtype)
+{
+	GHashTable *users;
+	GHashTableIter iter;
+	gpointer key, value;
+	GSList *list = NULL;
+
+	users = list_all_users();
+	g_hash_table_iter_init(&iter, users);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		char *dir = g_strdup_printf("%s/%04x/%08x", (char *) value, driver_id, devtype);
+
+		if (g_file_test(dir, G_FILE_TEST_IS_DIR))
+			list = g_slist_prepend(list, g_strdup(key));
+		g_free(dir);
+	}
+	g_hash_table_destroy(users);
+
+	return list;
+}
+
+static int device_users(int argc, char **argv)
+{
+	guint32 driver_id, devtype;
+	GSList *list, *l;
+	guint count;
+	int i, r;
+
+	if (selected_devices == NULL) {
+		g_printerr("Which devices? Give them with --device\n");
+		return 1;
+	}
+	if (!file_store && store.discover_users == NULL) {
+		g_printerr("The storage can't list the users of a device\n");
+		return 1;
+	}
+
+	r = store.init();
+	if (r < 0) {
+		g_printerr("Could not initialise the storage: %s\n", g_strerror(-r));
+		return 1;
+	}
+
+	r = 0;
+	for (i = 0; selected_devices[i] != NULL; i++) {
+		char *end;
+
+		driver_id = g_ascii_strtoull(selected_devices[i], &end, 16);
+		if (*end != ':' || driver_id > G_MAXUINT16 ||
+		    strlen(end + 1) == 0 || strlen(end + 1) > 8 ||
+		    !parse_hex(end + 1, strlen(end + 1), &devtype)) {
+			g_printerr("%s: give the device as DRIVER:DEVTYPE\n", selected_devices[i]);
+			r = 1;
+			continue;
+		}
+
+		if (file_store)
+			list = file_users(driver_id, devtype);
+		else
+			list = store.discover_users(driver_id, devtype);
+		list = g_slist_sort(list, (GCompareFunc) strcmp);
+		count = 0;
+		for (l = list; l != NULL; l = l->next) {
+			if (!user_selected(l->data))
+				continue;
+			g_print("%04x:%08x %s\n", driver_id, devtype, (char *) l->data);
+			count++;
+		}
+		g_printerr("%04x:%08x: %u users\n", driver_id, devtype, count);
+		free_list(list);
+	}
+
+	store.deinit();
+
+	return r;
+}
+
+static const struct {
+	const char *name;
+	int (*run)(int argc, char **argv);
+	const char *summary;
+} commands[] = {
+	{ "migrate", migrate, "move users to another layout" },
+	{ "export", export, "write prints to an archive" },
+	{ "import", import, "save prints from an archive" },
+	{ "check", check, "validate the prints and tidy the store" },
+	{ "scrub", scrub, "verify the prints' checksums in bulk" },
+	{ "users", device_users, "list the users with prints for --device" },
+	{ NULL }
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+	GString *summary;
+	int i;
+
+	summary = g_string_new("Commands:\n");
+	for (i = 0; commands[i].name != NULL; i++)
+		g_string_append_printf(summary, "  %-10s %s\n", commands[i].name, commands[i].summary);
+
+	context = g_option_context_new("COMMAND [FILE]");
+	g_option_context_set_summary(context, summary->str);
+	g_option_context_add_main_entries(context, entries, NULL);
+	g_string_free(summary, TRUE);
+
+	if (g_option_context_parse(context, &argc, &argv, &err) == FALSE) {
+		g_printerr("couldn't parse command-line options: %s\n", err->message);
+		g_error_free(err);
+		return 1;
+	}
+
+	if (argc < 2 || argc > 3) {
+		g_printerr("Usage: %s COMMAND, see --help\n", argv[0]);
+		return 1;
+	}
+
+	g_thread_init(NULL);
+	if (!load_conf())
+		return 1;
+
+	for (i = 0; commands[i].name != NULL; i++) {
+		if (g_str_equal(argv[1], commands[i].name))
+			return commands[i].run(argc - 2, argv + 2);
+	}
+
+	g_printerr("Unknown command %s\n", argv[1]);
+	return 1;
+}
+
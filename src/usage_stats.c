@@ -0,0 +1,202 @@
+/*
+ * Per-user finger usage statistics for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Drivers supporting identification usually match the gallery in
+ * order, so we remember which fingers each user actually authenticates
+ * with, and put the most used ones first when building a gallery.
+ *
+ * The counts are kept in a key file, with one group per user, and one
+ * "driver-devtype-finger" key per enrolled finger.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libfprint/fprint.h>
+
+#include "usage_stats.h"
+
+#ifndef USAGE_STATS_PATH
+#define USAGE_STATS_PATH "/var/lib/fprint/.usage"
+#endif
+
+/* Counts are halved once one of them reaches that value, so that
+ * the ordering follows changes in habits */
+#define USAGE_STATS_MAX_COUNT 1024
+/* Delay before writing the statistics back to disk, in seconds */
+#define USAGE_STATS_SAVE_DELAY 5
+
+static GKeyFile *usage = NULL;
+static guint save_id = 0;
+static const char *usage_path = USAGE_STATS_PATH;
+
+static char *get_key(struct fp_dscv_dev *ddev, int finger)
+{
+	return g_strdup_printf("%04x-%08x-%x",
+		fp_driver_get_driver_id(fp_dscv_dev_get_driver(ddev)),
+		fp_dscv_dev_get_devtype(ddev), finger);
+}
+
+static gboolean save_cb(gpointer user_data)
+{
+	GError *error = NULL;
+	char *data;
+	gsize len;
+
+	save_id = 0;
+
+	data = g_key_file_to_data(usage, &len, NULL);
+	if (!g_file_set_contents(usage_path, data, len, &error)) {
+		g_warning("Could not save usage statistics: %s", error->message);
+		g_error_free(error);
+	}
+	g_free(data);
+
+	return FALSE;
+}
+
+static void schedule_save(void)
+{
+	if (save_id == 0)
+		save_id = g_timeout_add_seconds(USAGE_STATS_SAVE_DELAY, save_cb, NULL);
+}
+
+/* Writes out the statistics still waiting for the delayed save,
+ * before exiting */
+void usage_stats_flush(void)
+{
+	if (save_id == 0)
+		return;
+	g_source_remove(save_id);
+	save_cb(NULL);
+}
+
+/* Needs to be called before usage_stats_load() */
+void usage_stats_set_path(const char *path)
+{
+	usage_path = g_strdup(path);
+}
+
+void usage_stats_load(void)
+{
+	usage = g_key_file_new();
+
+	/* Missing statistics just mean that nobody authenticated yet */
+	g_key_file_load_from_file(usage, usage_path, G_KEY_FILE_NONE, NULL);
+}
+
+static int get_count(const char *username, struct fp_dscv_dev *ddev, int finger)
+{
+	char *key;
+	int count;
+
+	key = get_key(ddev, finger);
+	count = g_key_file_get_integer(usage, username, key, NULL);
+	g_free(key);
+
+	return count;
+}
+
+void usage_stats_record_match(const char *username,
+	struct fp_dscv_dev *ddev, enum fp_finger finger)
+{
+	char *key;
+	int count;
+
+	if (usage == NULL || username == NULL)
+		return;
+
+	key = get_key(ddev, finger);
+	count = g_key_file_get_integer(usage, username, key, NULL) + 1;
+	g_key_file_set_integer(usage, username, key, count);
+	g_free(key);
+
+	if (count >= USAGE_STATS_MAX_COUNT) {
+		char **keys;
+		guint i;
+
+		keys = g_key_file_get_keys(usage, username, NULL, NULL);
+		for (i = 0; keys != NULL && keys[i] != NULL; i++) {
+			count = g_key_file_get_integer(usage, username, keys[i], NULL);
+			g_key_file_set_integer(usage, username, keys[i], count / 2);
+		}
+		g_strfreev(keys);
+	}
+
+	schedule_save();
+}
+
+struct sort_data {
+	const char *username;
+	struct fp_dscv_dev *ddev;
+};
+
+static gint compare_prints(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	struct sort_data *data = user_data;
+	int count_a, count_b;
+
+	count_a = get_count(data->username, data->ddev, GPOINTER_TO_INT(a));
+	count_b = get_count(data->username, data->ddev, GPOINTER_TO_INT(b));
+
+	return count_b - count_a;
+}
+
+/* Sorts a list of fingers, as returned by store.discover_prints,
+ * most used first */
+GSList *usage_stats_sort_prints(const char *username,
+	struct fp_dscv_dev *ddev, GSList *prints)
+{
+	struct sort_data data;
+
+	if (usage == NULL || username == NULL ||
+	    !g_key_file_has_group(usage, username))
+		return prints;
+
+	data.username = username;
+	data.ddev = ddev;
+
+	return g_slist_sort_with_data(prints, compare_prints, &data);
+}
+
+void usage_stats_forget(const char *username, struct fp_dscv_dev *ddev)
+{
+	char **keys;
+	char *prefix;
+	guint i;
+
+	if (usage == NULL || username == NULL)
+		return;
+
+	keys = g_key_file_get_keys(usage, username, NULL, NULL);
+	if (keys == NULL)
+		return;
+
+	prefix = g_strdup_printf("%04x-%08x-",
+		fp_driver_get_driver_id(fp_dscv_dev_get_driver(ddev)),
+		fp_dscv_dev_get_devtype(ddev));
+	for (i = 0; keys[i] != NULL; i++) {
+		if (g_str_has_prefix(keys[i], prefix))
+			g_key_file_remove_key(usage, username, keys[i], NULL);
+	}
+	g_free(prefix);
+	g_strfreev(keys);
+
+	schedule_save();
+}
+
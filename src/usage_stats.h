@@ -0,0 +1,38 @@
+/*
+ * Per-user finger usage statistics for fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef USAGE_STATS_H
+
+#define USAGE_STATS_H
+
+void usage_stats_set_path(const char *path);
+
+void usage_stats_load(void);
+void usage_stats_flush(void);
+
+void usage_stats_record_match(const char *username,
+	struct fp_dscv_dev *ddev, enum fp_finger finger);
+
+GSList *usage_stats_sort_prints(const char *username,
+	struct fp_dscv_dev *ddev, GSList *prints);
+
+void usage_stats_forget(const char *username, struct fp_dscv_dev *ddev);
+
+#endif
+
@@ -0,0 +1,242 @@
+/*
+ * fprintd Claim/Verify/Release benchmark
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dbus/dbus-glib-bindings.h>
+#include "manager-dbus-glue.h"
+#include "device-dbus-glue.h"
+#include "marshal.h"
+
+enum phase {
+	PHASE_CLAIM = 0,
+	PHASE_VERIFY,
+	PHASE_RELEASE,
+	PHASE_CYCLE,
+	NUM_PHASES
+};
+
+static const char *phase_names[NUM_PHASES] = {
+	"Claim",
+	"Verify",
+	"Release",
+	"cycle"
+};
+
+static DBusGProxy *manager = NULL;
+static DBusGConnection *connection = NULL;
+static int iterations = 100;
+static int warmup = 5;
+static char *finger_name = "any";
+static char *username = "";
+
+/* Latencies of each phase, in milliseconds */
+static GArray *latencies[NUM_PHASES];
+static guint matches = 0;
+static guint failures = 0;
+/* Final status of the verification in progress */
+static const char *last_result = NULL;
+
+static void create_manager(void)
+{
+	GError *error = NULL;
+
+	connection = dbus_g_bus_get(DBUS_BUS_SYSTEM, &error);
+	if (connection == NULL)
+		g_error("Failed to connect to session bus: %s", error->message);
+
+	manager = dbus_g_proxy_new_for_name(connection,
+		"net.reactivated.Fprint", "/net/reactivated/Fprint/Manager",
+		"net.reactivated.Fprint.Manager");
+}
+
+static DBusGProxy *get_device(void)
+{
+	GError *error = NULL;
+	gchar *path;
+	DBusGProxy *dev;
+
+	if (!net_reactivated_Fprint_Manager_get_default_device(manager, &path, &error))
+		g_error("list_devices failed: %s", error->message);
+
+	if (path == NULL) {
+		g_print("No devices found\n");
+		exit(1);
+	}
+
+	g_print("Using device %s\n", path);
+
+	dev = dbus_g_proxy_new_for_name(connection, "net.reactivated.Fprint",
+		path, "net.reactivated.Fprint.Device");
+
+	g_free (path);
+	return dev;
+}
+
+static void verify_result(GObject *object, const char *result, gboolean done, void *user_data)
+{
+	if (done != FALSE)
+		last_result = g_intern_string (result);
+}
+
+static void record(enum phase phase, GTimer *timer, gboolean keep)
+{
+	double ms = g_timer_elapsed (timer, NULL) * 1000;
+
+	if (keep)
+		g_array_append_val (latencies[phase], ms);
+	g_timer_start (timer);
+}
+
+static void do_cycle(DBusGProxy *dev, gboolean keep)
+{
+	GError *error = NULL;
+	GTimer *timer, *cycle;
+
+	timer = g_timer_new ();
+	cycle = g_timer_new ();
+
+	if (!net_reactivated_Fprint_Device_claim(dev, username, &error))
+		g_error("failed to claim device: %s", error->message);
+	record (PHASE_CLAIM, timer, keep);
+
+	if (!net_reactivated_Fprint_Device_verify_start(dev, finger_name, &error))
+		g_error("VerifyStart failed: %s", error->message);
+	last_result = NULL;
+	while (last_result == NULL)
+		g_main_context_iteration(NULL, TRUE);
+	if (!net_reactivated_Fprint_Device_verify_stop(dev, &error))
+		g_error("VerifyStop failed: %s", error->message);
+	record (PHASE_VERIFY, timer, keep);
+
+	if (!net_reactivated_Fprint_Device_release(dev, &error))
+		g_error("ReleaseDevice failed: %s", error->message);
+	record (PHASE_RELEASE, timer, keep);
+	record (PHASE_CYCLE, cycle, keep);
+
+	if (keep) {
+		if (g_str_equal (last_result, "verify-match"))
+			matches++;
+		else if (!g_str_equal (last_result, "verify-no-match"))
+			failures++;
+	}
+
+	g_timer_destroy (timer);
+	g_timer_destroy (cycle);
+}
+
+static gint compare_double(gconstpointer a, gconstpointer b)
+{
+	double da = *(const double *) a, db = *(const double *) b;
+
+	if (da < db)
+		return -1;
+	return da > db;
+}
+
+static double percentile(GArray *array, guint p)
+{
+	guint i;
+
+	i = (array->len * p + 99) / 100;
+	if (i > 0)
+		i--;
+	return g_array_index (array, double, i);
+}
+
+static void report(double elapsed)
+{
+	guint i;
+
+	g_print("%d cycles in %.2fs, %.1f cycles/s, %u matches, %u failures\n",
+		iterations, elapsed, iterations / elapsed, matches, failures);
+	g_print("%-8s %10s %10s %10s %10s\n", "", "p50 (ms)", "p99 (ms)", "max (ms)", "mean (ms)");
+	for (i = 0; i < NUM_PHASES; i++) {
+		GArray *array = latencies[i];
+		double sum = 0;
+		guint j;
+
+		g_array_sort (array, compare_double);
+		for (j = 0; j < array->len; j++)
+			sum += g_array_index (array, double, j);
+		g_print("%-8s %10.2f %10.2f %10.2f %10.2f\n", phase_names[i],
+			percentile (array, 50), percentile (array, 99),
+			g_array_index (array, double, array->len - 1),
+			sum / array->len);
+	}
+}
+
+static const GOptionEntry entries[] = {
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Claim/Verify/Release cycles to measure (default 100)", NULL },
+	{ "warmup", 'w', 0, G_OPTION_ARG_INT, &warmup, "Cycles to run before measuring (default 5)", NULL },
+	{ "finger", 'f', 0, G_OPTION_ARG_STRING, &finger_name, "Finger selected to verify (default is automatic)", NULL },
+	{ "username", 'u', 0, G_OPTION_ARG_STRING, &username, "User to verify (default is the current user)", NULL },
+	{ NULL }
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+	DBusGProxy *dev;
+	GTimer *timer;
+	int i;
+
+	g_type_init();
+
+	dbus_g_object_register_marshaller (fprintd_marshal_VOID__STRING_BOOLEAN,
+					   G_TYPE_NONE, G_TYPE_STRING, G_TYPE_BOOLEAN, G_TYPE_INVALID);
+
+	context = g_option_context_new ("Benchmark Claim/Verify/Release cycles");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (g_option_context_parse (context, &argc, &argv, &err) == FALSE) {
+		g_print ("couldn't parse command-line options: %s\n", err->message);
+		g_error_free (err);
+		return 1;
+	}
+
+	if (iterations <= 0 || warmup < 0) {
+		g_print ("Invalid options\n");
+		return 1;
+	}
+
+	for (i = 0; i < NUM_PHASES; i++)
+		latencies[i] = g_array_sized_new (FALSE, FALSE, sizeof (double), iterations);
+
+	create_manager();
+	dev = get_device();
+
+	dbus_g_proxy_add_signal(dev, "VerifyStatus", G_TYPE_STRING, G_TYPE_BOOLEAN, NULL);
+	dbus_g_proxy_connect_signal(dev, "VerifyStatus", G_CALLBACK(verify_result),
+				    NULL, NULL);
+
+	for (i = 0; i < warmup; i++)
+		do_cycle (dev, FALSE);
+
+	timer = g_timer_new ();
+	for (i = 0; i < iterations; i++)
+		do_cycle (dev, TRUE);
+	report (g_timer_elapsed (timer, NULL));
+
+	return failures == 0 ? 0 : 1;
+}
+
@@ -0,0 +1,30 @@
+#!/bin/sh
+#
+# Verifies against a stored print whose checksum doesn't match, which
+# has to fail with PrintCorrupt rather than an internal error. Run
+# from virtual-bench.sh, see the corrupt-print target.
+#
+# Usage: corrupt-print.sh
+
+PRINT="$FPRINTD_BENCH_DIR/prints/fprintd-bench-0/00ff/00000000/7"
+DEVICE=/net/reactivated/Fprint/Device/0
+
+# A checksummed print of 8 bytes, "virtual\n", with a checksum of 0
+printf 'FPS1\000\000\000\000\010\000\000\000virtual\n' > "$PRINT" || exit 1
+
+dbus-send --system --print-reply --dest=net.reactivated.Fprint $DEVICE \
+	net.reactivated.Fprint.Device.Claim string:fprintd-bench-0 > /dev/null || exit 1
+
+ERROR=`dbus-send --system --print-reply --dest=net.reactivated.Fprint $DEVICE \
+	net.reactivated.Fprint.Device.VerifyStart string:right-index-finger 2>&1`
+
+dbus-send --system --print-reply --dest=net.reactivated.Fprint $DEVICE \
+	net.reactivated.Fprint.Device.Release > /dev/null || exit 1
+
+case "$ERROR" in
+	*net.reactivated.Fprint.Error.PrintCorrupt*)
+		echo "Verification against a corrupt print failed with PrintCorrupt" ;;
+	*)
+		echo "Verification against a corrupt print got: $ERROR" >&2
+		exit 1 ;;
+esac
@@ -0,0 +1,155 @@
+/*
+ * Stand-in for the login session service, to test fprintd's pre-warming
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Owns a bus name, creates a single session for the given user, and sends
+ * the same SessionNew and Lock signals logind would. Point fprintd at it
+ * with "service=" in the [prewarm] section of fprintd.conf. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <dbus/dbus-glib-bindings.h>
+#include <dbus/dbus-glib-lowlevel.h>
+
+#define SESSION_ID "1"
+#define SESSION_PATH "/org/freedesktop/login1/session/_31"
+#define MANAGER_PATH "/org/freedesktop/login1"
+
+static char *service_name = "net.reactivated.Fprint.Test.Login";
+static gboolean lock = FALSE;
+static int linger = 5;
+static char **usernames = NULL;
+
+static DBusHandlerResult session_message(DBusConnection *conn,
+	DBusMessage *message, void *user_data)
+{
+	const char *username = user_data;
+	const char *interface, *property;
+	DBusMessage *reply;
+	DBusMessageIter iter, variant;
+
+	if (!dbus_message_is_method_call(message, "org.freedesktop.DBus.Properties", "Get"))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (!dbus_message_get_args(message, NULL,
+				   DBUS_TYPE_STRING, &interface,
+				   DBUS_TYPE_STRING, &property,
+				   DBUS_TYPE_INVALID) ||
+	    !g_str_equal(property, "Name")) {
+		reply = dbus_message_new_error(message,
+			"org.freedesktop.DBus.Error.InvalidArgs", "Only Name is supported");
+	} else {
+		reply = dbus_message_new_method_return(message);
+		dbus_message_iter_init_append(reply, &iter);
+		dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT, "s", &variant);
+		dbus_message_iter_append_basic(&variant, DBUS_TYPE_STRING, &username);
+		dbus_message_iter_close_container(&iter, &variant);
+	}
+
+	dbus_connection_send(conn, reply, NULL);
+	dbus_message_unref(reply);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static const DBusObjectPathVTable session_vtable = {
+	.message_function = session_message,
+};
+
+static void send_signal(DBusConnection *conn, const char *path,
+	const char *interface, const char *member, gboolean with_args)
+{
+	DBusMessage *signal;
+
+	signal = dbus_message_new_signal(path, interface, member);
+	if (with_args) {
+		const char *id = SESSION_ID;
+		const char *session_path = SESSION_PATH;
+
+		dbus_message_append_args(signal,
+					 DBUS_TYPE_STRING, &id,
+					 DBUS_TYPE_OBJECT_PATH, &session_path,
+					 DBUS_TYPE_INVALID);
+	}
+	dbus_connection_send(conn, signal, NULL);
+	dbus_message_unref(signal);
+	g_print("Sent %s.%s\n", interface, member);
+}
+
+static gboolean quit_cb(gpointer user_data)
+{
+	g_main_loop_quit(user_data);
+	return FALSE;
+}
+
+static const GOptionEntry entries[] = {
+	{ "name", 'n', 0, G_OPTION_ARG_STRING, &service_name, "Bus name to own", NULL },
+	{ "lock", 'l', 0, G_OPTION_ARG_NONE, &lock, "Also lock the session", NULL },
+	{ "linger", 0, 0, G_OPTION_ARG_INT, &linger, "Seconds to keep answering fprintd's requests", NULL },
+	{ G_OPTION_REMAINING, '\0', 0, G_OPTION_ARG_STRING_ARRAY, &usernames, NULL, "username" },
+	{ NULL }
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GMainLoop *loop;
+	GError *err = NULL;
+	DBusConnection *conn;
+	DBusError error;
+
+	g_type_init();
+
+	context = g_option_context_new ("Emit login session signals for fprintd");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (g_option_context_parse (context, &argc, &argv, &err) == FALSE) {
+		g_print ("couldn't parse command-line options: %s\n", err->message);
+		g_error_free (err);
+		return 1;
+	}
+
+	if (usernames == NULL) {
+		g_print ("Usage: %s [--lock] <username>\n", argv[0]);
+		return 1;
+	}
+
+	dbus_error_init(&error);
+	conn = dbus_bus_get(DBUS_BUS_SYSTEM, &error);
+	if (conn == NULL)
+		g_error("Failed to connect to system bus: %s", error.message);
+
+	if (dbus_bus_request_name(conn, service_name, 0, &error) != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER)
+		g_error("Failed to own %s: %s", service_name,
+			dbus_error_is_set(&error) ? error.message : "already owned");
+
+	loop = g_main_loop_new(NULL, FALSE);
+	dbus_connection_setup_with_g_main(conn, NULL);
+	dbus_connection_register_object_path(conn, SESSION_PATH,
+		&session_vtable, usernames[0]);
+
+	send_signal(conn, MANAGER_PATH, "org.freedesktop.login1.Manager", "SessionNew", TRUE);
+	if (lock)
+		send_signal(conn, SESSION_PATH, "org.freedesktop.login1.Session", "Lock", FALSE);
+
+	g_timeout_add_seconds(linger, quit_cb, loop);
+	g_main_loop_run(loop);
+
+	return 0;
+}
+
@@ -0,0 +1,258 @@
+/*
+ * fprintd example measuring continuous identification throughput
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dbus/dbus-glib-bindings.h>
+#include "manager-dbus-glue.h"
+#include "device-dbus-glue.h"
+#include "marshal.h"
+
+static DBusGProxy *manager = NULL;
+static DBusGConnection *connection = NULL;
+static int duration = 60;
+static int report_interval = 10;
+static int max_unacked = 1;
+static int ack_delay = 0;
+static char **usernames = NULL;
+
+static struct {
+	GTimer *timer;
+	guint matches;
+	guint no_matches;
+	guint retries;
+	guint last_serial;
+	guint acked;
+	gboolean failed;
+	gboolean finished;
+	/* identifications at the last report */
+	guint reported;
+	double reported_at;
+} stats;
+
+static void create_manager(void)
+{
+	GError *error = NULL;
+
+	connection = dbus_g_bus_get(DBUS_BUS_SYSTEM, &error);
+	if (connection == NULL)
+		g_error("Failed to connect to session bus: %s", error->message);
+
+	manager = dbus_g_proxy_new_for_name(connection,
+		"net.reactivated.Fprint", "/net/reactivated/Fprint/Manager",
+		"net.reactivated.Fprint.Manager");
+}
+
+static DBusGProxy *open_device(void)
+{
+	GError *error = NULL;
+	gchar *path;
+	DBusGProxy *dev;
+
+	if (!net_reactivated_Fprint_Manager_get_default_device(manager, &path, &error))
+		g_error("list_devices failed: %s", error->message);
+	
+	if (path == NULL) {
+		g_print("No devices found\n");
+		exit(1);
+	}
+
+	g_print("Using device %s\n", path);
+
+	dev = dbus_g_proxy_new_for_name(connection, "net.reactivated.Fprint",
+		path, "net.reactivated.Fprint.Device");
+	
+	g_free (path);
+
+	if (!net_reactivated_Fprint_Device_claim(dev, "", &error))
+		g_error("failed to claim device: %s", error->message);
+
+	return dev;
+}
+
+static gboolean ack_cb(gpointer user_data)
+{
+	DBusGProxy *dev = user_data;
+	GError *error = NULL;
+
+	if (stats.acked == stats.last_serial)
+		return FALSE;
+
+	/* Acknowledges everything received so far */
+	if (!net_reactivated_Fprint_Device_identify_ack(dev, stats.last_serial, &error)) {
+		g_print("IdentifyAck failed: %s\n", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+	stats.acked = stats.last_serial;
+
+	return FALSE;
+}
+
+static void identify_result(GObject *object, const char *result,
+			    const char *username, const char *finger_name,
+			    guint serial, void *user_data)
+{
+	DBusGProxy *dev = user_data;
+
+	if (serial == 0) {
+		if (g_str_equal (result, "verify-disconnected") ||
+		    g_str_equal (result, "verify-unknown-error")) {
+			g_print("Identification failed: %s\n", result);
+			stats.failed = TRUE;
+		} else {
+			stats.retries++;
+		}
+		return;
+	}
+
+	if (g_str_equal (result, "verify-match"))
+		stats.matches++;
+	else
+		stats.no_matches++;
+
+	if (serial != stats.last_serial + 1)
+		g_print("Missed %d results before serial %u\n",
+			serial - stats.last_serial - 1, serial);
+	stats.last_serial = serial;
+
+	if (ack_delay == 0)
+		ack_cb (dev);
+	else
+		g_timeout_add (ack_delay, ack_cb, dev);
+}
+
+static void report(void)
+{
+	double now = g_timer_elapsed (stats.timer, NULL);
+	guint total = stats.matches + stats.no_matches;
+
+	if (now > stats.reported_at)
+		g_print("%.0fs: %u identifications (%u matches, %u no-matches, %u retries), "
+			"%.1f/min overall, %.1f/min last interval\n",
+			now, total, stats.matches, stats.no_matches, stats.retries,
+			total * 60 / now,
+			(total - stats.reported) * 60 / (now - stats.reported_at));
+	stats.reported = total;
+	stats.reported_at = now;
+}
+
+static gboolean report_cb(gpointer user_data)
+{
+	report ();
+	return TRUE;
+}
+
+static gboolean done_cb(gpointer user_data)
+{
+	stats.finished = TRUE;
+	return FALSE;
+}
+
+static void do_identify(DBusGProxy *dev)
+{
+	GError *error = NULL;
+	GHashTable *options;
+	GValue value = { 0, };
+	const char *none[] = { NULL };
+
+	dbus_g_proxy_add_signal(dev, "IdentifyResult", G_TYPE_STRING, G_TYPE_STRING,
+				G_TYPE_STRING, G_TYPE_UINT, NULL);
+	dbus_g_proxy_connect_signal(dev, "IdentifyResult", G_CALLBACK(identify_result),
+				    dev, NULL);
+
+	options = g_hash_table_new (g_str_hash, g_str_equal);
+	g_value_init (&value, G_TYPE_UINT);
+	g_value_set_uint (&value, max_unacked);
+	g_hash_table_insert (options, "max-unacked", &value);
+
+	if (!net_reactivated_Fprint_Device_identify_start(dev,
+			usernames ? (const char **) usernames : none, options, &error))
+		g_error("IdentifyStart failed: %s", error->message);
+	g_hash_table_destroy (options);
+
+	stats.timer = g_timer_new ();
+	g_timeout_add_seconds (report_interval, report_cb, NULL);
+	g_timeout_add_seconds (duration, done_cb, NULL);
+
+	while (stats.finished == FALSE && stats.failed == FALSE)
+		g_main_context_iteration (NULL, TRUE);
+
+	report ();
+	g_print("%.1f identifications per minute over %.0fs\n",
+		(stats.matches + stats.no_matches) * 60 / g_timer_elapsed (stats.timer, NULL),
+		g_timer_elapsed (stats.timer, NULL));
+
+	dbus_g_proxy_disconnect_signal(dev, "IdentifyResult", G_CALLBACK(identify_result), dev);
+
+	if (!net_reactivated_Fprint_Device_identify_stop(dev, &error))
+		g_error("IdentifyStop failed: %s", error->message);
+}
+
+static void release_device(DBusGProxy *dev)
+{
+	GError *error = NULL;
+	if (!net_reactivated_Fprint_Device_release(dev, &error))
+		g_error("ReleaseDevice failed: %s", error->message);
+}
+
+static const GOptionEntry entries[] = {
+	{ "duration", 'd', 0, G_OPTION_ARG_INT, &duration, "Seconds to run for (default 60)", NULL },
+	{ "interval", 'i', 0, G_OPTION_ARG_INT, &report_interval, "Seconds between reports (default 10)", NULL },
+	{ "max-unacked", 'u', 0, G_OPTION_ARG_INT, &max_unacked, "Results the daemon may send ahead of our acks (default 1)", NULL },
+	{ "ack-delay", 'a', 0, G_OPTION_ARG_INT, &ack_delay, "Milliseconds to wait before acking, to simulate a slow client", NULL },
+	{ G_OPTION_REMAINING, '\0', 0, G_OPTION_ARG_STRING_ARRAY, &usernames, NULL, "[username...]" },
+	{ NULL }
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+	DBusGProxy *dev;
+
+	g_type_init();
+
+	dbus_g_object_register_marshaller (fprintd_marshal_VOID__STRING_STRING_STRING_UINT,
+					   G_TYPE_NONE, G_TYPE_STRING, G_TYPE_STRING,
+					   G_TYPE_STRING, G_TYPE_UINT, G_TYPE_INVALID);
+
+	context = g_option_context_new ("Measure continuous identification throughput");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (g_option_context_parse (context, &argc, &argv, &err) == FALSE) {
+		g_print ("couldn't parse command-line options: %s\n", err->message);
+		g_error_free (err);
+		return 1;
+	}
+
+	if (duration <= 0 || report_interval <= 0 || max_unacked <= 0 || ack_delay < 0) {
+		g_print ("Invalid options\n");
+		return 1;
+	}
+
+	create_manager();
+
+	dev = open_device();
+	do_identify(dev);
+	release_device(dev);
+	return 0;
+}
+
@@ -0,0 +1,620 @@
+/*
+ * fprintd concurrent load generator
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Runs a mix of operations against fprintd from many bus connections
+ * at once, each operation type being started at a fixed rate whether
+ * or not the daemon keeps up, and reports latency percentiles and
+ * errors for each D-Bus method.
+ *
+ * Operations are:
+ * list    ListEnrolledFingers
+ * verify  Claim, VerifyStart, waiting for the result, VerifyStop, Release
+ * enroll  Claim, EnrollStart, waiting for the result, EnrollStop, Release
+ * delete  DeleteEnrolledFingers
+ *
+ * Each client connection works on one reader, picked in turn, and
+ * one operation at a time, for a random user.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dbus/dbus-glib-bindings.h>
+#include "manager-dbus-glue.h"
+#include "device-dbus-glue.h"
+#include "marshal.h"
+
+enum op {
+	OP_LIST = 0,
+	OP_VERIFY,
+	OP_ENROLL,
+	OP_DELETE,
+	NUM_OPS
+};
+
+static const char *op_names[NUM_OPS] = {
+	"list",
+	"verify",
+	"enroll",
+	"delete"
+};
+
+enum step {
+	STEP_DONE = 0,
+	STEP_LIST,
+	STEP_DELETE,
+	STEP_CLAIM,
+	STEP_VERIFY_START,
+	STEP_VERIFY_WAIT,
+	STEP_VERIFY_STOP,
+	STEP_ENROLL_START,
+	STEP_ENROLL_WAIT,
+	STEP_ENROLL_STOP,
+	STEP_RELEASE,
+	NUM_STEPS
+};
+
+/* D-Bus method called for each step, or signal waited for */
+static const char *step_methods[NUM_STEPS] = {
+	NULL,
+	"ListEnrolledFingers",
+	"DeleteEnrolledFingers",
+	"Claim",
+	"VerifyStart",
+	"VerifyStatus",
+	"VerifyStop",
+	"EnrollStart",
+	"EnrollStatus",
+	"EnrollStop",
+	"Release"
+};
+
+static const enum step op_steps[NUM_OPS][6] = {
+	{ STEP_LIST, STEP_DONE },
+	{ STEP_CLAIM, STEP_VERIFY_START, STEP_VERIFY_WAIT, STEP_VERIFY_STOP, STEP_RELEASE, STEP_DONE },
+	{ STEP_CLAIM, STEP_ENROLL_START, STEP_ENROLL_WAIT, STEP_ENROLL_STOP, STEP_RELEASE, STEP_DONE },
+	{ STEP_DELETE, STEP_DONE }
+};
+
+struct timings {
+	/* in milliseconds */
+	GArray *latencies;
+	guint calls;
+	/* Error or result names, and how often they happened */
+	GHashTable *outcomes;
+};
+
+struct client {
+	guint index;
+	DBusGConnection *connection;
+	DBusGProxy *dev;
+
+	/* The operation in progress, if busy */
+	gboolean busy;
+	enum op op;
+	guint step;
+	const char *username;
+	gboolean claimed;
+	gboolean failed;
+	DBusGProxyCall *call;
+	GTimer *op_timer;
+	GTimer *step_timer;
+	guint timeout_id;
+};
+
+static int num_clients = 8;
+static int duration = 30;
+static int op_timeout = 30;
+static char **rates = NULL;
+static char *user_prefix = "fprintd-bench-";
+static int num_users = 1;
+static char *finger_name = "right-index-finger";
+static char **usernames = NULL;
+
+static double op_rates[NUM_OPS];
+static guint op_started[NUM_OPS];
+static guint op_skipped[NUM_OPS];
+static struct timings op_timings[NUM_OPS];
+static struct timings step_timings[NUM_STEPS];
+
+static struct client *clients = NULL;
+static GTimer *run_timer = NULL;
+static gboolean running = TRUE;
+static guint in_flight = 0;
+
+static void advance(struct client *c);
+
+static void timings_init(struct timings *t)
+{
+	t->latencies = g_array_new (FALSE, FALSE, sizeof (double));
+	t->outcomes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+}
+
+static void timings_add(struct timings *t, double ms, const char *outcome)
+{
+	guint count;
+
+	t->calls++;
+	g_array_append_val (t->latencies, ms);
+	if (outcome == NULL)
+		return;
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (t->outcomes, outcome));
+	g_hash_table_insert (t->outcomes, g_strdup (outcome), GUINT_TO_POINTER (count + 1));
+}
+
+static const char *error_name(GError *error)
+{
+	if (error->domain == DBUS_GERROR && error->code == DBUS_GERROR_REMOTE_EXCEPTION)
+		return dbus_g_error_get_name (error);
+	return error->message;
+}
+
+static char **get_devices(void)
+{
+	DBusGConnection *connection;
+	DBusGProxy *manager;
+	GError *error = NULL;
+	GPtrArray *devices;
+	char **paths;
+	guint i;
+
+	connection = dbus_g_bus_get(DBUS_BUS_SYSTEM, &error);
+	if (connection == NULL)
+		g_error("Failed to connect to session bus: %s", error->message);
+
+	manager = dbus_g_proxy_new_for_name(connection,
+		"net.reactivated.Fprint", "/net/reactivated/Fprint/Manager",
+		"net.reactivated.Fprint.Manager");
+
+	if (!net_reactivated_Fprint_Manager_get_devices(manager, &devices, &error))
+		g_error("list_devices failed: %s", error->message);
+
+	if (devices->len == 0) {
+		g_print("No devices found\n");
+		exit(1);
+	}
+
+	paths = g_new0 (char *, devices->len + 1);
+	for (i = 0; i < devices->len; i++)
+		paths[i] = g_ptr_array_index (devices, i);
+	g_ptr_array_free (devices, FALSE);
+	g_object_unref (manager);
+
+	return paths;
+}
+
+/* Outcome of the whole operation */
+static void op_done(struct client *c, const char *outcome)
+{
+	timings_add (&op_timings[c->op], g_timer_elapsed (c->op_timer, NULL) * 1000, outcome);
+	if (c->timeout_id != 0) {
+		g_source_remove (c->timeout_id);
+		c->timeout_id = 0;
+	}
+	c->busy = FALSE;
+	in_flight--;
+}
+
+static enum step current_step(struct client *c)
+{
+	return op_steps[c->op][c->step];
+}
+
+/* Skips to releasing the device if claimed, or finishes */
+static void fail(struct client *c, const char *outcome)
+{
+	if (!c->failed) {
+		c->failed = TRUE;
+		timings_add (&op_timings[c->op], g_timer_elapsed (c->op_timer, NULL) * 1000, outcome);
+	}
+
+	if (c->claimed && current_step (c) != STEP_RELEASE) {
+		while (current_step (c) != STEP_RELEASE)
+			c->step++;
+		advance (c);
+		return;
+	}
+
+	if (c->timeout_id != 0) {
+		g_source_remove (c->timeout_id);
+		c->timeout_id = 0;
+	}
+	c->busy = FALSE;
+	in_flight--;
+}
+
+static void step_done(struct client *c, GError *error)
+{
+	enum step step = current_step (c);
+	double ms = g_timer_elapsed (c->step_timer, NULL) * 1000;
+
+	c->call = NULL;
+	timings_add (&step_timings[step], ms, error ? error_name (error) : "ok");
+
+	if (error != NULL) {
+		char *outcome = g_strdup_printf ("%s: %s", step_methods[step], error_name (error));
+
+		if (step == STEP_RELEASE)
+			c->claimed = FALSE;
+		fail (c, outcome);
+		g_free (outcome);
+		g_error_free (error);
+		return;
+	}
+
+	if (step == STEP_CLAIM)
+		c->claimed = TRUE;
+	else if (step == STEP_RELEASE)
+		c->claimed = FALSE;
+
+	c->step++;
+	advance (c);
+}
+
+static void call_cb(DBusGProxy *proxy, DBusGProxyCall *call, gpointer user_data)
+{
+	struct client *c = user_data;
+	GError *error = NULL;
+
+	if (current_step (c) == STEP_LIST) {
+		char **fingers = NULL;
+
+		if (dbus_g_proxy_end_call (proxy, call, &error,
+					   G_TYPE_STRV, &fingers, G_TYPE_INVALID))
+			g_strfreev (fingers);
+	} else {
+		dbus_g_proxy_end_call (proxy, call, &error, G_TYPE_INVALID);
+	}
+
+	step_done (c, error);
+}
+
+static void status_cb(GObject *object, const char *result, gboolean done, void *user_data)
+{
+	struct client *c = user_data;
+	enum step step;
+
+	if (!c->busy || done == FALSE)
+		return;
+
+	step = current_step (c);
+	if (step != STEP_VERIFY_WAIT && step != STEP_ENROLL_WAIT)
+		return;
+
+	timings_add (&step_timings[step], g_timer_elapsed (c->step_timer, NULL) * 1000, result);
+	c->step++;
+	advance (c);
+}
+
+static gboolean timeout_cb(gpointer user_data)
+{
+	struct client *c = user_data;
+	enum step step = current_step (c);
+
+	c->timeout_id = 0;
+	if (c->call != NULL) {
+		dbus_g_proxy_cancel_call (c->dev, c->call);
+		c->call = NULL;
+	}
+	timings_add (&step_timings[step], g_timer_elapsed (c->step_timer, NULL) * 1000, "timeout");
+
+	/* Results can still be stopped */
+	if (step == STEP_VERIFY_WAIT || step == STEP_ENROLL_WAIT) {
+		c->failed = TRUE;
+		timings_add (&op_timings[c->op], g_timer_elapsed (c->op_timer, NULL) * 1000, "timeout");
+		c->step++;
+		advance (c);
+	} else {
+		/* The Claim can still go through, leaving the device claimed
+		 * by this connection for good, so it gets released, with as
+		 * long again to answer */
+		if (step == STEP_CLAIM) {
+			c->claimed = TRUE;
+			c->timeout_id = g_timeout_add_seconds (op_timeout, timeout_cb, c);
+		}
+		fail (c, "timeout");
+	}
+
+	return FALSE;
+}
+
+static void advance(struct client *c)
+{
+	enum step step = current_step (c);
+
+	g_timer_start (c->step_timer);
+
+	switch (step) {
+	case STEP_DONE:
+		if (!c->failed)
+			op_done (c, "ok");
+		else
+			fail (c, NULL);
+		return;
+	case STEP_VERIFY_WAIT:
+	case STEP_ENROLL_WAIT:
+		return;
+	case STEP_LIST:
+		c->call = dbus_g_proxy_begin_call (c->dev, "ListEnrolledFingers", call_cb, c, NULL,
+						   G_TYPE_STRING, c->username, G_TYPE_INVALID);
+		break;
+	case STEP_DELETE:
+		c->call = dbus_g_proxy_begin_call (c->dev, "DeleteEnrolledFingers", call_cb, c, NULL,
+						   G_TYPE_STRING, c->username, G_TYPE_INVALID);
+		break;
+	case STEP_CLAIM:
+		c->call = dbus_g_proxy_begin_call (c->dev, "Claim", call_cb, c, NULL,
+						   G_TYPE_STRING, c->username, G_TYPE_INVALID);
+		break;
+	case STEP_VERIFY_START:
+		c->call = dbus_g_proxy_begin_call (c->dev, "VerifyStart", call_cb, c, NULL,
+						   G_TYPE_STRING, "any", G_TYPE_INVALID);
+		break;
+	case STEP_ENROLL_START:
+		c->call = dbus_g_proxy_begin_call (c->dev, "EnrollStart", call_cb, c, NULL,
+						   G_TYPE_STRING, finger_name, G_TYPE_INVALID);
+		break;
+	case STEP_VERIFY_STOP:
+	case STEP_ENROLL_STOP:
+	case STEP_RELEASE:
+		c->call = dbus_g_proxy_begin_call (c->dev, step_methods[step], call_cb, c, NULL,
+						   G_TYPE_INVALID);
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+static void start_op(struct client *c, enum op op)
+{
+	c->busy = TRUE;
+	c->op = op;
+	c->step = 0;
+	c->claimed = FALSE;
+	c->failed = FALSE;
+	c->username = usernames[g_random_int_range (0, g_strv_length (usernames))];
+	g_timer_start (c->op_timer);
+	c->timeout_id = g_timeout_add_seconds (op_timeout, timeout_cb, c);
+	in_flight++;
+
+	advance (c);
+}
+
+static struct client *idle_client(void)
+{
+	static guint next = 0;
+	guint i;
+
+	for (i = 0; i < (guint) num_clients; i++) {
+		struct client *c = &clients[(next + i) % num_clients];
+
+		if (!c->busy) {
+			next = c->index + 1;
+			return c;
+		}
+	}
+
+	return NULL;
+}
+
+/* Starts whatever is due to keep up with the rates */
+static gboolean schedule_cb(gpointer user_data)
+{
+	double elapsed = g_timer_elapsed (run_timer, NULL);
+	guint op;
+
+	if (elapsed >= duration) {
+		running = FALSE;
+		return FALSE;
+	}
+
+	for (op = 0; op < NUM_OPS; op++) {
+		while (op_started[op] + op_skipped[op] < op_rates[op] * elapsed) {
+			struct client *c = idle_client ();
+
+			if (c == NULL) {
+				op_skipped[op]++;
+				continue;
+			}
+			op_started[op]++;
+			start_op (c, op);
+		}
+	}
+
+	return TRUE;
+}
+
+static gint compare_double(gconstpointer a, gconstpointer b)
+{
+	double da = *(const double *) a, db = *(const double *) b;
+
+	if (da < db)
+		return -1;
+	return da > db;
+}
+
+static double percentile(GArray *array, guint p)
+{
+	guint i;
+
+	if (array->len == 0)
+		return 0;
+	i = (array->len * p + 99) / 100;
+	if (i > 0)
+		i--;
+	return g_array_index (array, double, i);
+}
+
+static void print_outcome(gpointer key, gpointer value, gpointer user_data)
+{
+	g_print("    %-50s %u\n", (char *) key, GPOINTER_TO_UINT (value));
+}
+
+static void print_timings(const char *name, struct timings *t)
+{
+	if (t->calls == 0)
+		return;
+
+	g_array_sort (t->latencies, compare_double);
+	g_print("%-22s %8u %10.2f %10.2f %10.2f %10.2f\n", name, t->calls,
+		percentile (t->latencies, 50), percentile (t->latencies, 90),
+		percentile (t->latencies, 99),
+		g_array_index (t->latencies, double, t->latencies->len - 1));
+	g_hash_table_foreach (t->outcomes, print_outcome, NULL);
+}
+
+static void report(double elapsed)
+{
+	guint i;
+
+	g_print("%.1fs with %d clients\n", elapsed, num_clients);
+	for (i = 0; i < NUM_OPS; i++) {
+		if (op_rates[i] == 0)
+			continue;
+		g_print("%-8s target %.1f/s, achieved %.1f/s, %u skipped with no idle client\n",
+			op_names[i], op_rates[i], op_started[i] / elapsed, op_skipped[i]);
+	}
+
+	g_print("\n%-22s %8s %10s %10s %10s %10s\n", "", "calls", "p50 (ms)", "p90 (ms)", "p99 (ms)", "max (ms)");
+	for (i = 0; i < NUM_OPS; i++)
+		print_timings (op_names[i], &op_timings[i]);
+	for (i = 0; i < NUM_STEPS; i++) {
+		if (step_methods[i] != NULL)
+			print_timings (step_methods[i], &step_timings[i]);
+	}
+}
+
+static gboolean parse_rates(void)
+{
+	guint i, j;
+
+	for (i = 0; rates != NULL && rates[i] != NULL; i++) {
+		char **parts = g_strsplit (rates[i], "=", 2);
+		gboolean found = FALSE;
+
+		for (j = 0; j < NUM_OPS && parts[1] != NULL; j++) {
+			if (g_str_equal (parts[0], op_names[j])) {
+				op_rates[j] = g_ascii_strtod (parts[1], NULL);
+				found = op_rates[j] >= 0;
+			}
+		}
+		g_strfreev (parts);
+		if (!found) {
+			g_print ("Invalid rate '%s'\n", rates[i]);
+			return FALSE;
+		}
+	}
+
+	/* Something to do by default */
+	for (i = 0; i < NUM_OPS; i++) {
+		if (op_rates[i] > 0)
+			return TRUE;
+	}
+	op_rates[OP_VERIFY] = 1;
+	op_rates[OP_LIST] = 10;
+	return TRUE;
+}
+
+static const GOptionEntry entries[] = {
+	{ "clients", 'c', 0, G_OPTION_ARG_INT, &num_clients, "Bus connections to use (default 8)", NULL },
+	{ "duration", 'd', 0, G_OPTION_ARG_INT, &duration, "Seconds to run for (default 30)", NULL },
+	{ "rate", 'r', 0, G_OPTION_ARG_STRING_ARRAY, &rates, "Operations to start per second, as list, verify, enroll or delete=RATE, can be repeated (default list=10 and verify=1)", NULL },
+	{ "timeout", 't', 0, G_OPTION_ARG_INT, &op_timeout, "Seconds before giving up on an operation (default 30)", NULL },
+	{ "users", 'n', 0, G_OPTION_ARG_INT, &num_users, "Number of users, if none are given (default 1)", NULL },
+	{ "user-prefix", 'p', 0, G_OPTION_ARG_STRING, &user_prefix, "Prefix of the user names, if none are given (default fprintd-bench-)", NULL },
+	{ "finger", 'f', 0, G_OPTION_ARG_STRING, &finger_name, "Finger to enroll (default right-index-finger)", NULL },
+	{ G_OPTION_REMAINING, '\0', 0, G_OPTION_ARG_STRING_ARRAY, &usernames, NULL, "[username...]" },
+	{ NULL }
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+	char **devices;
+	guint num_devices;
+	int i;
+
+	g_type_init();
+
+	dbus_g_object_register_marshaller (fprintd_marshal_VOID__STRING_BOOLEAN,
+					   G_TYPE_NONE, G_TYPE_STRING, G_TYPE_BOOLEAN, G_TYPE_INVALID);
+
+	context = g_option_context_new ("Generate concurrent load on fprintd");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (g_option_context_parse (context, &argc, &argv, &err) == FALSE) {
+		g_print ("couldn't parse command-line options: %s\n", err->message);
+		g_error_free (err);
+		return 1;
+	}
+
+	if (num_clients <= 0 || duration <= 0 || op_timeout <= 0 || num_users <= 0 ||
+	    !parse_rates ()) {
+		g_print ("Invalid options\n");
+		return 1;
+	}
+
+	if (usernames == NULL) {
+		usernames = g_new0 (char *, num_users + 1);
+		for (i = 0; i < num_users; i++)
+			usernames[i] = g_strdup_printf ("%s%d", user_prefix, i);
+	}
+
+	for (i = 0; i < NUM_OPS; i++)
+		timings_init (&op_timings[i]);
+	for (i = 0; i < NUM_STEPS; i++)
+		timings_init (&step_timings[i]);
+
+	devices = get_devices ();
+	num_devices = g_strv_length (devices);
+
+	clients = g_new0 (struct client, num_clients);
+	for (i = 0; i < num_clients; i++) {
+		struct client *c = &clients[i];
+
+		c->index = i;
+		c->connection = dbus_g_bus_get_private (DBUS_BUS_SYSTEM, NULL, &err);
+		if (c->connection == NULL)
+			g_error("Failed to connect to the bus: %s", err->message);
+		c->dev = dbus_g_proxy_new_for_name(c->connection, "net.reactivated.Fprint",
+						   devices[i % num_devices], "net.reactivated.Fprint.Device");
+		dbus_g_proxy_add_signal(c->dev, "VerifyStatus", G_TYPE_STRING, G_TYPE_BOOLEAN, NULL);
+		dbus_g_proxy_connect_signal(c->dev, "VerifyStatus", G_CALLBACK(status_cb), c, NULL);
+		dbus_g_proxy_add_signal(c->dev, "EnrollStatus", G_TYPE_STRING, G_TYPE_BOOLEAN, NULL);
+		dbus_g_proxy_connect_signal(c->dev, "EnrollStatus", G_CALLBACK(status_cb), c, NULL);
+		c->op_timer = g_timer_new ();
+		c->step_timer = g_timer_new ();
+	}
+	g_print("%d clients on %u devices, %u users\n", num_clients, num_devices,
+		g_strv_length (usernames));
+
+	run_timer = g_timer_new ();
+	g_timeout_add (10, schedule_cb, NULL);
+
+	/* Let the last operations finish */
+	while (running || in_flight > 0)
+		g_main_context_iteration (NULL, TRUE);
+
+	report (duration);
+
+	return 0;
+}
+
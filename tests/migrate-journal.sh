@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# Checks that fprintd-store migrate leaves the prints alone while
+# fprintd's journal holds some it hasn't compacted yet, whose paths
+# are in the old layout, and moves them once it's been compacted.
+#
+# Usage: migrate-journal.sh FPRINTD-STORE
+
+if [ $# -lt 1 ]; then
+	echo "Usage: $0 FPRINTD-STORE" >&2
+	exit 1
+fi
+
+STORE=$1
+DIR=`mktemp -d ${TMPDIR:-/tmp}/fprintd-migrate.XXXXXX` || exit 1
+trap 'rm -rf "$DIR"' EXIT INT TERM
+
+mkdir -p "$DIR/prints/fprintd-test/00ff/00000000"
+echo virtual > "$DIR/prints/fprintd-test/00ff/00000000/7"
+cat > "$DIR/fprintd.conf" <<EOF2
+[storage]
+type=file
+path=$DIR/prints
+EOF2
+
+# A save fprintd journaled, not compacted yet
+echo pending > "$DIR/prints/.journal"
+if "$STORE" --config="$DIR/fprintd.conf" migrate --to=hashed --pause=0 2> /dev/null; then
+	echo "migrate ran with prints left in the journal" >&2
+	exit 1
+fi
+if [ ! -d "$DIR/prints/fprintd-test" ]; then
+	echo "migrate moved users with prints left in the journal" >&2
+	exit 1
+fi
+
+# Compacted, fprintd leaves an empty journal
+: > "$DIR/prints/.journal"
+if ! "$STORE" --config="$DIR/fprintd.conf" migrate --to=hashed --pause=0; then
+	echo "migrate failed with the journal compacted" >&2
+	exit 1
+fi
+if [ -d "$DIR/prints/fprintd-test" ] || [ -z "`find "$DIR/prints/.hashed" -name fprintd-test`" ]; then
+	echo "migrate didn't move the user to the hashed layout" >&2
+	exit 1
+fi
+
+echo "migrate waits for the journal to be compacted"
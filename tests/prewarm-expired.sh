@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# Lets the pre-warm window of a reader run out while it is still being
+# opened. With "claim", the reader is then claimed, which has to be
+# answered once the open completes. With "idle", nobody claims it, and
+# fprintd has to close it and keep answering.
+# Run from virtual-bench.sh, with FPRINTD_VIRTUAL_OPEN_DELAY longer
+# than the [prewarm] window, see the prewarm-expired targets.
+#
+# Usage: prewarm-expired.sh FAKE-LOGIN WAIT claim|idle
+
+FAKE_LOGIN=$1
+WAIT=$2
+MODE=$3
+
+"$FAKE_LOGIN" --lock --linger=1 fprintd-bench-0 > /dev/null || exit 1
+
+# Past the window, with the reader still opening, or past the
+# open as well when nobody is going to claim it
+sleep $WAIT
+
+if [ "$MODE" = idle ]; then
+	if ! dbus-send --system --print-reply --reply-timeout=10000 \
+		--dest=net.reactivated.Fprint /net/reactivated/Fprint/Manager \
+		net.reactivated.Fprint.Manager.GetDevices > /dev/null; then
+		echo "fprintd stopped answering after closing the pre-warmed reader" >&2
+		exit 1
+	fi
+fi
+
+if ! dbus-send --system --print-reply --reply-timeout=10000 \
+	--dest=net.reactivated.Fprint /net/reactivated/Fprint/Device/0 \
+	net.reactivated.Fprint.Device.Claim string:fprintd-bench-0 > /dev/null; then
+	echo "Claim after the pre-warm window got no answer" >&2
+	exit 1
+fi
+
+dbus-send --system --print-reply --dest=net.reactivated.Fprint \
+	/net/reactivated/Fprint/Device/0 net.reactivated.Fprint.Device.Release > /dev/null || exit 1
+
+echo "Claim after the pre-warm window answered"
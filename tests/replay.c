@@ -0,0 +1,580 @@
+/*
+ * fprintd D-Bus workload replay
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Replays the method calls captured by fprintd with [debug] capture,
+ * against another instance, typically one using the virtual readers,
+ * and reports the latency of each method, and its errors.
+ *
+ * Each sender of the capture gets its own bus connection, making its
+ * calls at the captured times, divided by --speed, but never before
+ * its previous call returned, and gets disconnected when the original
+ * sender did. Signals aren't waited for, the captured delays between
+ * calls standing in for them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dbus/dbus-glib-bindings.h>
+#include <dbus/dbus-glib-lowlevel.h>
+
+struct call {
+	/* in microseconds since the capture started */
+	guint64 time;
+	/* NULL when the sender disconnected */
+	char *path;
+	char *interface;
+	char *member;
+	char *signature;
+	char *args;
+};
+
+struct sender {
+	char *name;
+	DBusConnection *connection;
+	GQueue *calls;
+	/* The call waiting for a reply, if any */
+	struct call *current;
+	GTimer *timer;
+};
+
+struct timings {
+	/* in milliseconds */
+	GArray *latencies;
+	/* Error names, and how often they happened */
+	GHashTable *errors;
+};
+
+struct parser {
+	GPtrArray *tokens;
+	guint pos;
+};
+
+static double speed = 1;
+static int call_timeout = 30;
+
+static GPtrArray *senders = NULL;
+/* struct timings, by method name */
+static GHashTable *methods = NULL;
+static guint unparsable = 0;
+static GTimer *run_timer = NULL;
+static GMainLoop *loop = NULL;
+
+static struct sender *get_sender(GHashTable *by_name, const char *name)
+{
+	struct sender *sender = g_hash_table_lookup(by_name, name);
+
+	if (sender == NULL) {
+		sender = g_new0(struct sender, 1);
+		sender->name = g_strdup(name);
+		sender->calls = g_queue_new();
+		sender->timer = g_timer_new();
+		g_hash_table_insert(by_name, sender->name, sender);
+		g_ptr_array_add(senders, sender);
+	}
+
+	return sender;
+}
+
+static gboolean load_capture(const char *path)
+{
+	GHashTable *by_name;
+	GError *error = NULL;
+	char *contents;
+	char **lines;
+	guint i;
+
+	if (!g_file_get_contents(path, &contents, NULL, &error)) {
+		g_print("Could not read %s: %s\n", path, error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	senders = g_ptr_array_new();
+	by_name = g_hash_table_new(g_str_hash, g_str_equal);
+
+	lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+	for (i = 0; lines[i] != NULL; i++) {
+		char **fields;
+		struct call *call;
+
+		if (lines[i][0] == '#' || lines[i][0] == '\0')
+			continue;
+
+		fields = g_strsplit(lines[i], "\t", 8);
+		if (g_strv_length(fields) == 3 && g_str_equal(fields[1], "disconnect")) {
+			call = g_new0(struct call, 1);
+			call->time = g_ascii_strtoull(fields[0], NULL, 10);
+			g_queue_push_tail(get_sender(by_name, fields[2])->calls, call);
+		} else if (g_strv_length(fields) == 8 && g_str_equal(fields[1], "call")) {
+			call = g_new0(struct call, 1);
+			call->time = g_ascii_strtoull(fields[0], NULL, 10);
+			call->path = g_strdup(fields[3]);
+			call->interface = g_strdup(fields[4]);
+			call->member = g_strdup(fields[5]);
+			call->signature = g_strdup(fields[6]);
+			call->args = g_strdup(fields[7]);
+			g_queue_push_tail(get_sender(by_name, fields[2])->calls, call);
+		} else {
+			unparsable++;
+		}
+		g_strfreev(fields);
+	}
+	g_strfreev(lines);
+	g_hash_table_destroy(by_name);
+
+	return TRUE;
+}
+
+static void call_free(struct call *call)
+{
+	g_free(call->path);
+	g_free(call->interface);
+	g_free(call->member);
+	g_free(call->signature);
+	g_free(call->args);
+	g_free(call);
+}
+
+/* Splits arguments on spaces, except within quoted strings */
+static GPtrArray *tokenize(const char *args)
+{
+	GPtrArray *tokens = g_ptr_array_new();
+	const char *p = args;
+
+	while (*p != '\0') {
+		const char *start;
+
+		while (*p == ' ')
+			p++;
+		if (*p == '\0')
+			break;
+
+		start = p;
+		if (*p == '"') {
+			p++;
+			while (*p != '\0' && *p != '"') {
+				if (*p == '\\' && p[1] != '\0')
+					p++;
+				p++;
+			}
+			if (*p == '"')
+				p++;
+		} else {
+			while (*p != '\0' && *p != ' ')
+				p++;
+		}
+		g_ptr_array_add(tokens, g_strndup(start, p - start));
+	}
+
+	return tokens;
+}
+
+static const char *peek_token(struct parser *parser)
+{
+	if (parser->pos >= parser->tokens->len)
+		return NULL;
+	return g_ptr_array_index(parser->tokens, parser->pos);
+}
+
+static const char *next_token(struct parser *parser)
+{
+	const char *token = peek_token(parser);
+
+	if (token != NULL)
+		parser->pos++;
+	return token;
+}
+
+static gboolean expect_token(struct parser *parser, const char *expected)
+{
+	const char *token = next_token(parser);
+
+	return token != NULL && g_str_equal(token, expected);
+}
+
+static gboolean append_value(DBusMessageIter *iter, DBusSignatureIter *sig,
+	struct parser *parser)
+{
+	int type = dbus_signature_iter_get_current_type(sig);
+	DBusMessageIter sub;
+	DBusSignatureIter subsig;
+	const char *token;
+
+	switch (type) {
+	case DBUS_TYPE_ARRAY: {
+		char *element;
+
+		if (!expect_token(parser, "["))
+			return FALSE;
+		dbus_signature_iter_recurse(sig, &subsig);
+		element = dbus_signature_iter_get_signature(&subsig);
+		dbus_message_iter_open_container(iter, type, element, &sub);
+		dbus_free(element);
+		while ((token = peek_token(parser)) != NULL && !g_str_equal(token, "]")) {
+			dbus_signature_iter_recurse(sig, &subsig);
+			if (!append_value(&sub, &subsig, parser))
+				return FALSE;
+		}
+		dbus_message_iter_close_container(iter, &sub);
+		return expect_token(parser, "]");
+	}
+	case DBUS_TYPE_STRUCT:
+	case DBUS_TYPE_DICT_ENTRY:
+		if (!expect_token(parser, type == DBUS_TYPE_STRUCT ? "(" : "{"))
+			return FALSE;
+		dbus_message_iter_open_container(iter, type, NULL, &sub);
+		dbus_signature_iter_recurse(sig, &subsig);
+		do {
+			if (!append_value(&sub, &subsig, parser))
+				return FALSE;
+		} while (dbus_signature_iter_next(&subsig));
+		dbus_message_iter_close_container(iter, &sub);
+		return expect_token(parser, type == DBUS_TYPE_STRUCT ? ")" : "}");
+	case DBUS_TYPE_VARIANT:
+		if (!expect_token(parser, "<"))
+			return FALSE;
+		token = next_token(parser);
+		if (token == NULL || !dbus_signature_validate(token, NULL))
+			return FALSE;
+		dbus_message_iter_open_container(iter, type, token, &sub);
+		dbus_signature_iter_init(&subsig, token);
+		if (!append_value(&sub, &subsig, parser))
+			return FALSE;
+		dbus_message_iter_close_container(iter, &sub);
+		return expect_token(parser, ">");
+	}
+
+	token = next_token(parser);
+	if (token == NULL)
+		return FALSE;
+
+	switch (type) {
+	case DBUS_TYPE_STRING:
+	case DBUS_TYPE_OBJECT_PATH:
+	case DBUS_TYPE_SIGNATURE: {
+		size_t len = strlen(token);
+		char *quoted, *s;
+		gboolean ret;
+
+		if (len < 2 || token[0] != '"' || token[len - 1] != '"')
+			return FALSE;
+		quoted = g_strndup(token + 1, len - 2);
+		s = g_strcompress(quoted);
+		ret = dbus_message_iter_append_basic(iter, type, &s);
+		g_free(quoted);
+		g_free(s);
+		return ret;
+	}
+	case DBUS_TYPE_BOOLEAN: {
+		dbus_bool_t b = g_str_equal(token, "true");
+
+		return dbus_message_iter_append_basic(iter, type, &b);
+	}
+	case DBUS_TYPE_BYTE: {
+		unsigned char y = strtoul(token, NULL, 10);
+
+		return dbus_message_iter_append_basic(iter, type, &y);
+	}
+	case DBUS_TYPE_INT16: {
+		dbus_int16_t n = strtol(token, NULL, 10);
+
+		return dbus_message_iter_append_basic(iter, type, &n);
+	}
+	case DBUS_TYPE_UINT16: {
+		dbus_uint16_t q = strtoul(token, NULL, 10);
+
+		return dbus_message_iter_append_basic(iter, type, &q);
+	}
+	case DBUS_TYPE_INT32: {
+		dbus_int32_t i = strtol(token, NULL, 10);
+
+		return dbus_message_iter_append_basic(iter, type, &i);
+	}
+	case DBUS_TYPE_UINT32: {
+		dbus_uint32_t u = strtoul(token, NULL, 10);
+
+		return dbus_message_iter_append_basic(iter, type, &u);
+	}
+	case DBUS_TYPE_INT64: {
+		dbus_int64_t x = g_ascii_strtoll(token, NULL, 10);
+
+		return dbus_message_iter_append_basic(iter, type, &x);
+	}
+	case DBUS_TYPE_UINT64: {
+		dbus_uint64_t t = g_ascii_strtoull(token, NULL, 10);
+
+		return dbus_message_iter_append_basic(iter, type, &t);
+	}
+	case DBUS_TYPE_DOUBLE: {
+		double d = g_ascii_strtod(token, NULL);
+
+		return dbus_message_iter_append_basic(iter, type, &d);
+	}
+	}
+
+	return FALSE;
+}
+
+static DBusMessage *build_message(struct call *call)
+{
+	DBusMessage *message;
+	DBusMessageIter iter;
+	DBusSignatureIter sig;
+	struct parser parser;
+	gboolean ok = TRUE;
+
+	message = dbus_message_new_method_call("net.reactivated.Fprint", call->path,
+					       call->interface, call->member);
+	if (*call->signature == '\0')
+		return message;
+
+	if (!dbus_signature_validate(call->signature, NULL)) {
+		dbus_message_unref(message);
+		return NULL;
+	}
+
+	parser.tokens = tokenize(call->args);
+	parser.pos = 0;
+	dbus_message_iter_init_append(message, &iter);
+	dbus_signature_iter_init(&sig, call->signature);
+	do {
+		ok = append_value(&iter, &sig, &parser);
+	} while (ok && dbus_signature_iter_next(&sig));
+
+	g_ptr_array_foreach(parser.tokens, (GFunc) g_free, NULL);
+	g_ptr_array_free(parser.tokens, TRUE);
+
+	if (!ok) {
+		dbus_message_unref(message);
+		return NULL;
+	}
+	return message;
+}
+
+static void record(const char *method, double ms, const char *error)
+{
+	struct timings *t = g_hash_table_lookup(methods, method);
+
+	if (t == NULL) {
+		t = g_new0(struct timings, 1);
+		t->latencies = g_array_new(FALSE, FALSE, sizeof(double));
+		t->errors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+		g_hash_table_insert(methods, g_strdup(method), t);
+	}
+
+	g_array_append_val(t->latencies, ms);
+	if (error != NULL) {
+		guint count = GPOINTER_TO_UINT(g_hash_table_lookup(t->errors, error));
+
+		g_hash_table_insert(t->errors, g_strdup(error), GUINT_TO_POINTER(count + 1));
+	}
+}
+
+static void reply_cb(DBusPendingCall *pending, void *user_data)
+{
+	struct sender *sender = user_data;
+	struct call *call = sender->current;
+	DBusMessage *reply;
+	const char *error = NULL;
+
+	reply = dbus_pending_call_steal_reply(pending);
+	if (reply == NULL)
+		error = "no reply";
+	else if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR)
+		error = dbus_message_get_error_name(reply);
+
+	record(call->member, g_timer_elapsed(sender->timer, NULL) * 1000, error);
+
+	if (reply != NULL)
+		dbus_message_unref(reply);
+	dbus_pending_call_unref(pending);
+	sender->current = NULL;
+	call_free(call);
+}
+
+static void disconnect(struct sender *sender)
+{
+	if (sender->connection == NULL)
+		return;
+	dbus_connection_close(sender->connection);
+	dbus_connection_unref(sender->connection);
+	sender->connection = NULL;
+}
+
+static void send_call(struct sender *sender, struct call *call)
+{
+	DBusPendingCall *pending;
+	DBusMessage *message;
+
+	if (sender->connection == NULL) {
+		DBusError error;
+
+		dbus_error_init(&error);
+		sender->connection = dbus_bus_get_private(DBUS_BUS_SYSTEM, &error);
+		if (sender->connection == NULL)
+			g_error("Failed to connect to the bus: %s", error.message);
+		dbus_connection_set_exit_on_disconnect(sender->connection, FALSE);
+		dbus_connection_setup_with_g_main(sender->connection, NULL);
+	}
+
+	message = build_message(call);
+	if (message == NULL) {
+		unparsable++;
+		call_free(call);
+		return;
+	}
+
+	g_timer_start(sender->timer);
+	if (!dbus_connection_send_with_reply(sender->connection, message, &pending,
+					     call_timeout * 1000) || pending == NULL) {
+		record(call->member, 0, "not sent");
+		call_free(call);
+	} else {
+		sender->current = call;
+		dbus_pending_call_set_notify(pending, reply_cb, sender, NULL);
+	}
+	dbus_message_unref(message);
+}
+
+/* Makes the calls that are due, on senders that aren't waiting for
+ * a reply, and stops when everything was replayed */
+static gboolean schedule_cb(gpointer user_data)
+{
+	double elapsed = g_timer_elapsed(run_timer, NULL) * G_USEC_PER_SEC;
+	gboolean done = TRUE;
+	guint i;
+
+	for (i = 0; i < senders->len; i++) {
+		struct sender *sender = g_ptr_array_index(senders, i);
+		struct call *call;
+
+		if (sender->current != NULL) {
+			done = FALSE;
+			continue;
+		}
+
+		while ((call = g_queue_peek_head(sender->calls)) != NULL) {
+			if (speed > 0 && call->time / speed > elapsed)
+				break;
+			g_queue_pop_head(sender->calls);
+			if (call->path == NULL) {
+				disconnect(sender);
+				call_free(call);
+				continue;
+			}
+			send_call(sender, call);
+			if (sender->current != NULL)
+				break;
+		}
+
+		if (sender->current != NULL || !g_queue_is_empty(sender->calls))
+			done = FALSE;
+	}
+
+	if (done) {
+		g_main_loop_quit(loop);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static gint compare_double(gconstpointer a, gconstpointer b)
+{
+	double da = *(const double *) a, db = *(const double *) b;
+
+	if (da < db)
+		return -1;
+	return da > db;
+}
+
+static double percentile(GArray *array, guint p)
+{
+	guint i;
+
+	i = (array->len * p + 99) / 100;
+	if (i > 0)
+		i--;
+	return g_array_index(array, double, i);
+}
+
+static void print_error(gpointer key, gpointer value, gpointer user_data)
+{
+	g_print("    %-50s %u\n", (char *) key, GPOINTER_TO_UINT(value));
+}
+
+static void print_method(gpointer key, gpointer value, gpointer user_data)
+{
+	struct timings *t = value;
+
+	g_array_sort(t->latencies, compare_double);
+	g_print("%-28s %8u %10.2f %10.2f %10.2f %10.2f\n", (char *) key,
+		t->latencies->len, percentile(t->latencies, 50),
+		percentile(t->latencies, 90), percentile(t->latencies, 99),
+		g_array_index(t->latencies, double, t->latencies->len - 1));
+	g_hash_table_foreach(t->errors, print_error, NULL);
+}
+
+static const GOptionEntry entries[] = {
+	{ "speed", 's', 0, G_OPTION_ARG_DOUBLE, &speed, "How much faster than captured to replay, 0 for as fast as possible (default 1)", NULL },
+	{ "timeout", 't', 0, G_OPTION_ARG_INT, &call_timeout, "Seconds to wait for each reply (default 30)", NULL },
+	{ NULL }
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+
+	g_type_init();
+
+	context = g_option_context_new ("CAPTURE - Replay a D-Bus workload captured by fprintd");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (g_option_context_parse (context, &argc, &argv, &err) == FALSE) {
+		g_print ("couldn't parse command-line options: %s\n", err->message);
+		g_error_free (err);
+		return 1;
+	}
+
+	if (argc != 2 || speed < 0 || call_timeout <= 0) {
+		g_print ("Invalid options\n");
+		return 1;
+	}
+
+	if (!load_capture(argv[1]))
+		return 1;
+	g_print("Replaying %u senders\n", senders->len);
+
+	methods = g_hash_table_new(g_str_hash, g_str_equal);
+	loop = g_main_loop_new(NULL, FALSE);
+	run_timer = g_timer_new();
+	g_timeout_add(1, schedule_cb, NULL);
+	g_main_loop_run(loop);
+
+	g_print("Replayed in %.2fs, %u calls could not be parsed\n",
+		g_timer_elapsed(run_timer, NULL), unparsable);
+	g_print("%-28s %8s %10s %10s %10s %10s\n", "", "calls", "p50 (ms)", "p90 (ms)", "p99 (ms)", "max (ms)");
+	g_hash_table_foreach(methods, print_method, NULL);
+
+	return 0;
+}
+
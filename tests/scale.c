@@ -0,0 +1,265 @@
+/*
+ * fprintd benchmark of many readers in one daemon
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Measures how the daemon copes with many readers, typically the
+ * virtual ones with FPRINTD_VIRTUAL_DEVICES=256: the startup time
+ * and memory use passed by virtual-bench.sh, and the latency of
+ * Manager methods and of Device methods on each reader, claiming
+ * them all at once, so that the in-use bookkeeping is exercised with
+ * many readers in use.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dbus/dbus-glib-bindings.h>
+#include "manager-dbus-glue.h"
+#include "device-dbus-glue.h"
+
+enum method {
+	METHOD_GET_DEVICES = 0,
+	METHOD_GET_DEFAULT_DEVICE,
+	METHOD_LIST_ENROLLED_FINGERS,
+	METHOD_CLAIM,
+	METHOD_RELEASE,
+	NUM_METHODS
+};
+
+static const char *method_names[NUM_METHODS] = {
+	"GetDevices",
+	"GetDefaultDevice",
+	"ListEnrolledFingers",
+	"Claim",
+	"Release"
+};
+
+static DBusGProxy *manager = NULL;
+static DBusGConnection *connection = NULL;
+static int iterations = 10;
+static char *username = "fprintd-bench-0";
+
+/* Latencies of each method, in milliseconds */
+static GArray *latencies[NUM_METHODS];
+
+static void create_manager(void)
+{
+	GError *error = NULL;
+
+	connection = dbus_g_bus_get(DBUS_BUS_SYSTEM, &error);
+	if (connection == NULL)
+		g_error("Failed to connect to session bus: %s", error->message);
+
+	manager = dbus_g_proxy_new_for_name(connection,
+		"net.reactivated.Fprint", "/net/reactivated/Fprint/Manager",
+		"net.reactivated.Fprint.Manager");
+}
+
+static void record(enum method method, GTimer *timer)
+{
+	double ms = g_timer_elapsed (timer, NULL) * 1000;
+
+	g_array_append_val (latencies[method], ms);
+	g_timer_start (timer);
+}
+
+/* Resident memory of the daemon, in kB, or 0 if unknown */
+static guint rss(void)
+{
+	const char *pid = g_getenv ("FPRINTD_PID");
+	char *path, *contents, *line;
+	guint kb = 0;
+
+	if (pid == NULL)
+		return 0;
+
+	path = g_strdup_printf ("/proc/%s/status", pid);
+	if (g_file_get_contents (path, &contents, NULL, NULL)) {
+		line = strstr (contents, "VmRSS:");
+		if (line != NULL)
+			kb = strtoul (line + strlen ("VmRSS:"), NULL, 10);
+		g_free (contents);
+	}
+	g_free (path);
+
+	return kb;
+}
+
+static GPtrArray *get_devices(GTimer *timer)
+{
+	GError *error = NULL;
+	GPtrArray *devices;
+
+	g_timer_start (timer);
+	if (!net_reactivated_Fprint_Manager_get_devices(manager, &devices, &error))
+		g_error("list_devices failed: %s", error->message);
+	record (METHOD_GET_DEVICES, timer);
+
+	return devices;
+}
+
+static void run(GPtrArray *devices, DBusGProxy **devs, GTimer *timer)
+{
+	GError *error = NULL;
+	guint i;
+
+	g_timer_start (timer);
+	for (i = 0; i < devices->len; i++) {
+		char **fingers;
+
+		if (!net_reactivated_Fprint_Device_list_enrolled_fingers(devs[i], username, &fingers, &error))
+			g_error("ListEnrolledFingers failed: %s", error->message);
+		record (METHOD_LIST_ENROLLED_FINGERS, timer);
+		g_strfreev (fingers);
+	}
+
+	for (i = 0; i < devices->len; i++) {
+		if (!net_reactivated_Fprint_Device_claim(devs[i], username, &error))
+			g_error("failed to claim device: %s", error->message);
+		record (METHOD_CLAIM, timer);
+	}
+
+	for (i = 0; i < devices->len; i++) {
+		if (!net_reactivated_Fprint_Device_release(devs[i], &error))
+			g_error("ReleaseDevice failed: %s", error->message);
+		record (METHOD_RELEASE, timer);
+	}
+}
+
+static gint compare_double(gconstpointer a, gconstpointer b)
+{
+	double da = *(const double *) a, db = *(const double *) b;
+
+	if (da < db)
+		return -1;
+	return da > db;
+}
+
+static double percentile(GArray *array, guint p)
+{
+	guint i;
+
+	i = (array->len * p + 99) / 100;
+	if (i > 0)
+		i--;
+	return g_array_index (array, double, i);
+}
+
+static void report(guint num_devices, guint rss_start, guint rss_end)
+{
+	const char *startup = g_getenv ("FPRINTD_STARTUP_MS");
+	guint i;
+
+	g_print("%u devices\n", num_devices);
+	if (startup != NULL)
+		g_print("startup: %s ms\n", startup);
+	if (rss_start != 0)
+		g_print("RSS: %u kB at start, %u kB at end\n", rss_start, rss_end);
+
+	g_print("%-20s %8s %10s %10s %10s %10s\n", "", "calls", "p50 (ms)", "p99 (ms)", "max (ms)", "mean (ms)");
+	for (i = 0; i < NUM_METHODS; i++) {
+		GArray *array = latencies[i];
+		double sum = 0;
+		guint j;
+
+		if (array->len == 0)
+			continue;
+		g_array_sort (array, compare_double);
+		for (j = 0; j < array->len; j++)
+			sum += g_array_index (array, double, j);
+		g_print("%-20s %8u %10.2f %10.2f %10.2f %10.2f\n", method_names[i],
+			array->len, percentile (array, 50), percentile (array, 99),
+			g_array_index (array, double, array->len - 1),
+			sum / array->len);
+	}
+}
+
+static const GOptionEntry entries[] = {
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Passes over all the devices (default 10)", NULL },
+	{ "username", 'u', 0, G_OPTION_ARG_STRING, &username, "User to claim the devices for (default fprintd-bench-0)", NULL },
+	{ NULL }
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+	GPtrArray *devices;
+	DBusGProxy **devs;
+	GTimer *timer;
+	guint rss_start;
+	guint i;
+	int n;
+
+	g_type_init();
+
+	context = g_option_context_new ("Benchmark fprintd with many devices");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (g_option_context_parse (context, &argc, &argv, &err) == FALSE) {
+		g_print ("couldn't parse command-line options: %s\n", err->message);
+		g_error_free (err);
+		return 1;
+	}
+
+	if (iterations <= 0) {
+		g_print ("Invalid options\n");
+		return 1;
+	}
+
+	for (i = 0; i < NUM_METHODS; i++)
+		latencies[i] = g_array_new (FALSE, FALSE, sizeof (double));
+
+	rss_start = rss ();
+	create_manager();
+	timer = g_timer_new ();
+
+	devices = get_devices (timer);
+	if (devices->len == 0) {
+		g_print("No devices found\n");
+		return 1;
+	}
+
+	devs = g_new0 (DBusGProxy *, devices->len);
+	for (i = 0; i < devices->len; i++)
+		devs[i] = dbus_g_proxy_new_for_name(connection, "net.reactivated.Fprint",
+						    g_ptr_array_index (devices, i),
+						    "net.reactivated.Fprint.Device");
+
+	for (n = 0; n < iterations; n++) {
+		char *path;
+		GPtrArray *again;
+
+		again = get_devices (timer);
+		g_ptr_array_foreach (again, (GFunc) g_free, NULL);
+		g_ptr_array_free (again, TRUE);
+
+		if (!net_reactivated_Fprint_Manager_get_default_device(manager, &path, &err))
+			g_error("GetDefaultDevice failed: %s", err->message);
+		record (METHOD_GET_DEFAULT_DEVICE, timer);
+		g_free (path);
+
+		run (devices, devs, timer);
+	}
+
+	report (devices->len, rss_start, rss ());
+
+	return 0;
+}
+
@@ -0,0 +1,176 @@
+/*
+ * fprintd example reading the statistics page
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "stats.h"
+
+static char *path = STATS_PAGE_PATH;
+static int interval = 0;
+static gboolean show_devices = FALSE;
+
+static const struct fprint_stats_page *map_page(void)
+{
+	const struct fprint_stats_page *page;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		g_print("Could not open %s: %s\n", path, g_strerror(errno));
+		exit(1);
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(struct fprint_stats_page)) {
+		g_print("%s is too small to be a statistics page\n", path);
+		exit(1);
+	}
+
+	page = mmap(NULL, sizeof(struct fprint_stats_page), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED) {
+		g_print("Could not map %s: %s\n", path, g_strerror(errno));
+		exit(1);
+	}
+
+	if (page->magic != STATS_PAGE_MAGIC ||
+	    page->version != STATS_PAGE_VERSION ||
+	    page->size != sizeof(struct fprint_stats_page)) {
+		g_print("%s has an unsupported layout (version %u, size %u)\n",
+			path, page->version, page->size);
+		exit(1);
+	}
+
+	return page;
+}
+
+/* Copies the page once the daemon isn't in the middle of updating it */
+static void snapshot(const struct fprint_stats_page *page, struct fprint_stats_page *copy)
+{
+	guint32 seq;
+	guint tries = 0;
+
+	for (;;) {
+		seq = page->seq;
+		__sync_synchronize();
+		if ((seq & 1) == 0) {
+			memcpy(copy, (const void *) page, sizeof(struct fprint_stats_page));
+			__sync_synchronize();
+			if (page->seq == seq)
+				break;
+		}
+		if (++tries % 1000 == 0)
+			g_usleep(1000);
+	}
+}
+
+static void print_stats(const struct fprint_stats_page *page, const struct fprint_stats *stats)
+{
+	guint i, j;
+
+	for (i = 0; i < page->num_counters; i++) {
+		g_print("  %-24s %" G_GUINT64_FORMAT "\n",
+			page->counter_names[i], stats->counters[i]);
+	}
+
+	for (i = 0; i < page->num_phases; i++) {
+		const struct fprint_histogram *hist = &stats->phases[i];
+
+		if (hist->count == 0)
+			continue;
+
+		g_print("  %-24s %" G_GUINT64_FORMAT " samples, mean %.1fms\n",
+			page->phase_names[i], hist->count,
+			(double) hist->sum / hist->count / 1000);
+		for (j = 0; j < page->num_buckets; j++) {
+			if (hist->buckets[j] == 0)
+				continue;
+			if (j < page->num_buckets - 1)
+				g_print("    <= %8.1fms %" G_GUINT64_FORMAT "\n",
+					page->bucket_bounds[j] / 1000.0, hist->buckets[j]);
+			else
+				g_print("     > %8.1fms %" G_GUINT64_FORMAT "\n",
+					page->bucket_bounds[j - 1] / 1000.0, hist->buckets[j]);
+		}
+	}
+}
+
+static void print_page(const struct fprint_stats_page *page)
+{
+	struct fprint_stats_page copy;
+	guint i;
+
+	snapshot(page, &copy);
+
+	g_print("All devices:\n");
+	print_stats(&copy, &copy.total);
+
+	if (show_devices == FALSE)
+		return;
+
+	for (i = 0; i < copy.max_devices; i++) {
+		if (copy.device_ids[i] == G_MAXUINT32)
+			continue;
+		g_print("Device %u:\n", copy.device_ids[i]);
+		print_stats(&copy, &copy.devices[i]);
+	}
+}
+
+static const GOptionEntry entries[] = {
+	{ "file", 'f', 0, G_OPTION_ARG_FILENAME, &path, "Statistics page to read (default " STATS_PAGE_PATH ")", NULL },
+	{ "interval", 'i', 0, G_OPTION_ARG_INT, &interval, "Print the statistics every so many seconds", NULL },
+	{ "devices", 'd', 0, G_OPTION_ARG_NONE, &show_devices, "Also print the statistics of each device", NULL },
+	{ NULL }
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+	const struct fprint_stats_page *page;
+
+	context = g_option_context_new ("Read fprintd's statistics");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (g_option_context_parse (context, &argc, &argv, &err) == FALSE) {
+		g_print ("couldn't parse command-line options: %s\n", err->message);
+		g_error_free (err);
+		return 1;
+	}
+
+	page = map_page();
+	print_page(page);
+
+	while (interval > 0) {
+		sleep(interval);
+		g_print("\n");
+		print_page(page);
+	}
+
+	return 0;
+}
+
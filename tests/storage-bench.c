@@ -0,0 +1,349 @@
+/*
+ * fprintd storage backend benchmark
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Measures storage backends directly, through the storage vtable,
+ * with the virtual readers linked in instead of libfprint: how fast
+ * prints get saved, and how long loading, listing and deleting a
+ * user's prints takes, as the store grows to each of the --users
+ * sizes. Each --storage is "file", for the built-in file storage,
+ * "encrypted", for the same with [storage] encrypt=true, or the path
+ * of a module, and starts from an empty store in a temporary
+ * directory. Comparing the load latencies of the first two gives
+ * what decrypting adds to each load. --config adds fprintd.conf settings, such as
+ * [storage] layout=hashed, journal=true or checksums=true.
+ *
+ * Set FPRINTD_VIRTUAL_PRINT_SIZE to save prints the size of real
+ * ones, a few kilobytes.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libfprint/fprint.h>
+
+#include "storage.h"
+#include "file_storage.h"
+
+enum phase {
+	PHASE_LOAD = 0,
+	PHASE_DISCOVER,
+	PHASE_DELETE,
+	NUM_PHASES
+};
+
+static const char *phase_names[NUM_PHASES] = {
+	"load",
+	"discover",
+	"delete"
+};
+
+static char *users_list = "1000,10000,100000";
+static char *storage_list = "file";
+static char *conf_path = NULL;
+static char *tmp_dir = NULL;
+static int lookups = 10000;
+static gboolean keep = FALSE;
+
+static struct fp_dscv_dev *ddev = NULL;
+static struct fp_dev *dev = NULL;
+
+static void dev_open_cb(struct fp_dev *opened, int status, void *user_data)
+{
+	if (status != 0)
+		g_error("could not open the virtual reader: %d", status);
+	dev = opened;
+}
+
+static void open_device(void)
+{
+	struct fp_dscv_dev **devs;
+
+	if (fp_init() < 0)
+		g_error("could not initialise the virtual readers");
+	devs = fp_discover_devs();
+	ddev = devs[0];
+	fp_async_dev_open(ddev, dev_open_cb, NULL);
+	while (dev == NULL)
+		fp_handle_events_timeout(NULL);
+}
+
+static gboolean set_storage(const char *type, GKeyFile *conf)
+{
+	char *value;
+
+	if (g_str_equal(type, "file") || g_str_equal(type, "encrypted")) {
+		storage_set_file(&store);
+		if (!file_storage_configure(conf))
+			g_print("Unknown storage layout\n");
+		if (g_str_equal(type, "encrypted")) {
+			value = g_key_file_get_string(conf, "storage", "key-file", NULL);
+			file_storage_set_encryption(TRUE, value);
+			g_free(value);
+		}
+		return TRUE;
+	}
+
+	if (!storage_load_module(type, conf, &store)) {
+		g_print("Could not load the %s storage\n", type);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static GKeyFile *load_conf(const char *dir)
+{
+	GKeyFile *conf;
+	GError *error = NULL;
+	char *path;
+
+	conf = g_key_file_new();
+	if (conf_path != NULL &&
+	    !g_key_file_load_from_file(conf, conf_path, G_KEY_FILE_NONE, &error))
+		g_error("Could not open %s: %s", conf_path, error->message);
+
+	/* Everything goes in the temporary directory */
+	path = g_build_filename(dir, "prints", NULL);
+	g_key_file_set_string(conf, "storage", "path", path);
+	g_free(path);
+	path = g_build_filename(dir, "kv", NULL);
+	g_key_file_set_string(conf, "kv", "path", path);
+	g_free(path);
+	path = g_build_filename(dir, "host.key", NULL);
+	g_key_file_set_string(conf, "storage", "key-file", path);
+	g_free(path);
+
+	return conf;
+}
+
+static void remove_tree(const char *path)
+{
+	GDir *dir;
+	const char *name;
+
+	dir = g_dir_open(path, 0, NULL);
+	if (dir != NULL) {
+		while ((name = g_dir_read_name(dir)) != NULL) {
+			char *child = g_build_filename(path, name, NULL);
+
+			remove_tree(child);
+			g_free(child);
+		}
+		g_dir_close(dir);
+		g_rmdir(path);
+	} else {
+		g_unlink(path);
+	}
+}
+
+static gint compare_double(gconstpointer a, gconstpointer b)
+{
+	double da = *(const double *) a, db = *(const double *) b;
+
+	if (da < db)
+		return -1;
+	return da > db;
+}
+
+static double percentile(GArray *array, guint p)
+{
+	guint i;
+
+	i = (array->len * p + 99) / 100;
+	if (i > 0)
+		i--;
+	return g_array_index (array, double, i);
+}
+
+static void username(char *buf, gsize len, guint i)
+{
+	g_snprintf(buf, len, "bench-%06u", i);
+}
+
+/* Latencies in microseconds */
+static void report(const char *type, guint users, double saves_per_second,
+	GArray **latencies)
+{
+	guint i;
+
+	g_print("%s, %u users, %.0f saves/s\n", type, users, saves_per_second);
+	g_print("%-10s %10s %10s %10s %10s\n", "(us)", "p50", "p95", "p99", "max");
+	for (i = 0; i < NUM_PHASES; i++) {
+		GArray *array = latencies[i];
+
+		if (array->len == 0)
+			continue;
+		g_array_sort(array, compare_double);
+		g_print("%-10s %10.1f %10.1f %10.1f %10.1f\n", phase_names[i],
+			percentile(array, 50), percentile(array, 95),
+			percentile(array, 99), g_array_index(array, double, array->len - 1));
+	}
+	g_print("\n");
+}
+
+static int run(const char *type, char **sizes)
+{
+	struct fp_print_data *print;
+	GArray *latencies[NUM_PHASES];
+	GKeyFile *conf;
+	GTimer *timer;
+	GRand *rand;
+	char *dir, name[32];
+	guchar magic[] = "FPVIRT01";
+	guint populated = 0, i, j;
+	int r;
+
+	dir = g_build_filename(tmp_dir ? tmp_dir : g_get_tmp_dir(), "fprintd-storage-bench.XXXXXX", NULL);
+	if (mkdtemp(dir) == NULL) {
+		g_print("Could not create %s: %s\n", dir, g_strerror(errno));
+		return 1;
+	}
+	conf = load_conf(dir);
+	if (!set_storage(type, conf))
+		return 1;
+	r = store.init();
+	if (r < 0) {
+		g_print("Could not initialise %s: %s\n", type, g_strerror(-r));
+		return 1;
+	}
+
+	print = fp_print_data_from_data(magic, sizeof(magic) - 1);
+	timer = g_timer_new();
+	rand = g_rand_new_with_seed(1);
+
+	for (i = 0; sizes[i] != NULL; i++) {
+		guint users = atoi(sizes[i]), start = populated;
+		double saves_per_second;
+
+		if (users <= populated)
+			continue;
+
+		g_timer_start(timer);
+		for (; populated < users; populated++) {
+			username(name, sizeof(name), populated);
+			r = store.print_data_save(print, RIGHT_INDEX, name);
+			if (r < 0)
+				g_error("saving %s failed: %s", name, g_strerror(-r));
+		}
+		saves_per_second = (users - start) / g_timer_elapsed(timer, NULL);
+
+		for (j = 0; j < NUM_PHASES; j++)
+			latencies[j] = g_array_sized_new(FALSE, FALSE, sizeof(double), lookups);
+
+		for (j = 0; j < (guint) lookups; j++) {
+			struct fp_print_data *data;
+			GSList *fingers;
+			double us;
+
+			username(name, sizeof(name), g_rand_int_range(rand, 0, users));
+
+			g_timer_start(timer);
+			r = store.print_data_load(dev, RIGHT_INDEX, &data, name);
+			us = g_timer_elapsed(timer, NULL) * G_USEC_PER_SEC;
+			if (r < 0)
+				g_error("loading %s failed: %s", name, g_strerror(-r));
+			fp_print_data_free(data);
+			g_array_append_val(latencies[PHASE_LOAD], us);
+
+			g_timer_start(timer);
+			fingers = store.discover_prints(ddev, name);
+			us = g_timer_elapsed(timer, NULL) * G_USEC_PER_SEC;
+			g_slist_free(fingers);
+			g_array_append_val(latencies[PHASE_DISCOVER], us);
+		}
+
+		/* The largest size only, so that the store stays populated */
+		if (sizes[i + 1] == NULL) {
+			for (j = 0; j < MIN((guint) lookups, users); j++) {
+				double us;
+
+				username(name, sizeof(name), users - 1 - j);
+				g_timer_start(timer);
+				store.print_data_delete(ddev, RIGHT_INDEX, name);
+				us = g_timer_elapsed(timer, NULL) * G_USEC_PER_SEC;
+				g_array_append_val(latencies[PHASE_DELETE], us);
+			}
+		}
+
+		report(type, users, saves_per_second, latencies);
+		for (j = 0; j < NUM_PHASES; j++)
+			g_array_free(latencies[j], TRUE);
+	}
+
+	store.deinit();
+	fp_print_data_free(print);
+	g_timer_destroy(timer);
+	g_rand_free(rand);
+	g_key_file_free(conf);
+	if (keep)
+		g_print("Store kept in %s\n", dir);
+	else
+		remove_tree(dir);
+	g_free(dir);
+
+	return 0;
+}
+
+static const GOptionEntry entries[] = {
+	{ "users", 'u', 0, G_OPTION_ARG_STRING, &users_list, "Comma-separated store sizes, increasing (default 1000,10000,100000)", "LIST" },
+	{ "storage", 's', 0, G_OPTION_ARG_STRING, &storage_list, "Comma-separated storage types, file, encrypted or module paths (default file)", "LIST" },
+	{ "lookups", 'n', 0, G_OPTION_ARG_INT, &lookups, "Loads, listings and deletes to time at each size (default 10000)", NULL },
+	{ "config", 'c', 0, G_OPTION_ARG_FILENAME, &conf_path, "fprintd.conf settings to use", "FILE" },
+	{ "dir", 'd', 0, G_OPTION_ARG_FILENAME, &tmp_dir, "Where to create the stores (default the temporary directory)", "DIR" },
+	{ "keep", 'k', 0, G_OPTION_ARG_NONE, &keep, "Keep the stores", NULL },
+	{ NULL }
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+	char **types, **sizes;
+	int i, r = 0;
+
+	context = g_option_context_new ("Benchmark fprintd storage backends");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (g_option_context_parse (context, &argc, &argv, &err) == FALSE) {
+		g_print ("couldn't parse command-line options: %s\n", err->message);
+		g_error_free (err);
+		return 1;
+	}
+	if (lookups < 1) {
+		g_print ("Invalid options\n");
+		return 1;
+	}
+
+	g_thread_init (NULL);
+	open_device();
+
+	types = g_strsplit(storage_list, ",", -1);
+	sizes = g_strsplit(users_list, ",", -1);
+	for (i = 0; types[i] != NULL && r == 0; i++)
+		r = run(types[i], sizes);
+	g_strfreev(types);
+	g_strfreev(sizes);
+
+	return r;
+}
+
@@ -0,0 +1,120 @@
+#!/bin/sh
+#
+# Runs fprintd with virtual readers against a private bus, and
+# benchmarks it, or runs any other client against it.
+#
+# Usage: virtual-bench.sh FPRINTD VIRTUAL-MODULE COMMAND [ARGS...]
+#
+# The FPRINTD_VIRTUAL_* variables described in virtual-device.c are
+# passed through to the readers, and FPRINTD_BENCH_USERS gets that
+# many users, named fprintd-bench-0 and so on, a right index finger
+# enrolled, defaulting to 1.
+#
+# FPRINTD_BENCH_STORAGE sets the storage type, such as the full path
+# of src/.libs/libfaulty.so, and the file named by FPRINTD_BENCH_CONF
+# gets appended to fprintd.conf, to configure it.
+#
+# The command gets the daemon's process ID in FPRINTD_PID, how long
+# it took to get its bus name, in milliseconds, in FPRINTD_STARTUP_MS,
+# and the directory holding the prints, under prints/, in
+# FPRINTD_BENCH_DIR.
+#
+# Verification is only allowed to root without PolicyKit
+# authorizations, so this needs to run as root.
+
+if [ $# -lt 3 ]; then
+	echo "Usage: $0 FPRINTD VIRTUAL-MODULE COMMAND [ARGS...]" >&2
+	exit 1
+fi
+
+if [ "`id -u`" != 0 ]; then
+	echo "$0 needs to run as root, for fprintd to allow verification" >&2
+	exit 1
+fi
+
+FPRINTD=$1
+MODULE=$2
+shift 2
+
+case "$MODULE" in
+	/*) ;;
+	*) MODULE="`pwd`/$MODULE" ;;
+esac
+
+DIR=`mktemp -d ${TMPDIR:-/tmp}/fprintd-bench.XXXXXX` || exit 1
+BUS_PID=
+FPRINTD_PID=
+
+cleanup() {
+	[ -n "$FPRINTD_PID" ] && kill $FPRINTD_PID 2>/dev/null
+	[ -n "$BUS_PID" ] && kill $BUS_PID 2>/dev/null
+	rm -rf "$DIR"
+}
+trap cleanup EXIT INT TERM
+
+# Prints of the virtual driver (0x00ff), devtype 0, right index finger (7)
+i=0
+while [ $i -lt ${FPRINTD_BENCH_USERS:-1} ]; do
+	mkdir -p "$DIR/prints/fprintd-bench-$i/00ff/00000000"
+	echo virtual > "$DIR/prints/fprintd-bench-$i/00ff/00000000/7"
+	i=`expr $i + 1`
+done
+
+cat > "$DIR/fprintd.conf" <<EOF
+[storage]
+type=${FPRINTD_BENCH_STORAGE:-file}
+path=$DIR/prints
+EOF
+if [ -n "$FPRINTD_BENCH_CONF" ]; then
+	cat "$FPRINTD_BENCH_CONF" >> "$DIR/fprintd.conf" || exit 1
+fi
+
+cat > "$DIR/bus.conf" <<EOF
+<!DOCTYPE busconfig PUBLIC "-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN"
+ "http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd">
+<busconfig>
+  <type>fprintd-bench</type>
+  <listen>unix:path=$DIR/bus</listen>
+  <auth>EXTERNAL</auth>
+  <policy context="default">
+    <allow send_destination="*" eavesdrop="true"/>
+    <allow eavesdrop="true"/>
+    <allow own="*"/>
+  </policy>
+</busconfig>
+EOF
+
+BUS_PID=`dbus-daemon --config-file="$DIR/bus.conf" --fork --print-pid` || exit 1
+DBUS_SYSTEM_BUS_ADDRESS="unix:path=$DIR/bus"
+export DBUS_SYSTEM_BUS_ADDRESS
+
+START=`date +%s%N`
+LD_PRELOAD="$MODULE" "$FPRINTD" --no-timeout --config="$DIR/fprintd.conf" \
+	> "$DIR/fprintd.log" 2>&1 &
+FPRINTD_PID=$!
+
+# Wait for the daemon to get its name
+i=0
+until dbus-send --system --print-reply --dest=org.freedesktop.DBus / \
+	org.freedesktop.DBus.GetNameOwner string:net.reactivated.Fprint > /dev/null 2>&1; do
+	i=`expr $i + 1`
+	if [ $i -gt 1000 ] || ! kill -0 $FPRINTD_PID 2>/dev/null; then
+		echo "fprintd did not start:" >&2
+		cat "$DIR/fprintd.log" >&2
+		exit 1
+	fi
+	sleep 0.01
+done
+NOW=`date +%s%N`
+FPRINTD_STARTUP_MS=`expr \( $NOW - $START \) / 1000000`
+FPRINTD_BENCH_DIR=$DIR
+export FPRINTD_PID FPRINTD_STARTUP_MS FPRINTD_BENCH_DIR
+
+"$@"
+STATUS=$?
+
+if [ $STATUS -ne 0 ]; then
+	echo "fprintd log:" >&2
+	cat "$DIR/fprintd.log" >&2
+fi
+exit $STATUS
@@ -0,0 +1,696 @@
+/*
+ * Virtual fingerprint readers for testing fprintd
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Stands in for libfprint when LD_PRELOADed into fprintd, emulating
+ * readers whose results are scripted through environment variables:
+ *
+ * FPRINTD_VIRTUAL_DEVICES   number of readers, defaults to 1
+ * FPRINTD_VIRTUAL_VERIFY    comma-separated verify results, used in turn:
+ *                           match, no-match, retry-scan, swipe-too-short,
+ *                           finger-not-centered, remove-and-retry,
+ *                           disconnected or error. Defaults to match
+ * FPRINTD_VIRTUAL_ENROLL    comma-separated enroll stage results, used in
+ *                           turn: pass, complete, fail, retry-scan,
+ *                           swipe-too-short, finger-not-centered,
+ *                           remove-and-retry, disconnected or error.
+ *                           Defaults to passing every stage
+ * FPRINTD_VIRTUAL_STAGES    number of enroll stages, defaults to 5
+ * FPRINTD_VIRTUAL_IDENTIFY  set to 1 for readers supporting identification,
+ *                           matching the first print of the gallery
+ * FPRINTD_VIRTUAL_SCAN_DELAY  milliseconds before each scan result,
+ *                           defaults to 100
+ * FPRINTD_VIRTUAL_OPEN_DELAY  milliseconds to open a reader, defaults to 0
+ * FPRINTD_VIRTUAL_REPLAY    comma-separated recordings made by fprintd with
+ *                           [debug] record-dir, used in turn by the readers,
+ *                           whose open, verify, identify and enroll results
+ *                           and delays then come from them, in a loop,
+ *                           instead of the above. Images aren't replayed
+ * FPRINTD_VIRTUAL_REPLAY_SPEED  how much faster than recorded to replay,
+ *                           0 for no delays at all, defaults to 1
+ * FPRINTD_VIRTUAL_PRINT_SIZE  bytes of the saved prints, padded to look
+ *                           like real templates, defaults to 8
+ *
+ * Everything happens from timers, driven by fprintd's main loop
+ * through fp_get_next_timeout() and fp_handle_events_timeout().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <glib.h>
+#include <libfprint/fprint.h>
+
+#define VIRTUAL_DRIVER_ID 0x00ff
+#define VIRTUAL_PRINT_MAGIC "FPVIRT01"
+
+struct fp_driver {
+	guint16 id;
+	const char *full_name;
+};
+
+enum replay_kind {
+	REPLAY_OPEN = 0,
+	REPLAY_VERIFY,
+	REPLAY_IDENTIFY,
+	REPLAY_ENROLL,
+	NUM_REPLAY_KINDS
+};
+
+static const char *replay_kinds[NUM_REPLAY_KINDS] = {
+	"open",
+	"verify",
+	"identify",
+	"enroll"
+};
+
+struct replay_entry {
+	int result;
+	/* in microseconds */
+	guint64 delay;
+};
+
+/* A recording, with each kind of result replayed in turn */
+struct replay {
+	GArray *entries[NUM_REPLAY_KINDS];
+	guint pos[NUM_REPLAY_KINDS];
+};
+
+struct fp_dscv_dev {
+	guint index;
+	/* Kept across opens, NULL if not replaying */
+	struct replay *replay;
+};
+
+struct fp_dev {
+	struct fp_dscv_dev *ddev;
+	/* Position in the scripted results */
+	guint verify_step;
+	guint enroll_step;
+	guint enroll_stage;
+};
+
+struct fp_print_data {
+	guint16 driver_id;
+	guint32 devtype;
+};
+
+enum event_type {
+	EVENT_OPEN,
+	EVENT_CLOSE,
+	EVENT_ENROLL_STAGE,
+	EVENT_VERIFY,
+	EVENT_IDENTIFY,
+	EVENT_STOP
+};
+
+struct event {
+	/* in microseconds, CLOCK_MONOTONIC */
+	guint64 when;
+	enum event_type type;
+	struct fp_dev *dev;
+	void (*callback) (void);
+	void *user_data;
+};
+
+static struct fp_driver virtual_driver = {
+	VIRTUAL_DRIVER_ID,
+	"Virtual fingerprint reader"
+};
+
+static struct fp_dscv_dev *dscv_devs = NULL;
+static guint num_devs = 1;
+static char **verify_script = NULL;
+static char **enroll_script = NULL;
+static int nr_enroll_stages = 5;
+static gboolean identification = FALSE;
+static guint64 scan_delay = 100 * 1000;
+static guint64 open_delay = 0;
+static double replay_speed = 1;
+static size_t print_size = 0;
+
+/* Pending events, soonest first */
+static GList *events = NULL;
+
+static guint64 now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (guint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static int get_int(const char *name, int def)
+{
+	const char *value = g_getenv(name);
+
+	if (value == NULL || *value == '\0')
+		return def;
+	return atoi(value);
+}
+
+static char **get_script(const char *name)
+{
+	const char *value = g_getenv(name);
+
+	if (value == NULL || *value == '\0')
+		return NULL;
+	return g_strsplit(value, ",", -1);
+}
+
+static struct replay *load_replay(const char *path)
+{
+	struct replay *replay;
+	char *contents;
+	char **lines;
+	guint i, kind;
+
+	if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+		g_warning("could not read recording %s", path);
+		return NULL;
+	}
+
+	replay = g_new0(struct replay, 1);
+	for (kind = 0; kind < NUM_REPLAY_KINDS; kind++)
+		replay->entries[kind] = g_array_new(FALSE, FALSE, sizeof(struct replay_entry));
+
+	lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+	for (i = 0; lines[i] != NULL; i++) {
+		struct replay_entry entry;
+		char **fields;
+
+		if (lines[i][0] == '#' || lines[i][0] == '\0')
+			continue;
+		fields = g_strsplit(lines[i], " ", -1);
+		if (g_strv_length(fields) >= 3) {
+			entry.result = atoi(fields[1]);
+			entry.delay = g_ascii_strtoull(fields[2], NULL, 10);
+			for (kind = 0; kind < NUM_REPLAY_KINDS; kind++) {
+				if (g_str_equal(fields[0], replay_kinds[kind]))
+					g_array_append_val(replay->entries[kind], entry);
+			}
+		}
+		g_strfreev(fields);
+	}
+	g_strfreev(lines);
+
+	return replay;
+}
+
+/* The next recorded result of that kind, if replaying */
+static struct replay_entry *replay_peek(struct fp_dev *dev, enum replay_kind kind)
+{
+	struct replay *replay = dev->ddev->replay;
+	GArray *entries;
+
+	if (replay == NULL)
+		return NULL;
+	entries = replay->entries[kind];
+	if (entries->len == 0)
+		return NULL;
+	return &g_array_index(entries, struct replay_entry,
+			      replay->pos[kind] % entries->len);
+}
+
+static gboolean replay_next(struct fp_dev *dev, enum replay_kind kind, int *result)
+{
+	struct replay_entry *entry = replay_peek(dev, kind);
+
+	if (entry == NULL)
+		return FALSE;
+	*result = entry->result;
+	dev->ddev->replay->pos[kind]++;
+	return TRUE;
+}
+
+static guint64 replay_delay(struct fp_dev *dev, enum replay_kind kind, guint64 def)
+{
+	struct replay_entry *entry = replay_peek(dev, kind);
+
+	if (entry == NULL)
+		return def;
+	if (replay_speed <= 0)
+		return 0;
+	return entry->delay / replay_speed;
+}
+
+static gint event_compare(gconstpointer a, gconstpointer b)
+{
+	const struct event *ea = a, *eb = b;
+
+	if (ea->when < eb->when)
+		return -1;
+	return ea->when > eb->when;
+}
+
+static void add_event(enum event_type type, struct fp_dev *dev, guint64 delay,
+	void (*callback) (void), void *user_data)
+{
+	struct event *event = g_new0(struct event, 1);
+
+	event->when = now() + delay;
+	event->type = type;
+	event->dev = dev;
+	event->callback = callback;
+	event->user_data = user_data;
+	events = g_list_insert_sorted(events, event, event_compare);
+}
+
+/* Cancels the scans in progress on the device */
+static void cancel_scans(struct fp_dev *dev)
+{
+	GList *l = events;
+
+	while (l != NULL) {
+		struct event *event = l->data;
+		GList *next = l->next;
+
+		if (event->dev == dev &&
+		    (event->type == EVENT_ENROLL_STAGE ||
+		     event->type == EVENT_VERIFY ||
+		     event->type == EVENT_IDENTIFY)) {
+			events = g_list_delete_link(events, l);
+			g_free(event);
+		}
+		l = next;
+	}
+}
+
+static int verify_result(const char *name)
+{
+	if (g_str_equal(name, "match"))
+		return FP_VERIFY_MATCH;
+	if (g_str_equal(name, "no-match"))
+		return FP_VERIFY_NO_MATCH;
+	if (g_str_equal(name, "retry-scan"))
+		return FP_VERIFY_RETRY;
+	if (g_str_equal(name, "swipe-too-short"))
+		return FP_VERIFY_RETRY_TOO_SHORT;
+	if (g_str_equal(name, "finger-not-centered"))
+		return FP_VERIFY_RETRY_CENTER_FINGER;
+	if (g_str_equal(name, "remove-and-retry"))
+		return FP_VERIFY_RETRY_REMOVE_FINGER;
+	if (g_str_equal(name, "disconnected"))
+		return -EPROTO;
+	return -EIO;
+}
+
+static int enroll_result(const char *name)
+{
+	if (g_str_equal(name, "pass"))
+		return FP_ENROLL_PASS;
+	if (g_str_equal(name, "complete"))
+		return FP_ENROLL_COMPLETE;
+	if (g_str_equal(name, "fail"))
+		return FP_ENROLL_FAIL;
+	if (g_str_equal(name, "retry-scan"))
+		return FP_ENROLL_RETRY;
+	if (g_str_equal(name, "swipe-too-short"))
+		return FP_ENROLL_RETRY_TOO_SHORT;
+	if (g_str_equal(name, "finger-not-centered"))
+		return FP_ENROLL_RETRY_CENTER_FINGER;
+	if (g_str_equal(name, "remove-and-retry"))
+		return FP_ENROLL_RETRY_REMOVE_FINGER;
+	if (g_str_equal(name, "disconnected"))
+		return -EPROTO;
+	return -EIO;
+}
+
+static int next_verify_result(struct fp_dev *dev, enum replay_kind kind)
+{
+	const char *name;
+	int r;
+
+	if (replay_next(dev, kind, &r))
+		return r;
+	if (verify_script == NULL)
+		return FP_VERIFY_MATCH;
+	name = verify_script[dev->verify_step++ % g_strv_length(verify_script)];
+	return verify_result(name);
+}
+
+static int next_enroll_result(struct fp_dev *dev)
+{
+	int r;
+
+	/* Recordings have the completion in them */
+	if (replay_next(dev, REPLAY_ENROLL, &r))
+		return r;
+
+	if (enroll_script == NULL) {
+		r = FP_ENROLL_PASS;
+	} else {
+		const char *name;
+
+		name = enroll_script[dev->enroll_step++ % g_strv_length(enroll_script)];
+		r = enroll_result(name);
+	}
+
+	/* Passing the last stage completes the enrollment */
+	if (r == FP_ENROLL_PASS && ++dev->enroll_stage >= nr_enroll_stages)
+		r = FP_ENROLL_COMPLETE;
+	return r;
+}
+
+static gboolean is_retry(int r)
+{
+	return r >= FP_VERIFY_RETRY;
+}
+
+static void fire_event(struct event *event)
+{
+	struct fp_dev *dev = event->dev;
+	int r;
+
+	switch (event->type) {
+	case EVENT_OPEN:
+		r = 0;
+		replay_next(dev, REPLAY_OPEN, &r);
+		((fp_dev_open_cb) event->callback) (dev, r, event->user_data);
+		if (r != 0)
+			g_free(dev);
+		break;
+	case EVENT_CLOSE:
+		((fp_dev_close_cb) event->callback) (dev, event->user_data);
+		g_free(dev);
+		break;
+	case EVENT_STOP:
+		((fp_verify_stop_cb) event->callback) (dev, event->user_data);
+		break;
+	case EVENT_VERIFY:
+		r = next_verify_result(dev, REPLAY_VERIFY);
+		/* The driver keeps scanning after retries */
+		if (is_retry(r))
+			add_event(EVENT_VERIFY, dev, replay_delay(dev, REPLAY_VERIFY, scan_delay),
+				  event->callback, event->user_data);
+		((fp_verify_cb) event->callback) (dev, r, NULL, event->user_data);
+		break;
+	case EVENT_IDENTIFY:
+		r = next_verify_result(dev, REPLAY_IDENTIFY);
+		if (is_retry(r))
+			add_event(EVENT_IDENTIFY, dev, replay_delay(dev, REPLAY_IDENTIFY, scan_delay),
+				  event->callback, event->user_data);
+		((fp_identify_cb) event->callback) (dev, r, 0, NULL, event->user_data);
+		break;
+	case EVENT_ENROLL_STAGE: {
+		struct fp_print_data *print = NULL;
+
+		r = next_enroll_result(dev);
+		if (r == FP_ENROLL_PASS || is_retry(r))
+			add_event(EVENT_ENROLL_STAGE, dev, replay_delay(dev, REPLAY_ENROLL, scan_delay),
+				  event->callback, event->user_data);
+		if (r == FP_ENROLL_COMPLETE) {
+			print = g_new0(struct fp_print_data, 1);
+			print->driver_id = VIRTUAL_DRIVER_ID;
+			print->devtype = 0;
+		}
+		((fp_enroll_stage_cb) event->callback) (dev, r, print, NULL, event->user_data);
+		break;
+	}
+	}
+}
+
+int fp_init(void)
+{
+	char **replays;
+	const char *speed;
+	guint i;
+
+	num_devs = get_int("FPRINTD_VIRTUAL_DEVICES", 1);
+	verify_script = get_script("FPRINTD_VIRTUAL_VERIFY");
+	enroll_script = get_script("FPRINTD_VIRTUAL_ENROLL");
+	nr_enroll_stages = get_int("FPRINTD_VIRTUAL_STAGES", 5);
+	identification = get_int("FPRINTD_VIRTUAL_IDENTIFY", 0) != 0;
+	scan_delay = (guint64) get_int("FPRINTD_VIRTUAL_SCAN_DELAY", 100) * 1000;
+	open_delay = (guint64) get_int("FPRINTD_VIRTUAL_OPEN_DELAY", 0) * 1000;
+	print_size = MAX(get_int("FPRINTD_VIRTUAL_PRINT_SIZE", 0), 0);
+
+	replays = get_script("FPRINTD_VIRTUAL_REPLAY");
+	speed = g_getenv("FPRINTD_VIRTUAL_REPLAY_SPEED");
+	if (speed != NULL && *speed != '\0')
+		replay_speed = g_ascii_strtod(speed, NULL);
+
+	dscv_devs = g_new0(struct fp_dscv_dev, num_devs);
+	for (i = 0; i < num_devs; i++) {
+		dscv_devs[i].index = i;
+		if (replays != NULL)
+			dscv_devs[i].replay = load_replay(replays[i % g_strv_length(replays)]);
+	}
+	g_strfreev(replays);
+
+	g_message("emulating %u virtual readers", num_devs);
+	return 0;
+}
+
+void fp_exit(void)
+{
+}
+
+struct fp_dscv_dev **fp_discover_devs(void)
+{
+	struct fp_dscv_dev **devs;
+	guint i;
+
+	devs = g_new0(struct fp_dscv_dev *, num_devs + 1);
+	for (i = 0; i < num_devs; i++)
+		devs[i] = &dscv_devs[i];
+	return devs;
+}
+
+void fp_dscv_devs_free(struct fp_dscv_dev **devs)
+{
+	g_free(devs);
+}
+
+struct fp_driver *fp_dscv_dev_get_driver(struct fp_dscv_dev *dev)
+{
+	return &virtual_driver;
+}
+
+/* All the readers share the same prints */
+uint32_t fp_dscv_dev_get_devtype(struct fp_dscv_dev *dev)
+{
+	return 0;
+}
+
+struct fp_driver *fp_dev_get_driver(struct fp_dev *dev)
+{
+	return &virtual_driver;
+}
+
+uint32_t fp_dev_get_devtype(struct fp_dev *dev)
+{
+	return 0;
+}
+
+uint16_t fp_driver_get_driver_id(struct fp_driver *drv)
+{
+	return drv->id;
+}
+
+const char *fp_driver_get_name(struct fp_driver *drv)
+{
+	return "virtual";
+}
+
+const char *fp_driver_get_full_name(struct fp_driver *drv)
+{
+	return drv->full_name;
+}
+
+enum fp_scan_type fp_driver_get_scan_type(struct fp_driver *drv)
+{
+	return FP_SCAN_TYPE_PRESS;
+}
+
+int fp_dev_get_nr_enroll_stages(struct fp_dev *dev)
+{
+	return nr_enroll_stages;
+}
+
+int fp_dev_supports_identification(struct fp_dev *dev)
+{
+	return identification;
+}
+
+int fp_dev_supports_print_data(struct fp_dev *dev, struct fp_print_data *data)
+{
+	return data->driver_id == VIRTUAL_DRIVER_ID;
+}
+
+size_t fp_print_data_get_data(struct fp_print_data *data, unsigned char **ret)
+{
+	size_t magic_len = strlen(VIRTUAL_PRINT_MAGIC);
+	size_t len = MAX(magic_len, print_size), i;
+
+	/* Freed by the caller with free() */
+	*ret = malloc(len);
+	if (*ret == NULL)
+		return 0;
+	memcpy(*ret, VIRTUAL_PRINT_MAGIC, magic_len);
+	for (i = magic_len; i < len; i++)
+		(*ret)[i] = (i * 131) & 0xff;
+	return len;
+}
+
+/* Any file will do, so that the prints can be seeded by hand */
+struct fp_print_data *fp_print_data_from_data(unsigned char *buf, size_t buflen)
+{
+	struct fp_print_data *data = g_new0(struct fp_print_data, 1);
+
+	data->driver_id = VIRTUAL_DRIVER_ID;
+	data->devtype = 0;
+	return data;
+}
+
+uint16_t fp_print_data_get_driver_id(struct fp_print_data *data)
+{
+	return data->driver_id;
+}
+
+uint32_t fp_print_data_get_devtype(struct fp_print_data *data)
+{
+	return data->devtype;
+}
+
+void fp_print_data_free(struct fp_print_data *data)
+{
+	g_free(data);
+}
+
+void fp_img_free(struct fp_img *img)
+{
+}
+
+size_t fp_get_pollfds(struct fp_pollfd **pollfds)
+{
+	*pollfds = NULL;
+	return 0;
+}
+
+void fp_set_pollfd_notifiers(fp_pollfd_added_cb added_cb,
+	fp_pollfd_removed_cb removed_cb)
+{
+}
+
+int fp_get_next_timeout(struct timeval *tv)
+{
+	struct event *event;
+	guint64 t;
+
+	if (events == NULL)
+		return 0;
+
+	event = events->data;
+	t = now();
+	t = event->when > t ? event->when - t : 0;
+	tv->tv_sec = t / G_USEC_PER_SEC;
+	tv->tv_usec = t % G_USEC_PER_SEC;
+	return 1;
+}
+
+int fp_handle_events_timeout(struct timeval *timeout)
+{
+	guint64 t = now();
+
+	/* Callbacks can add and cancel events */
+	while (events != NULL) {
+		struct event *event = events->data;
+
+		if (event->when > t)
+			break;
+		events = g_list_delete_link(events, events);
+		fire_event(event);
+		g_free(event);
+	}
+
+	return 0;
+}
+
+int fp_async_dev_open(struct fp_dscv_dev *ddev, fp_dev_open_cb callback,
+	void *user_data)
+{
+	struct fp_dev *dev = g_new0(struct fp_dev, 1);
+
+	dev->ddev = ddev;
+	add_event(EVENT_OPEN, dev, replay_delay(dev, REPLAY_OPEN, open_delay),
+		  (void (*) (void)) callback, user_data);
+	return 0;
+}
+
+void fp_async_dev_close(struct fp_dev *dev, fp_dev_close_cb callback,
+	void *user_data)
+{
+	cancel_scans(dev);
+	add_event(EVENT_CLOSE, dev, 0, (void (*) (void)) callback, user_data);
+}
+
+int fp_async_enroll_start(struct fp_dev *dev, fp_enroll_stage_cb callback,
+	void *user_data)
+{
+	dev->enroll_stage = 0;
+	add_event(EVENT_ENROLL_STAGE, dev, replay_delay(dev, REPLAY_ENROLL, scan_delay),
+		  (void (*) (void)) callback, user_data);
+	return 0;
+}
+
+int fp_async_enroll_stop(struct fp_dev *dev, fp_enroll_stop_cb callback,
+	void *user_data)
+{
+	cancel_scans(dev);
+	add_event(EVENT_STOP, dev, 0, (void (*) (void)) callback, user_data);
+	return 0;
+}
+
+int fp_async_verify_start(struct fp_dev *dev, struct fp_print_data *data,
+	fp_verify_cb callback, void *user_data)
+{
+	add_event(EVENT_VERIFY, dev, replay_delay(dev, REPLAY_VERIFY, scan_delay),
+		  (void (*) (void)) callback, user_data);
+	return 0;
+}
+
+int fp_async_verify_stop(struct fp_dev *dev, fp_verify_stop_cb callback,
+	void *user_data)
+{
+	cancel_scans(dev);
+	add_event(EVENT_STOP, dev, 0, (void (*) (void)) callback, user_data);
+	return 0;
+}
+
+int fp_async_identify_start(struct fp_dev *dev, struct fp_print_data **gallery,
+	fp_identify_cb callback, void *user_data)
+{
+	if (!identification)
+		return -ENOTSUP;
+	add_event(EVENT_IDENTIFY, dev, replay_delay(dev, REPLAY_IDENTIFY, scan_delay),
+		  (void (*) (void)) callback, user_data);
+	return 0;
+}
+
+int fp_async_identify_stop(struct fp_dev *dev, fp_identify_stop_cb callback,
+	void *user_data)
+{
+	cancel_scans(dev);
+	add_event(EVENT_STOP, dev, 0, (void (*) (void)) callback, user_data);
+	return 0;
+}
+